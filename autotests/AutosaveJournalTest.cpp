@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a test of recovering the changes recorded in an
+ * autosave journal.
+ */
+
+// Qt includes
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+
+// Application includes
+#include "AutosaveJournal.h"
+#include "Document.h"
+#include "DocumentFloss.h"
+#include "SchemeManager.h"
+#include "configuration.h"
+
+class AutosaveJournalTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void recoverChanges();
+
+private:
+    void record(AutosaveJournal &journal);
+    QByteArray patternData(Document &document);
+
+    QTemporaryDir m_directory;
+};
+
+void AutosaveJournalTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    Configuration::setDocument_AutosaveJournal(true);
+
+    // new documents need their default scheme to exist
+    SchemeManager::createScheme(Configuration::palette_DefaultScheme());
+
+    QVERIFY(m_directory.isValid());
+}
+
+/**
+ * Record the changes made to the document and append them to the journal,
+ * as the timers would when editing.
+ *
+ * @param journal is the AutosaveJournal to record
+ */
+void AutosaveJournalTest::record(AutosaveJournal &journal)
+{
+    QVERIFY(QMetaObject::invokeMethod(&journal, "recordChanges"));
+    QVERIFY(QMetaObject::invokeMethod(&journal, "flush"));
+}
+
+QByteArray AutosaveJournalTest::patternData(Document &document)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_0);
+    stream << *document.pattern();
+
+    return data;
+}
+
+/**
+ * Make changes to the cells, backstitches, knots and palette, and operations
+ * on the whole pattern, in several records, and check that replaying the
+ * journal on to a new document gives the same pattern.
+ */
+void AutosaveJournalTest::recoverChanges()
+{
+    QUrl url = QUrl::fromLocalFile(m_directory.filePath(QStringLiteral("recover.kxs")));
+    Document document;
+    QByteArray expected;
+
+    {
+        AutosaveJournal journal(&document);
+        QVERIFY(!journal.open(url));
+
+        Pattern *pattern = document.pattern();
+        StitchData &stitches = pattern->stitches();
+
+        for (int i = 0; i < 4; ++i) {
+            DocumentFloss *documentFloss = new DocumentFloss(QString::number(i + 1), i, Qt::SolidLine, 2, 1);
+            documentFloss->setFlossColor(QColor::fromHsv(i * 90, 200, 200));
+            pattern->palette().add(i, documentFloss);
+        }
+
+        for (int i = 0; i < 10; ++i) {
+            stitches.addStitch(QPoint(i, i), Stitch::Full, i % 4);
+            stitches.addBackstitch(QPoint(i * 2, 0), QPoint(i * 2 + 2, 2), i % 4);
+            stitches.addFrenchKnot(QPoint(i * 2, 4), i % 4);
+        }
+
+        record(journal);
+
+        // removals from the middle of the lists and additions in the same record
+        delete stitches.takeBackstitch(QPoint(4, 0), QPoint(6, 2), 2);
+        delete stitches.takeFrenchKnot(QPoint(0, 4), 0);
+        stitches.addBackstitch(QPoint(0, 6), QPoint(2, 8), 3);
+        delete stitches.takeBackstitch(QPoint(0, 6), QPoint(2, 8), 3);
+        stitches.addFrenchKnot(QPoint(6, 6), 1);
+        stitches.deleteStitch(QPoint(3, 3), Stitch::Full, 3);
+        pattern->palette().swap(0, 1);
+        delete pattern->palette().remove(3);
+        pattern->palette().setCurrentIndex(2);
+
+        record(journal);
+
+        // more changes than backstitches records them in full
+        for (int i = 0; i < 20; ++i) {
+            stitches.addBackstitch(QPoint(0, 10), QPoint(2, 12), 0);
+            delete stitches.takeBackstitch(QPoint(0, 10), QPoint(2, 12), 0);
+        }
+
+        stitches.addBackstitch(QPoint(2, 10), QPoint(4, 12), 1);
+
+        record(journal);
+
+        // operations on the whole pattern are recorded as operations rather than as every cell
+        QMap<int, int> colorIndexes;
+        colorIndexes.insert(0, 1);
+
+        stitches.insertRows(2, 3);
+        stitches.mirror(Qt::Horizontal);
+        stitches.rotate(StitchData::Rotate90);
+        StitchData::ColorChanges changes = stitches.remapColors(colorIndexes);
+        stitches.addStitch(QPoint(1, 1), Stitch::Full, 2);
+        QVERIFY(!stitches.allCellsChanged());
+        QCOMPARE(stitches.operations().count(), 4);
+
+        record(journal);
+
+        // undoing the remap restores the merged stitches from the recorded changes
+        QMap<int, int> inverse;
+        inverse.insert(1, 0);
+
+        stitches.remapColors(inverse, changes);
+        stitches.removeColumns(0, 1);
+        QVERIFY(!stitches.allCellsChanged());
+
+        record(journal);
+
+        // an operation after individual changes in the same record records everything
+        stitches.addStitch(QPoint(2, 2), Stitch::Full, 1);
+        stitches.mirror(Qt::Vertical);
+        QVERIFY(stitches.allCellsChanged());
+
+        record(journal);
+
+        expected = patternData(document);
+
+        // the journal files are left in place as they would be after a crash
+    }
+
+    Document recovered;
+    AutosaveJournal journal(&recovered);
+
+    QVERIFY(journal.open(url));
+    QVERIFY(journal.recover());
+    QCOMPARE(patternData(recovered), expected);
+
+    journal.close();
+}
+
+QTEST_GUILESS_MAIN(AutosaveJournalTest)
+
+#include "AutosaveJournalTest.moc"
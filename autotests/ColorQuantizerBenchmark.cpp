@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a benchmark of the CIELAB color quantizer against the
+ * ImageMagick quantize and map used by the import.
+ */
+
+// Qt includes
+#include <QByteArray>
+#include <QColor>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QTest>
+
+// wrap include to silence unused-parameter warning from Magick++ include file
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsuggest-override"
+#include <Magick++.h>
+#pragma GCC diagnostic pop
+
+// Application includes
+#include "ColorQuantizer.h"
+
+/**
+ * The width and height of the benchmark image in pixels.
+ */
+static const int imageSize = 400;
+
+/**
+ * The number of colors in the benchmark palette, similar to a floss scheme.
+ */
+static const int paletteSize = 450;
+
+/**
+ * The maximum number of colors in the quantized image.
+ */
+static const int maximumColors = 40;
+
+class ColorQuantizerBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cielab_data();
+    void cielab();
+    void imageMagick();
+
+private:
+    void checkColors(const QByteArray &pixels, bool exact);
+
+    QList<QRgb> m_palette;
+    QByteArray m_pixels;
+};
+
+void ColorQuantizerBenchmark::initTestCase()
+{
+    Magick::InitializeMagick(nullptr);
+
+    // a palette spread over the hues with several saturations and values, plus greys
+    for (int i = 0; m_palette.count() < paletteSize; ++i) {
+        int hue = (i * 7) % 360;
+        int saturation = 40 + (i * 37) % 216;
+        int value = 40 + (i * 53) % 216;
+        m_palette.append((i % 10 == 0) ? qRgb(value, value, value) : QColor::fromHsv(hue, saturation, value).rgb());
+    }
+
+    // smooth gradients with noise, similar to a photograph
+    QRandomGenerator random(1);
+    m_pixels.resize(imageSize * imageSize * 4);
+    uchar *pixel = reinterpret_cast<uchar *>(m_pixels.data());
+
+    for (int y = 0; y < imageSize; ++y) {
+        for (int x = 0; x < imageSize; ++x, pixel += 4) {
+            int noise = random.bounded(-8, 9);
+            pixel[0] = uchar(qBound(0, x * 255 / imageSize + noise, 255));
+            pixel[1] = uchar(qBound(0, y * 255 / imageSize + noise, 255));
+            pixel[2] = uchar(qBound(0, (x + y) * 255 / (imageSize * 2) + noise, 255));
+            pixel[3] = 255;
+        }
+    }
+}
+
+/**
+ * Check that a quantized image uses no more than the maximum number of colors.
+ *
+ * @param pixels is the image as 8 bit RGBA values
+ * @param exact is true if the colors must be exact palette colors, ImageMagick
+ * converts the colors to its quantum depth and back so they may differ slightly
+ */
+void ColorQuantizerBenchmark::checkColors(const QByteArray &pixels, bool exact)
+{
+    QSet<QRgb> palette(m_palette.constBegin(), m_palette.constEnd());
+    QSet<QRgb> used;
+    const uchar *pixel = reinterpret_cast<const uchar *>(pixels.constData());
+
+    for (int i = 0; i < imageSize * imageSize; ++i, pixel += 4) {
+        used.insert(qRgb(pixel[0], pixel[1], pixel[2]));
+    }
+
+    QVERIFY(used.count() <= maximumColors);
+    QVERIFY(!exact || palette.contains(used));
+}
+
+void ColorQuantizerBenchmark::cielab_data()
+{
+    QTest::addColumn<int>("dithering");
+
+    QTest::newRow("none") << int(Configuration::EnumImport_Dithering::NoDithering);
+    QTest::newRow("ordered") << int(Configuration::EnumImport_Dithering::Ordered);
+    QTest::newRow("floyd-steinberg") << int(Configuration::EnumImport_Dithering::FloydSteinberg);
+}
+
+void ColorQuantizerBenchmark::cielab()
+{
+    QFETCH(int, dithering);
+
+    ColorQuantizer quantizer(m_palette);
+    quantizer.setMaximumColors(maximumColors);
+    quantizer.setDithering(Configuration::EnumImport_Dithering::type(dithering));
+
+    QByteArray pixels;
+
+    QBENCHMARK {
+        pixels = m_pixels;
+        pixels.detach();
+        quantizer.quantize(reinterpret_cast<uchar *>(pixels.data()), imageSize, imageSize);
+    }
+
+    checkColors(pixels, true);
+}
+
+/**
+ * The ImageMagick reduction and mapping as done by ImportPipeline, the colors
+ * are reduced in RGB and then mapped to the palette.
+ */
+void ColorQuantizerBenchmark::imageMagick()
+{
+    QByteArray map;
+
+    for (QRgb rgb : std::as_const(m_palette)) {
+        map.append(char(qRed(rgb)));
+        map.append(char(qGreen(rgb)));
+        map.append(char(qBlue(rgb)));
+        map.append(char(0xff));
+    }
+
+    Magick::Image colorMap(m_palette.count(), 1, "RGBA", Magick::CharPixel, map.constData());
+    Magick::Image source(imageSize, imageSize, "RGBA", Magick::CharPixel, m_pixels.constData());
+    QByteArray pixels(m_pixels.size(), Qt::Uninitialized);
+
+    QBENCHMARK {
+        Magick::Image image = source;
+        image.quantizeColorSpace(Magick::RGBColorspace);
+        image.quantizeColors(maximumColors);
+        image.quantize();
+        image.map(colorMap);
+        image.write(0, 0, imageSize, imageSize, "RGBA", Magick::CharPixel, pixels.data());
+    }
+
+    checkColors(pixels, false);
+}
+
+QTEST_GUILESS_MAIN(ColorQuantizerBenchmark)
+
+#include "ColorQuantizerBenchmark.moc"
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a benchmark of saving and loading documents with and
+ * without compressed sections.
+ */
+
+// Qt includes
+#include <QBuffer>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QTest>
+
+// Application includes
+#include "Document.h"
+#include "DocumentFloss.h"
+#include "SchemeManager.h"
+#include "configuration.h"
+
+/**
+ * The width and height of the benchmark pattern in cells.
+ */
+static const int patternSize = 500;
+
+/**
+ * The number of colors used in the benchmark pattern.
+ */
+static const int patternColors = 40;
+
+class DocumentFileBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void save_data();
+    void save();
+    void load_data();
+    void load();
+    void snapshot();
+
+private:
+    void fillDocument(Document &document);
+    QByteArray saveDocument(Document &document, bool compress);
+};
+
+void DocumentFileBenchmark::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+
+    // new documents need their default scheme to exist
+    SchemeManager::createScheme(Configuration::palette_DefaultScheme());
+}
+
+/**
+ * Fill a document with a pattern of full and fractional stitches in bands of
+ * color, with backstitches and knots, similar to an imported image.
+ *
+ * @param document is the Document to fill
+ */
+void DocumentFileBenchmark::fillDocument(Document &document)
+{
+    Pattern *pattern = document.pattern();
+    pattern->stitches().resize(patternSize, patternSize);
+
+    for (int i = 0; i < patternColors; ++i) {
+        DocumentFloss *documentFloss = new DocumentFloss(QString::number(i + 1), i, Qt::SolidLine, 2, 1);
+        documentFloss->setFlossColor(QColor::fromHsv(i * 359 / patternColors, 200, 200));
+        pattern->palette().add(i, documentFloss);
+    }
+
+    for (int y = 0; y < patternSize; ++y) {
+        for (int x = 0; x < patternSize; ++x) {
+            int colorIndex = ((x / 7) + (y / 5)) % patternColors;
+
+            if ((x + y) % 11) {
+                pattern->stitches().addStitch(QPoint(x, y), Stitch::Full, colorIndex);
+            } else {
+                pattern->stitches().addStitch(QPoint(x, y), Stitch::TLQtr, colorIndex);
+                pattern->stitches().addStitch(QPoint(x, y), Stitch::BRQtr, (colorIndex + 1) % patternColors);
+            }
+        }
+    }
+
+    for (int i = 0; i < patternSize; ++i) {
+        pattern->stitches().addBackstitch(QPoint(i * 2, 0), QPoint(i * 2, patternSize * 2), i % patternColors);
+        pattern->stitches().addFrenchKnot(QPoint(i * 2, i * 2), i % patternColors);
+    }
+}
+
+/**
+ * Save a document to memory.
+ *
+ * @param document is the Document to save
+ * @param compress is true if the sections are compressed
+ *
+ * @return the saved data
+ */
+QByteArray DocumentFileBenchmark::saveDocument(Document &document, bool compress)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    document.write(stream, compress);
+
+    return data;
+}
+
+void DocumentFileBenchmark::save_data()
+{
+    QTest::addColumn<bool>("compress");
+
+    QTest::newRow("uncompressed") << false;
+    QTest::newRow("compressed") << true;
+}
+
+void DocumentFileBenchmark::save()
+{
+    QFETCH(bool, compress);
+
+    Document document;
+    fillDocument(document);
+
+    QByteArray data;
+
+    QBENCHMARK {
+        data = saveDocument(document, compress);
+    }
+
+    qInfo() << "saved size" << data.size() << "bytes";
+}
+
+void DocumentFileBenchmark::load_data()
+{
+    save_data();
+}
+
+void DocumentFileBenchmark::load()
+{
+    QFETCH(bool, compress);
+
+    Document original;
+    fillDocument(original);
+    QByteArray data = saveDocument(original, compress);
+
+    Document document;
+
+    QBENCHMARK {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream stream(&buffer);
+        document.readKXStitch(stream);
+    }
+
+    // the loaded document is saved again to check it is the same as the original
+    QCOMPARE(document.pattern()->stitches().width(), patternSize);
+    QCOMPARE(document.pattern()->palette().flosses().count(), patternColors);
+    QCOMPARE(saveDocument(document, compress), data);
+}
+
+void DocumentFileBenchmark::snapshot()
+{
+    Document document;
+    fillDocument(document);
+
+    Document *snapshot = nullptr;
+
+    // the time taken on the GUI thread before a save can start
+    QBENCHMARK {
+        delete snapshot;
+        snapshot = document.snapshot();
+    }
+
+    // a snapshot must be written the same as the document it was taken from
+    QCOMPARE(saveDocument(*snapshot, false), saveDocument(document, false));
+    QCOMPARE(saveDocument(*snapshot, true), saveDocument(document, true));
+
+    delete snapshot;
+}
+
+QTEST_GUILESS_MAIN(DocumentFileBenchmark)
+
+#include "DocumentFileBenchmark.moc"
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a test of reading the summary from the start of a
+ * saved document.
+ */
+
+// Qt includes
+#include <QBuffer>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QTest>
+#include <QtEndian>
+
+// Application includes
+#include "Document.h"
+#include "DocumentFloss.h"
+#include "DocumentSummary.h"
+#include "SchemeManager.h"
+#include "configuration.h"
+
+/**
+ * The offset of the file version, following the "KXStitchDoc" header.
+ */
+static const int versionOffset = 11;
+
+/**
+ * The offset of the summary size, following the file version.
+ */
+static const int sizeOffset = versionOffset + 4;
+
+class DocumentSummaryTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void roundTrip();
+    void olderVersion();
+    void truncated_data();
+    void truncated();
+
+private:
+    bool readSummary(const QByteArray &data, DocumentSummary &summary);
+
+    QByteArray m_data;
+};
+
+/**
+ * Save a document with a known number of colors, stitches, backstitches and
+ * knots, larger than the thumbnail so the thumbnail is scaled.
+ */
+void DocumentSummaryTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+
+    // new documents need their default scheme to exist
+    SchemeManager::createScheme(Configuration::palette_DefaultScheme());
+
+    Document document;
+    document.setProperty(QStringLiteral("title"), QStringLiteral("Summary"));
+
+    Pattern *pattern = document.pattern();
+    StitchData &stitches = pattern->stitches();
+    stitches.resize(300, 200);
+
+    for (int i = 0; i < 3; ++i) {
+        DocumentFloss *documentFloss = new DocumentFloss(QString::number(i + 1), i, Qt::SolidLine, 2, 1);
+        documentFloss->setFlossColor(QColor::fromHsv(i * 120, 200, 200));
+        pattern->palette().add(i, documentFloss);
+    }
+
+    // ten full stitches and a cell of two quarters gives twelve stitches
+    for (int i = 0; i < 10; ++i) {
+        stitches.addStitch(QPoint(i * 20, i * 10), Stitch::Full, i % 3);
+    }
+
+    stitches.addStitch(QPoint(250, 150), Stitch::TLQtr, 0);
+    stitches.addStitch(QPoint(250, 150), Stitch::BRQtr, 1);
+
+    for (int i = 0; i < 5; ++i) {
+        stitches.addBackstitch(QPoint(i * 2, 0), QPoint(i * 2 + 2, 2), i % 3);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        stitches.addFrenchKnot(QPoint(i * 2, 4), i % 3);
+    }
+
+    QDataStream stream(&m_data, QIODevice::WriteOnly);
+    document.write(stream, true);
+}
+
+/**
+ * Read the summary from a copy of a saved file.
+ *
+ * @param data is the contents of the file
+ * @param summary is the DocumentSummary to read in to
+ *
+ * @return the result of DocumentSummary::read
+ */
+bool DocumentSummaryTest::readSummary(const QByteArray &data, DocumentSummary &summary)
+{
+    QByteArray copy = data;
+    QBuffer buffer(&copy);
+    buffer.open(QIODevice::ReadOnly);
+
+    return summary.read(&buffer);
+}
+
+void DocumentSummaryTest::roundTrip()
+{
+    DocumentSummary summary;
+    QVERIFY(readSummary(m_data, summary));
+
+    QCOMPARE(summary.title(), QStringLiteral("Summary"));
+    QCOMPARE(summary.width(), 300);
+    QCOMPARE(summary.height(), 200);
+    QCOMPARE(summary.colors(), 3);
+    QCOMPARE(summary.stitches(), 12);
+    QCOMPARE(summary.backstitches(), 5);
+    QCOMPARE(summary.knots(), 4);
+    QCOMPARE(summary.thumbnail().size(), QSize(300, 200).scaled(DocumentSummary::thumbnailSize, DocumentSummary::thumbnailSize, Qt::KeepAspectRatio));
+}
+
+/**
+ * Files of version 104 and earlier have no summary.
+ */
+void DocumentSummaryTest::olderVersion()
+{
+    QByteArray data = m_data;
+    qToBigEndian<qint32>(104, data.data() + versionOffset);
+
+    DocumentSummary summary;
+    QVERIFY(!readSummary(data, summary));
+}
+
+void DocumentSummaryTest::truncated_data()
+{
+    QTest::addColumn<int>("length");
+
+    QTest::newRow("header") << versionOffset - 1;
+    QTest::newRow("version") << sizeOffset - 1;
+    QTest::newRow("size") << sizeOffset + 2;
+    QTest::newRow("summary") << sizeOffset + 4 + 10;
+}
+
+/**
+ * A file cut short, including within the size prefix or with a size beyond
+ * the end of the file, has no summary.
+ */
+void DocumentSummaryTest::truncated()
+{
+    QFETCH(int, length);
+
+    DocumentSummary summary;
+    QVERIFY(!readSummary(m_data.left(length), summary));
+}
+
+QTEST_GUILESS_MAIN(DocumentSummaryTest)
+
+#include "DocumentSummaryTest.moc"
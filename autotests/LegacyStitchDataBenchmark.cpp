@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a benchmark of reading the legacy stitch data versions
+ * 100 to 102, comparing the current reader with the previous one that
+ * collected the stitch queues in a hash before placing them in the grid.
+ */
+
+// Qt includes
+#include <QBuffer>
+#include <QDataStream>
+#include <QHash>
+#include <QTest>
+
+// Application includes
+#include "StitchData.h"
+
+/**
+ * The width and height of the benchmark pattern in cells.
+ */
+static const int patternSize = 400;
+
+/**
+ * Test if a cell of the benchmark pattern has stitches, about two thirds of
+ * the cells are filled.
+ *
+ * @param column is the column of the cell
+ * @param row is the row of the cell
+ *
+ * @return true if the cell has stitches
+ */
+static bool cellFilled(int column, int row)
+{
+    return ((column * 7 + row * 13) % 3) != 0;
+}
+
+/**
+ * Write a stitch queue for a cell of the benchmark pattern.
+ *
+ * @param stream is the QDataStream to write to
+ * @param column is the column of the cell
+ * @param row is the row of the cell
+ */
+static void writeQueue(QDataStream &stream, int column, int row)
+{
+    StitchQueue stitchQueue;
+
+    if ((column + row) % 5) {
+        stitchQueue.add(Stitch::Full, (column / 8 + row / 8) % 30);
+    } else {
+        stitchQueue.add(Stitch::TLQtr, column % 30);
+        stitchQueue.add(Stitch::BRQtr, row % 30);
+    }
+
+    stream << stitchQueue;
+}
+
+/**
+ * Create a stream of stitch data in one of the legacy versions.
+ *
+ * @param version is the stitch data version, 100, 101 or 102
+ *
+ * @return the stream data
+ */
+static QByteArray createLegacyStream(int version)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_0);
+
+    stream << qint32(version);
+    stream << qint32(patternSize);
+    stream << qint32(patternSize);
+
+    if (version == 100) {
+        stream << qint32(1); // layers
+    }
+
+    stream << qint32(patternSize); // columns
+
+    for (int column = 0; column < patternSize; ++column) {
+        int rows = 0;
+
+        for (int row = 0; row < patternSize; ++row) {
+            rows += cellFilled(column, row);
+        }
+
+        stream << qint32(rows);
+
+        for (int row = 0; row < patternSize; ++row) {
+            if (cellFilled(column, row)) {
+                if (version == 100) {
+                    stream << qint32(0); // layer
+                }
+
+                stream << qint32(column);
+                stream << qint32(row);
+                writeQueue(stream, column, row);
+            }
+        }
+    }
+
+    if (version == 102) {
+        stream << qint32(patternSize);
+
+        for (int i = 0; i < patternSize; ++i) {
+            stream << Backstitch(QPoint(i * 2, 0), QPoint(i * 2, patternSize * 2), i % 30);
+        }
+
+        stream << qint32(patternSize);
+
+        for (int i = 0; i < patternSize; ++i) {
+            stream << Knot(QPoint(i * 2, i * 2), i % 30);
+        }
+    }
+
+    return data;
+}
+
+/**
+ * Read legacy stitch data the way it was read before the queues were placed
+ * directly into the grid. The queues are collected in a nested hash, which is
+ * then probed for every cell of the pattern. Version 100 is resized here so
+ * the result can be compared, the previous reader set the size without
+ * allocating the grid.
+ *
+ * @param stream is the QDataStream to read from
+ * @param stitchData is the StitchData to read into
+ */
+static void readPreviousVersion(QDataStream &stream, StitchData &stitchData)
+{
+    qint32 version;
+    qint32 width;
+    qint32 height;
+    qint32 layers = 1;
+    qint32 columns;
+    qint32 rows;
+    qint32 count;
+    QHash<int, QHash<int, StitchQueue *>> stitches;
+
+    stitchData.clear();
+
+    stream >> version;
+    stream >> width;
+    stream >> height;
+    stitchData.resize(width, height);
+
+    if (version == 100) {
+        stream >> layers;
+    }
+
+    while (layers--) {
+        stream >> columns;
+
+        while (columns--) {
+            stream >> rows;
+
+            while (rows--) {
+                qint32 layer;
+                qint32 column;
+                qint32 row;
+
+                if (version == 100) {
+                    stream >> layer;
+                }
+
+                stream >> column;
+                stream >> row;
+
+                StitchQueue *stitchQueue = new StitchQueue;
+                stitches[column][row] = stitchQueue;
+                stream >> *stitchQueue;
+            }
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (stitches[x][y]) {
+                stitchData.replaceStitchQueueAt(x, y, stitches[x][y]);
+            }
+        }
+    }
+
+    if (version == 102) {
+        stream >> count;
+
+        while (count--) {
+            Backstitch *backstitch = new Backstitch;
+            stream >> *backstitch;
+            stitchData.addBackstitch(backstitch);
+        }
+
+        stream >> count;
+
+        while (count--) {
+            Knot *knot = new Knot;
+            stream >> *knot;
+            stitchData.addFrenchKnot(knot);
+        }
+    }
+}
+
+/**
+ * Read legacy stitch data from memory with either reader.
+ *
+ * @param data is the stream data
+ * @param previous is true to use the previous reader, false for the current one
+ * @param stitchData is the StitchData to read into
+ */
+static void readStream(const QByteArray &data, bool previous, StitchData &stitchData)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_4_0);
+
+    if (previous) {
+        readPreviousVersion(stream, stitchData);
+    } else {
+        stream >> stitchData;
+    }
+}
+
+/**
+ * Write stitch data in the current version for comparison.
+ *
+ * @param stitchData is the StitchData to write
+ *
+ * @return the stream data
+ */
+static QByteArray currentVersion(const StitchData &stitchData)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_0);
+    stream << stitchData;
+
+    return data;
+}
+
+class LegacyStitchDataBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void read_data();
+    void read();
+};
+
+void LegacyStitchDataBenchmark::read_data()
+{
+    QTest::addColumn<int>("version");
+    QTest::addColumn<bool>("previous");
+
+    for (int version = 100; version <= 102; ++version) {
+        QTest::addRow("v%d previous reader", version) << version << true;
+        QTest::addRow("v%d current reader", version) << version << false;
+    }
+}
+
+void LegacyStitchDataBenchmark::read()
+{
+    QFETCH(int, version);
+    QFETCH(bool, previous);
+
+    QByteArray data = createLegacyStream(version);
+    StitchData stitchData;
+
+    QBENCHMARK {
+        readStream(data, previous, stitchData);
+    }
+
+    // both readers must produce the same stitches
+    StitchData other;
+    readStream(data, !previous, other);
+
+    QCOMPARE(stitchData.width(), patternSize);
+    QCOMPARE(currentVersion(stitchData), currentVersion(other));
+}
+
+QTEST_GUILESS_MAIN(LegacyStitchDataBenchmark)
+
+#include "LegacyStitchDataBenchmark.moc"
@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a test of the PC Stitch readers with valid, truncated
+ * and corrupted files.
+ */
+
+// Qt includes
+#include <QBuffer>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QTest>
+
+// Application includes
+#include "Document.h"
+#include "Exceptions.h"
+
+/**
+ * The width and height of the generated patterns in cells.
+ */
+static const int patternWidth = 20;
+static const int patternHeight = 15;
+
+/**
+ * The DMC floss names used in the generated palettes.
+ */
+static const char *const flossNames[] = {"310", "White", "321", "699", "797", "5200"};
+static const int flossCount = sizeof(flossNames) / sizeof(flossNames[0]);
+
+/**
+ * The number of extra stitches, knots and backstitches in the generated patterns.
+ */
+static const int extraCount = 5;
+static const int knotCount = 6;
+static const int backstitchCount = 7;
+
+/**
+ * The PC Stitch stitch type of a petite stitch, which has no KXStitch equivalent.
+ */
+static const quint8 petiteType = 13;
+
+/**
+ * The PC Stitch stitch types written in the runs, all the types with a
+ * KXStitch equivalent other than those that map to Stitch::Delete.
+ */
+static const quint8 stitchTypes[] = {1, 2, 3, 4, 5, 6, 7, 9, 10, 11, 12};
+static const int stitchTypeCount = sizeof(stitchTypes) / sizeof(stitchTypes[0]);
+
+/**
+ * The number of corrupted copies of each generated file that are read.
+ */
+static const int mutations = 500;
+
+static void appendUInt8(QByteArray &data, quint8 value)
+{
+    data.append(char(value));
+}
+
+static void appendUInt16(QByteArray &data, quint16 value)
+{
+    data.append(char(value & 0xff));
+    data.append(char(value >> 8));
+}
+
+static void appendUInt32(QByteArray &data, quint32 value)
+{
+    appendUInt16(data, quint16(value & 0xffff));
+    appendUInt16(data, quint16(value >> 16));
+}
+
+/**
+ * Append a fixed length field padded with spaces, or zeros for binary fields.
+ */
+static void appendField(QByteArray &data, const QByteArray &value, int size, char padding = ' ')
+{
+    data.append(value.left(size));
+    data.append(QByteArray(size - qMin(size, int(value.size())), padding));
+}
+
+static void appendString(QByteArray &data, const QByteArray &value)
+{
+    appendUInt16(data, value.size());
+    data.append(value);
+}
+
+class PCStitchReaderTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void readValid_data();
+    void readValid();
+    void readTruncated_data();
+    void readTruncated();
+    void readMutated_data();
+    void readMutated();
+
+private:
+    void addVersions();
+    QByteArray createFile(int version);
+    bool read(const QByteArray &data, Document &document);
+};
+
+void PCStitchReaderTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+
+    // the readers need the DMC scheme and the default symbol library
+    QString dataDirectory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QVERIFY(QDir().mkpath(dataDirectory + QLatin1String("/schemes")));
+    QVERIFY(QDir().mkpath(dataDirectory + QLatin1String("/symbols")));
+
+    QFile::remove(dataDirectory + QLatin1String("/schemes/dmc.xml"));
+    QFile::remove(dataDirectory + QLatin1String("/symbols/kxstitch.sym"));
+    QVERIFY(QFile::copy(QStringLiteral(KXSTITCH_SOURCE_DIR "/schemes/dmc.xml"), dataDirectory + QLatin1String("/schemes/dmc.xml")));
+    QVERIFY(QFile::copy(QStringLiteral(KXSTITCH_SOURCE_DIR "/symbols/kxstitch.sym"), dataDirectory + QLatin1String("/symbols/kxstitch.sym")));
+}
+
+void PCStitchReaderTest::addVersions()
+{
+    QTest::addColumn<int>("version");
+
+    QTest::newRow("PCStitch 5") << 5;
+    QTest::newRow("PCStitch 6") << 6;
+    QTest::newRow("PCStitch 7") << 7;
+}
+
+/**
+ * Create a PC Stitch file with a palette, runs of each stitch type including
+ * a petite stitch, extra stitches, knots and backstitches.
+ *
+ * @param version is the PC Stitch version, 5, 6 or 7
+ *
+ * @return a QByteArray containing the file
+ */
+QByteArray PCStitchReaderTest::createFile(int version)
+{
+    QByteArray data;
+    appendField(data, QStringLiteral("PCStitch %1 Pattern File").arg(version).toLatin1(), 256, '\0');
+    data.append(QByteArray(8, '\0')); // unknown
+
+    appendUInt16(data, patternWidth);
+    appendUInt16(data, patternHeight);
+    appendUInt16(data, 14); // cloth count
+    appendUInt16(data, 14);
+
+    if (version == 7) {
+        data.append("\xf0\xe0\xd0\xff", 4); // fabric color
+    }
+
+    appendString(data, "author");
+    appendString(data, "copyright");
+    appendString(data, "title");
+    appendString(data, "Aida");
+    appendString(data, ""); // instructions
+
+    if (version == 7) {
+        appendString(data, "keywords");
+        appendString(data, "website");
+        appendUInt16(data, 2); // default stitch strands
+        appendUInt16(data, 1); // default backstitch strands
+    }
+
+    for (int i = 0; i < flossCount; ++i) {
+        QByteArray name(flossNames[i]);
+        QByteArray rgba = QByteArray::fromRawData("\x80\x40\x20\xff", 4);
+
+        if (i == 0) {
+            if (version == 5) {
+                data.append("PCStitch 5 Floss Palette!", 25);
+                appendUInt16(data, flossCount);
+                appendField(data, "DMC", 10);
+                appendField(data, "Anchor", 10);
+                appendField(data, "Coates", 10);
+                appendString(data, "PCStitch Symbols");
+                data.append(QByteArray(4, '\0')); // unknown
+            } else if (version == 6) {
+                data.append("PCStitch 6 Floss Palette!", 25);
+                data.append(QByteArray(12, '\0')); // unknown
+                appendField(data, "DMC", 30);
+                appendUInt16(data, flossCount);
+                appendString(data, "PCStitch Symbols");
+                data.append(QByteArray(4, '\0')); // unknown
+            } else {
+                data.append("PCStitch Floss Palette!!!", 25);
+                data.append(QByteArray(4, '\0')); // unknown
+                appendUInt16(data, flossCount);
+            }
+        }
+
+        if (version == 5) {
+            data.append(rgba);
+            appendField(data, name, 30);
+            appendField(data, "description", 50);
+            appendUInt8(data, 'A' + i); // symbol
+            appendUInt16(data, 2); // stitch strands
+            appendUInt16(data, 1); // backstitch strands
+        } else if (version == 6) {
+            appendField(data, "description", 30);
+            data.append(rgba);
+            appendField(data, name, 10);
+            data.append(QByteArray(59, '\0'));
+            appendUInt16(data, 2); // stitch strands
+            appendUInt16(data, 1); // backstitch strands
+            data.append(QByteArray(2, '\0'));
+            appendField(data, "description", 30);
+            data.append(QByteArray(5, '\0'));
+            appendField(data, "Black", 25);
+        } else {
+            appendField(data, "DMC", 33);
+            appendField(data, name, 10);
+            appendField(data, "description", 30);
+            data.append(QByteArray(4, '\0'));
+            data.append(rgba);
+            data.append(QByteArray(81, '\0'));
+            appendField(data, "PCStitch Symbols", 30);
+            data.append(QByteArray(7, '\0'));
+            appendField(data, "description", 30);
+            data.append(rgba);
+            appendField(data, name, 10);
+            data.append(QByteArray(7, '\0'));
+        }
+    }
+
+    // runs of each type, the first column is a petite stitch and the last is empty
+    int cells = patternWidth * patternHeight;
+    int run = 0;
+
+    appendUInt16(data, patternHeight);
+    appendUInt8(data, 1);
+    appendUInt8(data, petiteType);
+
+    for (int i = patternHeight; i < cells - patternHeight;) {
+        int count = qMin(7, cells - patternHeight - i);
+        appendUInt16(data, count);
+        appendUInt8(data, (i % flossCount) + 1);
+        appendUInt8(data, stitchTypes[run++ % stitchTypeCount]);
+        i += count;
+    }
+
+    appendUInt16(data, patternHeight);
+    appendUInt8(data, 0xff);
+    appendUInt8(data, 0xff);
+
+    appendUInt32(data, extraCount);
+
+    for (int i = 0; i < extraCount; ++i) {
+        appendUInt16(data, 1);
+        appendUInt16(data, i + 1);
+
+        for (int quadrant = 0; quadrant < 4; ++quadrant) {
+            appendUInt8(data, (quadrant == 3) ? 0xff : quadrant + 1);
+            appendUInt8(data, (quadrant == 3) ? 0xff : quadrant + 9);
+        }
+    }
+
+    appendUInt32(data, knotCount);
+
+    for (int i = 0; i < knotCount; ++i) {
+        appendUInt16(data, i * 3 + 1);
+        appendUInt16(data, i * 2 + 1);
+
+        if (version == 7) {
+            appendUInt16(data, (i % flossCount) + 1);
+        } else {
+            appendUInt8(data, (i % flossCount) + 1);
+        }
+    }
+
+    appendUInt32(data, backstitchCount);
+
+    for (int i = 0; i < backstitchCount; ++i) {
+        appendUInt16(data, i + 1);
+        appendUInt16(data, i + 1);
+        appendUInt16(data, 1);
+        appendUInt16(data, i + 2);
+        appendUInt16(data, i + 1);
+        appendUInt16(data, 9);
+
+        if (version == 5) {
+            appendUInt8(data, (i % flossCount) + 1);
+        } else {
+            appendUInt16(data, (i % flossCount) + 1);
+        }
+    }
+
+    data.append(QByteArray(8, '\0')); // unknown
+
+    return data;
+}
+
+/**
+ * Read a file in to a document.
+ *
+ * @param data is the file
+ * @param document is the Document to read in to
+ *
+ * @return @c true if the file was read, @c false if it was rejected
+ */
+bool PCStitchReaderTest::read(const QByteArray &data, Document &document)
+{
+    QByteArray copy(data);
+    QBuffer buffer(&copy);
+    buffer.open(QIODevice::ReadOnly);
+    QDataStream stream(&buffer);
+
+    try {
+        document.readPCStitch(stream);
+    } catch (const InvalidFile &e) {
+        return false;
+    } catch (const InvalidFileVersion &e) {
+        return false;
+    } catch (const FailedReadFile &e) {
+        return false;
+    }
+
+    return true;
+}
+
+void PCStitchReaderTest::readValid_data()
+{
+    addVersions();
+}
+
+void PCStitchReaderTest::readValid()
+{
+    QFETCH(int, version);
+
+    Document document;
+    QVERIFY(read(createFile(version), document));
+
+    StitchData &stitches = document.pattern()->stitches();
+    QCOMPARE(stitches.width(), patternWidth);
+    QCOMPARE(stitches.height(), patternHeight);
+    QCOMPARE(document.pattern()->palette().flosses().count(), flossCount);
+    QCOMPARE(stitches.knots().count(), knotCount);
+    QCOMPARE(stitches.backstitches().count(), backstitchCount);
+
+    // the petite stitches are skipped, the extra stitches are added to the first column
+    for (int y = 0; y < patternHeight; ++y) {
+        StitchQueue *stitchQueue = stitches.stitchQueueAt(0, y);
+        QCOMPARE(stitchQueue ? stitchQueue->count() : 0, (y < extraCount) ? 3 : 0);
+    }
+
+    QVERIFY(stitches.stitchQueueAt(1, 0) != nullptr);
+    QVERIFY(stitches.stitchQueueAt(patternWidth - 1, 0) == nullptr);
+}
+
+void PCStitchReaderTest::readTruncated_data()
+{
+    addVersions();
+}
+
+/**
+ * Every truncated file must be rejected, except where only the unknown bytes
+ * at the end of the file are missing.
+ */
+void PCStitchReaderTest::readTruncated()
+{
+    QFETCH(int, version);
+
+    QByteArray data = createFile(version);
+
+    for (int size = 0; size < data.size() - 8; ++size) {
+        Document document;
+
+        if (read(data.left(size), document)) {
+            QFAIL(qPrintable(QStringLiteral("A file truncated to %1 bytes was read").arg(size)));
+        }
+    }
+}
+
+void PCStitchReaderTest::readMutated_data()
+{
+    addVersions();
+}
+
+/**
+ * Corrupted files must either be read or rejected. Anything the reader accepts
+ * must be within the pattern and use colors from the palette.
+ */
+void PCStitchReaderTest::readMutated()
+{
+    QFETCH(int, version);
+
+    QByteArray data = createFile(version);
+    QRandomGenerator random(version);
+
+    for (int i = 0; i < mutations; ++i) {
+        QByteArray mutated(data);
+        int changes = random.bounded(1, 5);
+
+        while (changes--) {
+            // most changes are made after the header, where the counts and coordinates are
+            int position = random.bounded(256, int(mutated.size()));
+            mutated[position] = char(random.bounded(256));
+        }
+
+        Document document;
+
+        if (!read(mutated, document)) {
+            continue;
+        }
+
+        StitchData &stitches = document.pattern()->stitches();
+        QMap<int, DocumentFloss *> flosses = document.pattern()->palette().flosses();
+        QRect snapArea(0, 0, stitches.width() * 2 + 1, stitches.height() * 2 + 1);
+
+        for (int y = 0; y < stitches.height(); ++y) {
+            for (int x = 0; x < stitches.width(); ++x) {
+                if (StitchQueue *stitchQueue = stitches.stitchQueueAt(x, y)) {
+                    for (const Stitch *stitch : std::as_const(*stitchQueue)) {
+                        QVERIFY(flosses.contains(stitch->colorIndex));
+                    }
+                }
+            }
+        }
+
+        for (const Knot *knot : std::as_const(stitches.knots())) {
+            QVERIFY(snapArea.contains(knot->position));
+            QVERIFY(flosses.contains(knot->colorIndex));
+        }
+
+        for (const Backstitch *backstitch : std::as_const(stitches.backstitches())) {
+            QVERIFY(snapArea.contains(backstitch->start));
+            QVERIFY(snapArea.contains(backstitch->end));
+            QVERIFY(flosses.contains(backstitch->colorIndex));
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(PCStitchReaderTest)
+
+#include "PCStitchReaderTest.moc"
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a test of remapping the colors of the stitch data and
+ * reversing the remap.
+ */
+
+// Qt includes
+#include <QMap>
+#include <QTest>
+#include <QVector>
+
+// Application includes
+#include "StitchData.h"
+
+// C++ includes
+#include <algorithm>
+
+class StitchDataTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void remapColors();
+
+private:
+    QVector<int> colorIndexes(StitchData &stitches);
+};
+
+/**
+ * Get the color index of every stitch, backstitch and knot in the order of
+ * the stitch data.
+ *
+ * @param stitches is the StitchData
+ *
+ * @return the color indexes
+ */
+QVector<int> StitchDataTest::colorIndexes(StitchData &stitches)
+{
+    QVector<int> indexes;
+
+    for (int y = 0; y < stitches.height(); ++y) {
+        for (int x = 0; x < stitches.width(); ++x) {
+            if (StitchQueue *stitchQueue = stitches.stitchQueueAt(x, y)) {
+                for (const Stitch *stitch : std::as_const(*stitchQueue)) {
+                    indexes.append(stitch->colorIndex);
+                }
+            }
+        }
+    }
+
+    for (const Backstitch *backstitch : std::as_const(stitches.backstitches())) {
+        indexes.append(backstitch->colorIndex);
+    }
+
+    for (const Knot *knot : std::as_const(stitches.knots())) {
+        indexes.append(knot->colorIndex);
+    }
+
+    return indexes;
+}
+
+/**
+ * Replace a color with a color that is already in use, as the palette replace
+ * color command does, then undo and redo it twice. The pattern spans several
+ * blocks of rows and has cells with stitches of both colors, so the change bit
+ * of each item must stay aligned across the blocks, backstitches and knots for
+ * the merged stitches to get their original color back.
+ */
+void StitchDataTest::remapColors()
+{
+    StitchData stitches;
+    stitches.resize(20, 100);
+
+    for (int y = 0; y < stitches.height(); ++y) {
+        for (int x = 0; x < stitches.width(); ++x) {
+            switch ((x + y * 3) % 4) {
+            case 0:
+                stitches.addStitch(QPoint(x, y), Stitch::Full, (x + y) % 3);
+                break;
+
+            case 1:
+                stitches.addStitch(QPoint(x, y), Stitch::TLQtr, 0);
+                stitches.addStitch(QPoint(x, y), Stitch::BRQtr, 1);
+                break;
+
+            case 2:
+                stitches.addStitch(QPoint(x, y), Stitch::TBHalf, 1);
+                break;
+
+            default:
+                break; // no stitches
+            }
+        }
+    }
+
+    for (int i = 0; i < 30; ++i) {
+        stitches.addBackstitch(QPoint(i, 0), QPoint(i, 2), i % 3);
+        stitches.addFrenchKnot(QPoint(i * 2, 4), (i + 1) % 3);
+    }
+
+    QVector<int> original = colorIndexes(stitches);
+    QVERIFY(original.contains(0));
+    QVERIFY(original.contains(1));
+
+    QMap<int, int> replace;
+    replace.insert(0, 1);
+
+    QMap<int, int> restore;
+    restore.insert(1, 0);
+
+    QVector<int> replaced = original;
+    std::replace(replaced.begin(), replaced.end(), 0, 1);
+
+    for (int cycle = 0; cycle < 2; ++cycle) {
+        StitchData::ColorChanges changes = stitches.remapColors(replace);
+        QCOMPARE(colorIndexes(stitches), replaced);
+
+        stitches.remapColors(restore, changes);
+        QCOMPARE(colorIndexes(stitches), original);
+    }
+}
+
+QTEST_GUILESS_MAIN(StitchDataTest)
+
+#include "StitchDataTest.moc"
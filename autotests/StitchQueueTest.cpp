@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a test of creating the stitches of a cell from the
+ * colors of its quarters.
+ */
+
+// Qt includes
+#include <QTest>
+
+// Application includes
+#include "Stitch.h"
+
+class StitchQueueTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void fromQuarters();
+};
+
+/**
+ * Check that StitchQueue::fromQuarters gives the same stitches, in the same
+ * order, as adding each quarter to a queue as the import used to. Each quarter
+ * takes one of four colors or no stitch, which covers all 625 arrangement
+ * codes. The colors are not the labels used in the codes, so a mix up of
+ * labels and colors would be found.
+ */
+void StitchQueueTest::fromQuarters()
+{
+    static const int colors[5] = {-1, 7, 3, 12, 0};
+
+    for (int arrangement = 0; arrangement < 5 * 5 * 5 * 5; ++arrangement) {
+        int colorIndexes[4];
+
+        for (int zone = 0, digits = arrangement; zone < 4; ++zone, digits /= 5) {
+            colorIndexes[zone] = colors[digits % 5];
+        }
+
+        StitchQueue expected;
+
+        for (int zone = 0; zone < 4; ++zone) {
+            if (colorIndexes[zone] != -1) {
+                expected.add(stitchMap[0][zone], colorIndexes[zone]);
+            }
+        }
+
+        StitchQueue *queue = StitchQueue::fromQuarters(colorIndexes);
+        QByteArray arrangementName = QByteArray::number(arrangement);
+
+        if (expected.isEmpty()) {
+            QVERIFY2(queue == nullptr, arrangementName.constData());
+            continue;
+        }
+
+        QVERIFY2(queue != nullptr, arrangementName.constData());
+        QCOMPARE(queue->count(), expected.count());
+
+        for (int i = 0; i < expected.count(); ++i) {
+            QCOMPARE(queue->at(i)->type, expected.at(i)->type);
+            QCOMPARE(queue->at(i)->colorIndex, expected.at(i)->colorIndex);
+        }
+
+        delete queue;
+    }
+}
+
+QTEST_GUILESS_MAIN(StitchQueueTest)
+
+#include "StitchQueueTest.moc"
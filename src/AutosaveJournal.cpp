@@ -0,0 +1,687 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a journal of unsaved changes to a document that allows
+ * the changes to be recovered if the application exits unexpectedly.
+ */
+
+// Class include
+#include "AutosaveJournal.h"
+
+// Qt includes
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent>
+#include <QtEndian>
+
+// KF includes
+#include <KLocalizedString>
+
+// Application includes
+#include "Document.h"
+#include "Exceptions.h"
+#include "configuration.h"
+
+/**
+ * Identifies a journal file, the characters KXSJ.
+ */
+static const quint32 journalMagic = 0x4b58534a;
+
+/**
+ * The version of the journal header and records.
+ */
+static const qint32 journalVersion = 102;
+
+/**
+ * The delay in milliseconds before changes are recorded, combining changes
+ * made in quick succession in to a single record.
+ */
+static const int recordDelay = 500;
+
+/**
+ * The delay in milliseconds before records are appended to the journal.
+ */
+static const int flushDelay = 2000;
+
+/**
+ * Write the changes to the backstitches or knots to a record. If all of them
+ * have changed they are written in full, otherwise the changes are written in
+ * the order they were made.
+ *
+ * @param stream is a reference to the QDataStream of the record
+ * @param allChanged is @c true if all the items have changed
+ * @param items is the list of items
+ * @param changes is the list of changes from StitchData
+ */
+template <class T>
+static void writeChanges(QDataStream &stream, bool allChanged, const QList<T *> &items, const QVector<QPair<int, T>> &changes)
+{
+    stream << allChanged;
+
+    if (allChanged) {
+        stream << qint32(items.count());
+
+        for (const T *item : items) {
+            stream << *item;
+        }
+    } else {
+        stream << qint32(changes.count());
+
+        for (const QPair<int, T> &change : changes) {
+            stream << qint32(change.first);
+
+            if (change.first == -1) {
+                stream << change.second;
+            }
+        }
+    }
+}
+
+/**
+ * Apply the changes to the backstitches or knots written by writeChanges().
+ *
+ * @param stream is a reference to the QDataStream of the record
+ * @param items is the list of items to be changed
+ */
+template <class T>
+static void readChanges(QDataStream &stream, QList<T *> &items)
+{
+    bool allChanged;
+    qint32 count;
+
+    stream >> allChanged;
+    stream >> count;
+
+    if (allChanged) {
+        qDeleteAll(items);
+        items.clear();
+    }
+
+    while ((count-- > 0) && (stream.status() == QDataStream::Ok)) {
+        qint32 index = -1;
+
+        if (!allChanged) {
+            stream >> index;
+        }
+
+        if (index == -1) {
+            T *item = new T;
+            stream >> *item;
+            items.append(item);
+        } else if ((index >= 0) && (index < items.count())) {
+            delete items.takeAt(index);
+        } else {
+            throw FailedReadFile(QString(i18n("Invalid journal record")));
+        }
+    }
+}
+
+AutosaveJournal::AutosaveJournal(Document *document, QObject *parent)
+    : QObject(parent)
+    , m_document(document)
+    , m_lock(nullptr)
+    , m_holding(false)
+    , m_changed(false)
+    , m_checkpointSnapshot(nullptr)
+{
+    m_recordTimer.setSingleShot(true);
+    m_recordTimer.setInterval(recordDelay);
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(flushDelay);
+
+    connect(&m_recordTimer, &QTimer::timeout, this, &AutosaveJournal::recordChanges);
+    connect(&m_flushTimer, &QTimer::timeout, this, &AutosaveJournal::flush);
+    connect(&m_checkpointTimer, &QTimer::timeout, this, &AutosaveJournal::checkpoint);
+    connect(&m_checkpointWatcher, &QFutureWatcher<bool>::finished, this, &AutosaveJournal::checkpointFinished);
+}
+
+AutosaveJournal::~AutosaveJournal()
+{
+    m_checkpointWatcher.waitForFinished();
+    delete m_checkpointSnapshot;
+    delete m_lock;
+}
+
+bool AutosaveJournal::open(const QUrl &url)
+{
+    close();
+
+    if (!Configuration::document_AutosaveJournal() || !url.isLocalFile() || !lock(url)) {
+        return false;
+    }
+
+    bool recoverable = QFile::exists(m_checkpointPath);
+
+    if (m_file.open(QIODevice::ReadOnly)) {
+        recoverable = (readHeader() && !m_file.atEnd()) || recoverable;
+        m_file.close();
+    }
+
+    if (!recoverable) {
+        discard();
+    }
+
+    return recoverable;
+}
+
+bool AutosaveJournal::recover()
+{
+    if (m_lock == nullptr) {
+        return false;
+    }
+
+    bool recovered = true;
+
+    try {
+        if (QFile::exists(m_checkpointPath)) {
+            QFile checkpoint(m_checkpointPath);
+
+            if (!checkpoint.open(QIODevice::ReadOnly)) {
+                throw FailedReadFile(checkpoint.errorString());
+            }
+
+            QDataStream stream(&checkpoint);
+            m_document->readKXStitch(stream);
+            m_document->setUrl(m_url);
+        }
+
+        if (m_file.open(QIODevice::ReadOnly) && readHeader()) {
+            char length[4];
+
+            // a crash while appending may leave an incomplete record at the end, which is ignored
+            while (m_file.read(length, 4) == 4) {
+                QByteArray record = m_file.read(qFromBigEndian<quint32>(length));
+
+                if (quint32(record.size()) != qFromBigEndian<quint32>(length)) {
+                    break;
+                }
+
+                QDataStream stream(record);
+                stream.setVersion(QDataStream::Qt_4_0);
+                applyRecord(stream);
+            }
+        }
+
+        m_file.close();
+    } catch (const InvalidFile &e) {
+        recovered = false;
+    } catch (const InvalidFileVersion &e) {
+        recovered = false;
+    } catch (const FailedReadFile &e) {
+        recovered = false;
+    }
+
+    if (!recovered) {
+        // restart from whatever was recovered, recording the whole document in the first record
+        m_file.close();
+        discard();
+        m_document->pattern()->stitches().markChanged();
+        m_document->pattern()->palette().markChanged();
+        recordChanges();
+        return false;
+    }
+
+    // the journal continues from the end of the recovered records
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        release(true);
+        return true;
+    }
+
+    m_document->pattern()->palette().resetChanges();
+    m_document->pattern()->stitches().resetChanges();
+    m_pending.clear();
+    m_changed = true;
+    m_checkpointTimer.start(Configuration::document_CheckpointInterval() * 60 * 1000);
+
+    return true;
+}
+
+void AutosaveJournal::discard()
+{
+    if (m_lock == nullptr) {
+        return;
+    }
+
+    QFile::remove(m_checkpointPath);
+
+    if (restart()) {
+        m_document->pattern()->palette().resetChanges();
+        m_document->pattern()->stitches().resetChanges();
+        m_pending.clear();
+        m_changed = false;
+    }
+}
+
+void AutosaveJournal::close()
+{
+    if (m_lock) {
+        release(true);
+    }
+}
+
+void AutosaveJournal::saveStarted(const QUrl &url)
+{
+    // a checkpoint in progress is completed first so that only one base is pending
+    if (m_checkpointSnapshot) {
+        m_checkpointWatcher.waitForFinished();
+        checkpointFinished();
+    }
+
+    // changes up to the snapshot are appended to the journal for the current base
+    recordChanges();
+    flush();
+
+    m_saveUrl = url;
+    m_holding = true;
+}
+
+void AutosaveJournal::saveFinished(bool success)
+{
+    if (!success) {
+        // the journal is still valid for the previous base
+        m_holding = false;
+        flush();
+        return;
+    }
+
+    // records held since the snapshot are the changes not included in the saved file
+    QByteArray pending = m_pending;
+
+    if (m_saveUrl != m_url) {
+        release(true);
+
+        if (!Configuration::document_AutosaveJournal() || !m_saveUrl.isLocalFile() || !lock(m_saveUrl)) {
+            return;
+        }
+    }
+
+    QFile::remove(m_checkpointPath);
+    m_pending = pending;
+    rebase(true);
+}
+
+void AutosaveJournal::scheduleRecord()
+{
+    if (m_file.isOpen()) {
+        m_recordTimer.start();
+    }
+}
+
+void AutosaveJournal::recordChanges()
+{
+    m_recordTimer.stop();
+
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    DocumentPalette &palette = m_document->pattern()->palette();
+    StitchData &stitches = m_document->pattern()->stitches();
+    bool allFlossesChanged = palette.allFlossesChanged();
+    bool allCellsChanged = stitches.allCellsChanged();
+
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_0);
+
+    stream << qint32(journalVersion);
+    stream << allFlossesChanged;
+
+    if (allFlossesChanged) {
+        stream << palette;
+    } else {
+        QSet<int> flossIndexes = palette.changedFlosses();
+
+        stream << qint32(palette.currentIndex());
+        stream << qint32(flossIndexes.count());
+
+        for (int flossIndex : flossIndexes) {
+            DocumentFloss *documentFloss = palette.floss(flossIndex);
+            stream << qint32(flossIndex);
+            stream << bool(documentFloss != nullptr);
+
+            if (documentFloss) {
+                stream << *documentFloss;
+            }
+        }
+    }
+
+    stream << allCellsChanged;
+
+    if (allCellsChanged) {
+        stream << stitches;
+    } else {
+        QSet<int> cells = stitches.changedCells();
+        int width = stitches.width();
+
+        // operations on the whole pattern, such as a resize or a color remap, are repeated when
+        // the record is applied rather than writing every cell they changed
+        stream << stitches.operations();
+        stream << qint32(width);
+        stream << qint32(stitches.height());
+        stream << qint32(cells.count());
+
+        for (int cell : cells) {
+            StitchQueue *stitchQueue = stitches.stitchQueueAt(cell % width, cell / width);
+            stream << qint32(cell);
+            stream << bool(stitchQueue != nullptr);
+
+            if (stitchQueue) {
+                stream << *stitchQueue;
+            }
+        }
+
+        writeChanges(stream, stitches.allBackstitchesChanged(), stitches.backstitches(), stitches.backstitchChanges());
+        writeChanges(stream, stitches.allKnotsChanged(), stitches.knots(), stitches.knotChanges());
+    }
+
+    palette.resetChanges();
+    stitches.resetChanges();
+
+    char length[4];
+    qToBigEndian<quint32>(record.size(), length);
+    m_pending.append(length, 4);
+    m_pending.append(record);
+    m_changed = true;
+
+    if (!m_holding && !m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+void AutosaveJournal::flush()
+{
+    m_flushTimer.stop();
+
+    if (m_holding || !m_file.isOpen() || m_pending.isEmpty()) {
+        return;
+    }
+
+    if ((m_file.write(m_pending) != m_pending.size()) || !m_file.flush()) {
+        // an incomplete journal can not be replayed reliably, so stop journaling this document
+        release(true);
+        return;
+    }
+
+    m_pending.clear();
+}
+
+void AutosaveJournal::checkpoint()
+{
+    if (!m_file.isOpen() || m_holding || !m_changed) {
+        return;
+    }
+
+    // changes up to the snapshot are appended to the journal for the current base
+    recordChanges();
+    flush();
+
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    m_checkpointSnapshot = m_document->snapshot();
+    m_holding = true;
+
+    Document *snapshot = m_checkpointSnapshot;
+    QString fileName = m_checkpointPath;
+    bool compress = Configuration::document_CompressFiles();
+
+    m_checkpointWatcher.setFuture(QtConcurrent::run([snapshot, fileName, compress]() {
+        QSaveFile file(fileName);
+
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+
+        QDataStream stream(&file);
+
+        try {
+            snapshot->write(stream, compress);
+        } catch (const FailedWriteFile &e) {
+            file.cancelWriting();
+            return false;
+        }
+
+        return file.commit();
+    }));
+}
+
+void AutosaveJournal::checkpointFinished()
+{
+    if (m_checkpointSnapshot == nullptr) {
+        return; // already handled by saveStarted or release
+    }
+
+    delete m_checkpointSnapshot;
+    m_checkpointSnapshot = nullptr;
+
+    rebase(m_checkpointWatcher.result());
+}
+
+bool AutosaveJournal::lock(const QUrl &url)
+{
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QLatin1String("/autosave");
+
+    if (!QDir().mkpath(directory)) {
+        return false;
+    }
+
+    QString path = directory + QLatin1Char('/') + QString::fromLatin1(QCryptographicHash::hash(url.toString().toUtf8(), QCryptographicHash::Sha1).toHex());
+    QLockFile *lockFile = new QLockFile(path + QLatin1String(".lock"));
+
+    // another instance editing the same document holds the lock, a lock left by a crashed instance is stale and is removed
+    if (!lockFile->tryLock(0)) {
+        delete lockFile;
+        return false;
+    }
+
+    m_lock = lockFile;
+    m_url = url;
+    m_file.setFileName(path + QLatin1String(".journal"));
+    m_checkpointPath = path + QLatin1String(".checkpoint");
+
+    return true;
+}
+
+void AutosaveJournal::release(bool removeFiles)
+{
+    m_recordTimer.stop();
+    m_flushTimer.stop();
+    m_checkpointTimer.stop();
+
+    m_checkpointWatcher.waitForFinished();
+    delete m_checkpointSnapshot;
+    m_checkpointSnapshot = nullptr;
+
+    m_file.close();
+
+    if (removeFiles) {
+        m_file.remove();
+        QFile::remove(m_checkpointPath);
+    }
+
+    m_pending.clear();
+    m_holding = false;
+    m_changed = false;
+    m_url = QUrl();
+
+    delete m_lock;
+    m_lock = nullptr;
+}
+
+bool AutosaveJournal::restart()
+{
+    m_file.close();
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        release(true);
+        return false;
+    }
+
+    writeHeader();
+    m_checkpointTimer.start(Configuration::document_CheckpointInterval() * 60 * 1000);
+
+    return true;
+}
+
+void AutosaveJournal::rebase(bool success)
+{
+    if (success) {
+        // the new base contains everything except the records held since the snapshot
+        QByteArray pending = m_pending;
+
+        if (!restart()) {
+            return;
+        }
+
+        m_pending = pending;
+        m_changed = !m_pending.isEmpty();
+    }
+
+    m_holding = false;
+    flush();
+}
+
+void AutosaveJournal::writeHeader()
+{
+    QDataStream stream(&m_file);
+    stream.setVersion(QDataStream::Qt_4_0);
+
+    stream << journalMagic;
+    stream << journalVersion;
+    stream << m_url;
+}
+
+bool AutosaveJournal::readHeader()
+{
+    quint32 magic;
+    qint32 version;
+    QUrl url;
+
+    QDataStream stream(&m_file);
+    stream.setVersion(QDataStream::Qt_4_0);
+
+    stream >> magic;
+    stream >> version;
+    stream >> url;
+
+    return (stream.status() == QDataStream::Ok) && (magic == journalMagic) && (version == journalVersion) && (url == m_url);
+}
+
+void AutosaveJournal::applyRecord(QDataStream &stream)
+{
+    qint32 version;
+    bool allFlossesChanged;
+    bool allCellsChanged;
+
+    DocumentPalette &palette = m_document->pattern()->palette();
+    StitchData &stitches = m_document->pattern()->stitches();
+
+    stream >> version;
+
+    if (version != journalVersion) {
+        throw InvalidFileVersion(QString(i18n("Journal version %1", version)));
+    }
+
+    stream >> allFlossesChanged;
+
+    if (allFlossesChanged) {
+        stream >> palette;
+    } else {
+        qint32 currentIndex;
+        qint32 count;
+
+        stream >> currentIndex;
+        stream >> count;
+
+        while ((count-- > 0) && (stream.status() == QDataStream::Ok)) {
+            qint32 flossIndex;
+            bool present;
+
+            stream >> flossIndex;
+            stream >> present;
+
+            if (present) {
+                DocumentFloss *documentFloss = new DocumentFloss;
+                stream >> *documentFloss;
+                delete palette.replace(flossIndex, documentFloss);
+            } else {
+                delete palette.remove(flossIndex);
+            }
+        }
+
+        palette.setCurrentIndex(currentIndex);
+    }
+
+    stream >> allCellsChanged;
+
+    if (allCellsChanged) {
+        stream >> stitches;
+    } else {
+        StitchData::Operations operations;
+        qint32 width;
+        qint32 height;
+        qint32 count;
+
+        stream >> operations;
+
+        if (stream.status() != QDataStream::Ok) {
+            throw FailedReadFile(stream.status());
+        }
+
+        for (const StitchData::Operation &operation : std::as_const(operations)) {
+            if (!stitches.applyOperation(operation)) {
+                throw FailedReadFile(QString(i18n("Invalid journal record")));
+            }
+        }
+
+        stream >> width;
+        stream >> height;
+        stream >> count;
+
+        if ((width != stitches.width()) || (height != stitches.height())) {
+            throw FailedReadFile(QString(i18n("The journal does not match the pattern")));
+        }
+
+        while (count--) {
+            qint32 cell;
+            bool occupied;
+
+            stream >> cell;
+            stream >> occupied;
+
+            if ((stream.status() != QDataStream::Ok) || (cell < 0) || (cell >= width * height)) {
+                throw FailedReadFile(QString(i18n("Invalid journal record")));
+            }
+
+            StitchQueue *stitchQueue = nullptr;
+
+            if (occupied) {
+                stitchQueue = new StitchQueue;
+                stream >> *stitchQueue;
+            }
+
+            delete stitches.replaceStitchQueueAt(cell % width, cell / width, stitchQueue);
+        }
+
+        readChanges(stream, stitches.backstitches());
+        readChanges(stream, stitches.knots());
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        throw FailedReadFile(stream.status());
+    }
+}
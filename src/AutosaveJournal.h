@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines a journal of unsaved changes to a document that allows
+ * the changes to be recovered if the application exits unexpectedly.
+ */
+
+#ifndef AutosaveJournal_H
+#define AutosaveJournal_H
+
+// Qt includes
+#include <QByteArray>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QTimer>
+#include <QUrl>
+
+class QDataStream;
+class QLockFile;
+
+class Document;
+
+/**
+ * This class records the changes made to a document in an append only
+ * journal file, allowing unsaved changes to be recovered after a crash.
+ *
+ * Changes are recorded when the undo stack of the document changes. Each
+ * record contains the operations made on the whole pattern, such as resizing,
+ * mirroring or remapping colors, which are repeated when the record is
+ * applied. It is followed by the contents of the cells that changed since the
+ * previous record, along with the backstitches and knots that were added or
+ * removed and the palette flosses that changed. Records are built from the
+ * change tracking in StitchData and DocumentPalette, so the cost of a record
+ * depends on the size of the change and not on the size of the pattern. Only
+ * replacing the whole pattern, as importing an image and undoing the import
+ * do, records the stitches in full. Records are collected in memory and
+ * appended to the journal periodically, so writing the journal does not
+ * interrupt editing.
+ *
+ * At intervals a checkpoint of the whole document is written on a worker
+ * thread from a snapshot of the document, and the journal is restarted. When
+ * the document is saved, the saved file becomes the base for the journal and
+ * any checkpoint is removed. The journal is replayed on to the checkpoint, or
+ * the saved file if there is no checkpoint, to recover the changes.
+ *
+ * The journal and checkpoint are kept in the application data directory,
+ * named from a hash of the document url. A lock file prevents two instances
+ * journaling the same document. Untitled documents are not journaled until
+ * they are first saved.
+ */
+class AutosaveJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param document is a pointer to the Document to be journaled
+     * @param parent is a pointer to the parent QObject
+     */
+    explicit AutosaveJournal(Document *document, QObject *parent = nullptr);
+
+    /**
+     * Destructor, waits for any checkpoint being written. The journal files
+     * are left in place, close() should be called when the document has been
+     * closed normally.
+     */
+    ~AutosaveJournal() override;
+
+    /**
+     * Start journaling the document for a url. Any journal left by a previous
+     * session for the same url is detected, in which case either recover() or
+     * discard() must be called before the document is changed.
+     *
+     * @param url is the url of the document
+     *
+     * @return @c true if there are changes that can be recovered, @c false otherwise
+     */
+    bool open(const QUrl &url);
+
+    /**
+     * Recover the changes from a previous session in to the document, reading
+     * the checkpoint if there is one and replaying the journal. Journaling
+     * continues from the recovered state.
+     *
+     * @return @c true if the changes were recovered, @c false if the journal could not be read
+     */
+    bool recover();
+
+    /**
+     * Discard any changes from a previous session and restart the journal from
+     * the current state of the document.
+     */
+    void discard();
+
+    /**
+     * Stop journaling and remove the journal files, used when the document has
+     * been closed normally.
+     */
+    void close();
+
+    /**
+     * Notification that a snapshot of the document has been taken to be saved.
+     * Changes recorded after this point are held in memory until the save has
+     * finished.
+     *
+     * @param url is the url the document is being saved to
+     */
+    void saveStarted(const QUrl &url);
+
+    /**
+     * Notification that the save started by saveStarted() has finished. When
+     * successful the saved file becomes the base for the journal.
+     *
+     * @param success is @c true if the file was saved, @c false otherwise
+     */
+    void saveFinished(bool success);
+
+public slots:
+    /**
+     * Schedule a record of the current changes, connected to the
+     * QUndoStack::indexChanged signal of the document.
+     */
+    void scheduleRecord();
+
+private slots:
+    void recordChanges();
+    void flush();
+    void checkpoint();
+    void checkpointFinished();
+
+private:
+    bool lock(const QUrl &url);
+    void release(bool removeFiles);
+    bool restart();
+    void rebase(bool success);
+    void writeHeader();
+    bool readHeader();
+    void applyRecord(QDataStream &stream);
+
+    Document *m_document; /**< The document being journaled */
+    QUrl m_url; /**< The url of the document */
+    QString m_checkpointPath; /**< The path of the checkpoint file */
+    QLockFile *m_lock; /**< The lock held on the journal, nullptr if not journaling */
+    QFile m_file; /**< The journal file */
+    QByteArray m_pending; /**< Records not yet appended to the journal */
+    bool m_holding; /**< @c true while a save or checkpoint is in progress */
+    bool m_changed; /**< @c true if records have been made since the last checkpoint or save */
+    QUrl m_saveUrl; /**< The url the document is being saved to */
+    QTimer m_recordTimer; /**< Delays records to combine rapid changes */
+    QTimer m_flushTimer; /**< Delays appending records to the journal */
+    QTimer m_checkpointTimer; /**< Triggers periodic checkpoints */
+    QFutureWatcher<bool> m_checkpointWatcher; /**< Watches the checkpoint being written */
+    Document *m_checkpointSnapshot; /**< The snapshot being written as a checkpoint */
+};
+
+#endif // AutosaveJournal_H
@@ -17,7 +17,10 @@
 #include "BackgroundImage.h"
 
 // Qt includes
+#include <QBuffer>
+#include <QCryptographicHash>
 #include <QDataStream>
+#include <QFile>
 
 // KF includes
 #include <KLocalizedString>
@@ -29,11 +32,19 @@ BackgroundImage::BackgroundImage(const QUrl &url, const QRect &location)
     : m_url(url)
     , m_location(location)
     , m_visible(true)
+    , m_status(false)
 {
-    m_status = m_image.load(m_url.path());
+    QFile file(m_url.path());
+
+    if (file.open(QIODevice::ReadOnly)) {
+        m_data = file.readAll();
+        m_status = m_image.loadFromData(m_data);
+    }
 
     if (m_status) {
         generateIcon();
+    } else {
+        m_data.clear();
     }
 }
 
@@ -59,9 +70,34 @@ bool BackgroundImage::isValid() const
 
 const QImage &BackgroundImage::image() const
 {
+    if (m_image.isNull() && !m_data.isEmpty()) {
+        m_image.loadFromData(m_data);
+    }
+
     return m_image;
 }
 
+const QByteArray &BackgroundImage::data() const
+{
+    if (m_data.isEmpty() && !m_image.isNull()) {
+        // documents prior to version 102 stored the decoded image, encode it once so it can be written as data
+        QBuffer buffer(&m_data);
+        buffer.open(QIODevice::WriteOnly);
+        m_image.save(&buffer, "PNG");
+    }
+
+    return m_data;
+}
+
+const QByteArray &BackgroundImage::hash() const
+{
+    if (m_hash.isEmpty()) {
+        m_hash = QCryptographicHash::hash(data(), QCryptographicHash::Sha1);
+    }
+
+    return m_hash;
+}
+
 const QIcon &BackgroundImage::icon() const
 {
     return m_icon;
@@ -75,21 +111,38 @@ void BackgroundImage::setLocation(const QRect &location)
 void BackgroundImage::setVisible(bool visible)
 {
     m_visible = visible;
+
+    if (!m_visible && !m_data.isEmpty()) {
+        // the image can be decoded again from the data when it is next shown
+        m_image = QImage();
+    }
 }
 
 void BackgroundImage::generateIcon()
 {
-    m_icon = QPixmap::fromImage(m_image).scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    if (m_thumbnail.isNull()) {
+        m_thumbnail = image().scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    m_icon = QPixmap::fromImage(m_thumbnail);
+}
+
+void BackgroundImage::setData(const QByteArray &data)
+{
+    m_data = data;
+    m_image = QImage();
 }
 
 QDataStream &operator<<(QDataStream &stream, const BackgroundImage &backgroundImage)
 {
+    // the encoded data is written by BackgroundImages and referenced by the hash
     stream << qint32(backgroundImage.version);
     stream << backgroundImage.m_url;
     stream << backgroundImage.m_location;
     stream << backgroundImage.m_visible;
     stream << backgroundImage.m_status;
-    stream << backgroundImage.m_image;
+    stream << backgroundImage.hash();
+    stream << backgroundImage.m_thumbnail;
     return stream;
 }
 
@@ -100,6 +153,16 @@ QDataStream &operator>>(QDataStream &stream, BackgroundImage &backgroundImage)
     stream >> version;
 
     switch (version) {
+    case 102:
+        stream >> backgroundImage.m_url;
+        stream >> backgroundImage.m_location;
+        stream >> backgroundImage.m_visible;
+        stream >> backgroundImage.m_status;
+        stream >> backgroundImage.m_hash;
+        stream >> backgroundImage.m_thumbnail;
+        backgroundImage.m_icon = QPixmap::fromImage(backgroundImage.m_thumbnail);
+        break;
+
     case 101:
         stream >> backgroundImage.m_url;
         stream >> backgroundImage.m_location;
@@ -116,6 +179,7 @@ QDataStream &operator>>(QDataStream &stream, BackgroundImage &backgroundImage)
         stream >> backgroundImage.m_status;
         stream >> backgroundImage.m_image;
         stream >> backgroundImage.m_icon;
+        backgroundImage.generateIcon();
         break;
 
     default:
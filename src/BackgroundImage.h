@@ -17,6 +17,7 @@
 #define BackgroundImage_H
 
 // Qt includes
+#include <QByteArray>
 #include <QIcon>
 #include <QImage>
 #include <QRect>
@@ -26,11 +27,20 @@
 // Forward declaration of Qt classes
 class QDataStream;
 
+// Forward declaration of application classes
+class BackgroundImages;
+
 /**
  * This class defines a background image including the area it occupies on the
  * canvas, its visibility state and its original source url.  It also stores an
  * icon for display in the menus and a Qimage which is scaled to fit the canvas
  * zoom factor.
+ *
+ * The image is held as the original encoded bytes of the source file which are
+ * written unchanged to the document. The QImage is only decoded from these when
+ * it is first needed for painting and is released again when the image is
+ * hidden. A small thumbnail is stored with the document so the menu icons can
+ * be created without decoding the full image.
  */
 class BackgroundImage
 {
@@ -88,6 +98,23 @@ public:
      */
     const QImage &image() const;
 
+    /**
+     * Get the encoded image data. This will be the original bytes of the source
+     * file, or a PNG encoding of the image for documents written by versions
+     * that stored the decoded image.
+     *
+     * @return a const reference to a QByteArray containing the encoded image
+     */
+    const QByteArray &data() const;
+
+    /**
+     * Get a hash of the encoded image data. Background images sharing the same
+     * source data will have the same hash allowing the data to be written once.
+     *
+     * @return a const reference to a QByteArray containing the hash
+     */
+    const QByteArray &hash() const;
+
     /**
      * Get the QIcon of the background image. This is used in the menus to show
      * which image any action would apply to.
@@ -131,20 +158,38 @@ public:
      */
     friend QDataStream &operator>>(QDataStream &stream, BackgroundImage &backgroundImage);
 
+    /**
+     * Allow the BackgroundImages reader to attach the shared encoded data to
+     * the background images that reference it.
+     */
+    friend QDataStream &operator>>(QDataStream &stream, BackgroundImages &backgroundImages);
+
 private:
     /**
-     * Generate the QIcon from the image data. Used after reading from a file.
+     * Generate the thumbnail and QIcon from the image data.
      */
     void generateIcon();
 
-    static const int version = 101; /**< The version of the streamed object */
+    /**
+     * Set the encoded image data read from a file. The hash has already been
+     * read with the instance and identifies this data.
+     *
+     * @param data is a const reference to a QByteArray containing the encoded image
+     */
+    void setData(const QByteArray &data);
+
+    static const int version = 102; /**< The version of the streamed object */
     // no longer store m_icon, generate it on loading
+    // no longer store m_image, store the encoded data in BackgroundImages and a thumbnail
 
     QUrl m_url; /**< The URL of the source file */
     QRect m_location; /**< The area of the canvas occupied by the image */
     bool m_visible; /**< The visibility state, @c true if visible, @c false otherwise */
     bool m_status; /**< The validity state of the class instance, @c true if valid, @c false otherwise */
-    QImage m_image; /**< The image read from the URL */
+    mutable QByteArray m_data; /**< The encoded image data */
+    mutable QByteArray m_hash; /**< The hash of the encoded image data */
+    mutable QImage m_image; /**< The image decoded from m_data, created when first painted */
+    QImage m_thumbnail; /**< A thumbnail of the image used to create the icon */
     QIcon m_icon; /**< An icon of the image */
 };
 
@@ -18,6 +18,8 @@
 
 // Qt includes
 #include <QDataStream>
+#include <QHash>
+#include <QSet>
 
 // KF includes
 #include <KLocalizedString>
@@ -65,6 +67,25 @@ bool BackgroundImages::showBackgroundImage(QSharedPointer<BackgroundImage> backg
 QDataStream &operator<<(QDataStream &stream, const BackgroundImages &backgroundImages)
 {
     stream << qint32(backgroundImages.version);
+
+    // write the encoded data of each distinct source image once, the images reference it by hash
+    QList<QSharedPointer<BackgroundImage>> distinctImages;
+    QSet<QByteArray> hashes;
+
+    for (auto backgroundImage : backgroundImages.m_backgroundImages) {
+        if (!hashes.contains(backgroundImage->hash())) {
+            hashes.insert(backgroundImage->hash());
+            distinctImages.append(backgroundImage);
+        }
+    }
+
+    stream << qint32(distinctImages.count());
+
+    for (auto backgroundImage : distinctImages) {
+        stream << backgroundImage->hash();
+        stream << backgroundImage->data();
+    }
+
     stream << qint32(backgroundImages.m_backgroundImages.count());
 
     for (auto backgroundImage : backgroundImages.m_backgroundImages) {
@@ -81,11 +102,35 @@ QDataStream &operator<<(QDataStream &stream, const BackgroundImages &backgroundI
 QDataStream &operator>>(QDataStream &stream, BackgroundImages &backgroundImages)
 {
     qint32 version;
+    qint32 dataCount;
     qint32 backgroundImageCount;
+    QHash<QByteArray, QByteArray> imageData;
 
     stream >> version;
 
     switch (version) {
+    case 101:
+        stream >> dataCount;
+
+        while (dataCount-- > 0 && stream.status() == QDataStream::Ok) {
+            QByteArray hash;
+            QByteArray data;
+            stream >> hash;
+            stream >> data;
+            imageData.insert(hash, data);
+        }
+
+        stream >> backgroundImageCount;
+
+        while (backgroundImageCount-- > 0 && stream.status() == QDataStream::Ok) {
+            QSharedPointer<BackgroundImage> backgroundImage(new BackgroundImage);
+            stream >> *backgroundImage;
+            backgroundImage->setData(imageData.value(backgroundImage->m_hash));
+            backgroundImages.m_backgroundImages.append(backgroundImage);
+        }
+
+        break;
+
     case 100:
         stream >> backgroundImageCount;
 
@@ -99,7 +99,8 @@ public:
 
     /**
      * Operator to stream out the class instance to a QDataStream. This will
-     * stream the instance of the BackgroundImage contained in the list.
+     * stream the encoded data of each distinct source image once followed by
+     * the instances of the BackgroundImage contained in the list.
      *
      * @param stream a reference to the QDataStream to write to
      * @param backgroundImages a const reference to the class instance to write
@@ -122,7 +123,7 @@ public:
     friend QDataStream &operator>>(QDataStream &stream, BackgroundImages &backgroundImages);
 
 private:
-    static const int version = 100; /**< The version of the streamed object */
+    static const int version = 101; /**< The version of the streamed object */
 
     QList<QSharedPointer<BackgroundImage>> m_backgroundImages; /**< A list of BackgroundImage shared pointers */
 };
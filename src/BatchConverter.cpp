@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements the conversion of PC Stitch pattern files to KXStitch
+ * files from the command line without creating a MainWindow.
+ */
+
+// Class include
+#include "BatchConverter.h"
+
+// Qt includes
+#include <QBuffer>
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+// KF includes
+#include <KLocalizedString>
+
+// Application includes
+#include "Document.h"
+#include "SchemeManager.h"
+#include "SymbolManager.h"
+#include "configuration.h"
+
+/**
+ * The result of converting a single file.
+ */
+struct ConversionResult {
+    QString source; /**< The path of the source file */
+    QString destination; /**< The path of the converted file */
+    QString error; /**< A description of the failure, empty if successful */
+    qint64 elapsed; /**< The time taken in milliseconds */
+};
+
+/**
+ * Convert a single file, called on a thread from the pool.
+ *
+ * @param source is the path of the PC Stitch file
+ * @param destination is the path of the KXStitch file to write
+ * @param compress is true if the sections of the file are compressed
+ *
+ * @return the ConversionResult
+ */
+static ConversionResult convertFile(const QString &source, const QString &destination, bool compress)
+{
+    ConversionResult result;
+    result.source = source;
+    result.destination = destination;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(source);
+
+    if (file.open(QIODevice::ReadOnly)) {
+        // the whole file is read in one operation and parsed from memory
+        QByteArray data = file.readAll();
+        file.close();
+
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream stream(&buffer);
+
+        Document document;
+
+        try {
+            document.readPCStitch(stream);
+            document.setUrl(QUrl::fromLocalFile(destination));
+
+            QSaveFile output(destination);
+
+            if (output.open(QIODevice::WriteOnly)) {
+                QDataStream outputStream(&output);
+                document.write(outputStream, compress);
+
+                if (!output.commit()) {
+                    result.error = output.errorString();
+                }
+            } else {
+                result.error = output.errorString();
+            }
+        } catch (const InvalidFile &e) {
+            result.error = i18n("The file does not appear to be a PC Stitch file.");
+        } catch (const InvalidFileVersion &e) {
+            result.error = i18n("This version of the file is not supported.\n%1", e.version);
+        } catch (const FailedReadFile &e) {
+            result.error = i18n("Failed to read the file.\n%1.", e.status);
+        } catch (const FailedWriteFile &e) {
+            result.error = i18n("Failed to save the file.\n%1", e.statusMessage());
+        }
+    } else {
+        result.error = file.errorString();
+    }
+
+    result.elapsed = timer.elapsed();
+
+    return result;
+}
+
+int BatchConverter::run(const QStringList &sources, const QString &outputDirectory, int jobs)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (!outputDirectory.isEmpty() && !QDir().mkpath(outputDirectory)) {
+        err << i18n("Unable to create the output directory %1", outputDirectory) << Qt::endl;
+        return 1;
+    }
+
+    // the shared managers are created lazily, so create them here before any threads use them.
+    // The PC Stitch readers only use FlossScheme::find and FlossScheme::convert, which are
+    // safe to call from the pool threads as the lookup table used by convert is created under a lock.
+    SchemeManager::schemes();
+    SymbolManager::libraries();
+
+    QThreadPool pool;
+
+    if (jobs > 0) {
+        pool.setMaxThreadCount(jobs);
+    }
+
+    QList<QPair<QString, QString>> files;
+    QHash<QString, QString> destinations; // the path of each converted file to the file it is converted from
+
+    for (const QString &source : sources) {
+        QFileInfo sourceInfo(source);
+        QString directory = outputDirectory.isEmpty() ? sourceInfo.absolutePath() : outputDirectory;
+        QString destination = QDir(directory).absoluteFilePath(sourceInfo.completeBaseName() + QLatin1String(".kxs"));
+
+        // files with the same base name, such as d1/a.pat and d2/a.pat with an output directory,
+        // would overwrite each other so only the first is converted
+        if (destinations.contains(destination)) {
+            err << i18n("%1: The file %2 is already being converted from %3", source, destination, destinations.value(destination)) << Qt::endl;
+            continue;
+        }
+
+        destinations.insert(destination, source);
+        files.append(qMakePair(source, destination));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // nothing changes the configuration while converting, so the Document created on each thread
+    // can read it, reading it here also creates it before the threads start
+    bool compress = Configuration::document_CompressFiles();
+
+    QFuture<ConversionResult> future = QtConcurrent::mapped(&pool, files, [compress](const QPair<QString, QString> &file) {
+        return convertFile(file.first, file.second, compress);
+    });
+
+    int converted = 0;
+
+    // results are reported in order as they become available
+    for (int i = 0; i < files.count(); ++i) {
+        ConversionResult result = future.resultAt(i);
+
+        if (result.error.isEmpty()) {
+            out << i18n("%1 -> %2 (%3 ms)", result.source, result.destination, result.elapsed) << Qt::endl;
+            ++converted;
+        } else {
+            err << i18n("%1: %2 (%3 ms)", result.source, result.error.simplified(), result.elapsed) << Qt::endl;
+        }
+    }
+
+    out << i18n("Converted %1 of %2 files in %3 ms using %4 threads", converted, sources.count(), timer.elapsed(), pool.maxThreadCount()) << Qt::endl;
+
+    return (converted == sources.count()) ? 0 : 1;
+}
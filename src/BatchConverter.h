@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines the conversion of PC Stitch pattern files to KXStitch
+ * files from the command line without creating a MainWindow.
+ */
+
+#ifndef BatchConverter_H
+#define BatchConverter_H
+
+// Qt includes
+#include <QString>
+#include <QStringList>
+
+/**
+ * This class converts a list of PC Stitch pattern files to KXStitch files.
+ *
+ * Each file is read and written by a separate Document on a thread from a
+ * thread pool, so files are converted in parallel. Files that would be
+ * written to the same KXStitch file as an earlier file are not converted.
+ * The result of each file is reported on the standard output, or the
+ * standard error for failures, in the order the files were given, along
+ * with the time taken.
+ */
+class BatchConverter
+{
+public:
+    /**
+     * Convert the files.
+     *
+     * @param sources is a list of paths of the PC Stitch files to convert
+     * @param outputDirectory is the directory for the converted files, if empty each file is written alongside its source
+     * @param jobs is the maximum number of files converted at the same time, 0 to use the number of processors
+     *
+     * @return 0 if all the files were converted, 1 otherwise
+     */
+    static int run(const QStringList &sources, const QString &outputDirectory, int jobs);
+};
+
+#endif // BatchConverter_H
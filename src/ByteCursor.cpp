@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a bounds checked cursor used to parse little endian
+ * binary data held in memory.
+ */
+
+// Class include
+#include "ByteCursor.h"
+
+// Qt includes
+#include <QtEndian>
+
+// KF includes
+#include <KLocalizedString>
+
+// Application includes
+#include "Exceptions.h"
+
+ByteCursor::ByteCursor(const QByteArray &data)
+    : m_data(data)
+    , m_position(0)
+{
+}
+
+int ByteCursor::position() const
+{
+    return m_position;
+}
+
+int ByteCursor::remaining() const
+{
+    return m_data.size() - m_position;
+}
+
+void ByteCursor::seek(int position)
+{
+    if ((position < 0) || (position > m_data.size())) {
+        throw FailedReadFile(QString(i18n("Unexpected end of file")));
+    }
+
+    m_position = position;
+}
+
+void ByteCursor::skip(int size)
+{
+    require(size);
+    m_position += size;
+}
+
+void ByteCursor::requireRecords(quint32 count, int recordSize) const
+{
+    if (qint64(count) * recordSize > remaining()) {
+        throw FailedReadFile(QString(i18n("Invalid count %1 for the remaining data", count)));
+    }
+}
+
+const char *ByteCursor::readRaw(int size)
+{
+    require(size);
+    const char *data = m_data.constData() + m_position;
+    m_position += size;
+
+    return data;
+}
+
+quint8 ByteCursor::readUInt8()
+{
+    return quint8(*readRaw(1));
+}
+
+quint16 ByteCursor::readUInt16()
+{
+    return qFromLittleEndian<quint16>(readRaw(2));
+}
+
+quint32 ByteCursor::readUInt32()
+{
+    return qFromLittleEndian<quint32>(readRaw(4));
+}
+
+qint16 ByteCursor::readInt16()
+{
+    return qFromLittleEndian<qint16>(readRaw(2));
+}
+
+void ByteCursor::require(qint64 size) const
+{
+    if ((size < 0) || (size > remaining())) {
+        throw FailedReadFile(QString(i18n("Unexpected end of file")));
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines a bounds checked cursor used to parse little endian
+ * binary data held in memory.
+ */
+
+#ifndef ByteCursor_H
+#define ByteCursor_H
+
+// Qt includes
+#include <QByteArray>
+#include <QtGlobal>
+
+/**
+ * This class reads little endian values from a QByteArray, such as the
+ * contents of a PC Stitch file read in to memory.
+ *
+ * Every read is checked against the end of the data and a FailedReadFile
+ * exception is thrown rather than reading past the end. Counts read from the
+ * data can be checked with requireRecords() before anything is allocated or
+ * any loop is started, so a corrupt count can not cause a large allocation
+ * or a long loop reading nothing.
+ */
+class ByteCursor
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param data is the QByteArray to be read, which must remain valid while the cursor is used
+     */
+    explicit ByteCursor(const QByteArray &data);
+
+    /**
+     * Get the current position.
+     *
+     * @return the offset of the next byte to be read
+     */
+    int position() const;
+
+    /**
+     * Get the number of bytes remaining.
+     *
+     * @return the number of bytes after the current position
+     */
+    int remaining() const;
+
+    /**
+     * Move to a position, throws FailedReadFile if the position is outside the data.
+     *
+     * @param position is the offset of the next byte to be read
+     */
+    void seek(int position);
+
+    /**
+     * Skip a number of bytes, throws FailedReadFile if there are insufficient bytes.
+     *
+     * @param size is the number of bytes to skip
+     */
+    void skip(int size);
+
+    /**
+     * Check that enough data remains for a number of fixed size records, throws
+     * FailedReadFile if it does not.
+     *
+     * @param count is the number of records
+     * @param recordSize is the size in bytes of each record
+     */
+    void requireRecords(quint32 count, int recordSize) const;
+
+    /**
+     * Read a number of bytes, throws FailedReadFile if there are insufficient bytes.
+     *
+     * @param size is the number of bytes to read
+     *
+     * @return a pointer to the bytes within the data
+     */
+    const char *readRaw(int size);
+
+    quint8 readUInt8(); /**< Read an unsigned 8 bit value */
+    quint16 readUInt16(); /**< Read an unsigned 16 bit little endian value */
+    quint32 readUInt32(); /**< Read an unsigned 32 bit little endian value */
+    qint16 readInt16(); /**< Read a signed 16 bit little endian value */
+
+private:
+    void require(qint64 size) const;
+
+    const QByteArray &m_data; /**< The data being read */
+    int m_position; /**< The offset of the next byte to be read */
+};
+
+#endif // ByteCursor_H
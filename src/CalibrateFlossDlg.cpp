@@ -195,6 +195,8 @@ void CalibrateFlossDlg::on_DialogButtonBox_accepted()
                 }
             }
 
+            scheme->colorsChanged();
+
             SchemeManager::writeScheme(mapIterator.key());
         }
     }
@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a color quantizer that reduces the colors of an image
+ * to the colors of a floss scheme, working in the CIELAB color space.
+ */
+
+// Class include
+#include "ColorQuantizer.h"
+
+// Qt includes
+#include <QHash>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+// C++ includes
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+/**
+ * A color in the CIELAB color space.
+ */
+struct Lab {
+    float L; /**< The lightness */
+    float a; /**< The green to red component */
+    float b; /**< The blue to yellow component */
+};
+
+/**
+ * Convert an sRGB color to CIELAB using the D65 white point.
+ *
+ * @param rgb is the color to convert
+ *
+ * @return the Lab color
+ */
+static Lab toLab(QRgb rgb)
+{
+    // the linear values of each 8 bit sRGB component
+    static const std::array<float, 256> linear = [] {
+        std::array<float, 256> table;
+
+        for (int i = 0; i < 256; ++i) {
+            float value = i / 255.0f;
+            table[i] = (value <= 0.04045f) ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+
+        return table;
+    }();
+
+    auto f = [](float t) {
+        return (t > 0.008856f) ? std::cbrt(t) : (7.787f * t + 16.0f / 116.0f);
+    };
+
+    float r = linear[qRed(rgb)];
+    float g = linear[qGreen(rgb)];
+    float b = linear[qBlue(rgb)];
+
+    float fx = f((0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f);
+    float fy = f(0.2126729f * r + 0.7151522f * g + 0.0721750f * b);
+    float fz = f((0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f);
+
+    return Lab{116.0f * fy - 16.0f, 500.0f * (fx - fy), 200.0f * (fy - fz)};
+}
+
+/**
+ * A set of palette colors held as separate arrays of L, a and b values, so the
+ * search for the nearest color is a simple loop over contiguous floats.
+ */
+class LabPalette
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param colors is the list of colors
+     */
+    explicit LabPalette(const std::vector<QRgb> &colors)
+        : m_colors(colors)
+    {
+        m_L.reserve(colors.size());
+        m_a.reserve(colors.size());
+        m_b.reserve(colors.size());
+
+        for (QRgb color : colors) {
+            Lab lab = toLab(color);
+            m_L.push_back(lab.L);
+            m_a.push_back(lab.a);
+            m_b.push_back(lab.b);
+        }
+    }
+
+    /**
+     * Find the nearest color.
+     *
+     * @param lab is the color to match
+     *
+     * @return the index of the nearest color
+     */
+    int nearest(const Lab &lab) const
+    {
+        const float *L = m_L.data();
+        const float *a = m_a.data();
+        const float *b = m_b.data();
+        int count = int(m_L.size());
+        int nearestIndex = 0;
+        float nearestDistance = std::numeric_limits<float>::max();
+
+        for (int i = 0; i < count; ++i) {
+            float dL = L[i] - lab.L;
+            float da = a[i] - lab.a;
+            float db = b[i] - lab.b;
+            float distance = dL * dL + da * da + db * db;
+
+            if (distance < nearestDistance) {
+                nearestDistance = distance;
+                nearestIndex = i;
+            }
+        }
+
+        return nearestIndex;
+    }
+
+    /**
+     * Get a color as a Lab value.
+     *
+     * @param index is the index of the color
+     *
+     * @return the Lab value
+     */
+    Lab lab(int index) const
+    {
+        return Lab{m_L[index], m_a[index], m_b[index]};
+    }
+
+    /**
+     * Get a color as an RGB value.
+     *
+     * @param index is the index of the color
+     *
+     * @return the RGB value
+     */
+    QRgb rgb(int index) const
+    {
+        return m_colors[index];
+    }
+
+    /**
+     * Get the number of colors.
+     *
+     * @return the number of colors
+     */
+    int count() const
+    {
+        return int(m_colors.size());
+    }
+
+private:
+    std::vector<QRgb> m_colors; /**< The RGB values of the colors */
+    std::vector<float> m_L; /**< The lightness of each color */
+    std::vector<float> m_a; /**< The a component of each color */
+    std::vector<float> m_b; /**< The b component of each color */
+};
+
+/**
+ * Divide a range in to chunks and call a function for each chunk on the threads of the global thread pool.
+ *
+ * @param count is the size of the range
+ * @param function is called with the first index of a chunk and the index after the last
+ */
+template <typename Function>
+static void parallelFor(int count, Function function)
+{
+    int chunks = std::min(count, QThreadPool::globalInstance()->maxThreadCount() * 4);
+
+    if (chunks <= 1) {
+        function(0, count);
+        return;
+    }
+
+    int chunkSize = (count + chunks - 1) / chunks;
+    QList<int> starts;
+
+    for (int start = 0; start < count; start += chunkSize) {
+        starts.append(start);
+    }
+
+    QtConcurrent::blockingMap(starts, [&](int start) {
+        function(start, std::min(start + chunkSize, count));
+    });
+}
+
+/**
+ * A division of the image colors made by the median cut.
+ */
+struct Box {
+    int begin; /**< The index in the ordered colors of the first color */
+    int end; /**< The index in the ordered colors after the last color */
+    int axis; /**< The Lab component with the largest extent, 0 for L, 1 for a, 2 for b */
+    float extent; /**< The extent of the colors along the axis */
+};
+
+/**
+ * Get a component of a Lab color.
+ *
+ * @param lab is the Lab color
+ * @param axis is 0 for L, 1 for a and 2 for b
+ *
+ * @return the value of the component
+ */
+static float component(const Lab &lab, int axis)
+{
+    return (axis == 0) ? lab.L : ((axis == 1) ? lab.a : lab.b);
+}
+
+/**
+ * Find the component of a box with the largest extent.
+ *
+ * @param box is the Box to be updated
+ * @param order is the list of color indexes ordered by box
+ * @param labs is the list of Lab colors
+ */
+static void measure(Box &box, const std::vector<int> &order, const std::vector<Lab> &labs)
+{
+    Lab minimum = labs[order[box.begin]];
+    Lab maximum = minimum;
+
+    for (int i = box.begin + 1; i < box.end; ++i) {
+        const Lab &lab = labs[order[i]];
+        minimum = Lab{std::min(minimum.L, lab.L), std::min(minimum.a, lab.a), std::min(minimum.b, lab.b)};
+        maximum = Lab{std::max(maximum.L, lab.L), std::max(maximum.a, lab.a), std::max(maximum.b, lab.b)};
+    }
+
+    box.axis = 0;
+    box.extent = maximum.L - minimum.L;
+
+    if (maximum.a - minimum.a > box.extent) {
+        box.axis = 1;
+        box.extent = maximum.a - minimum.a;
+    }
+
+    if (maximum.b - minimum.b > box.extent) {
+        box.axis = 2;
+        box.extent = maximum.b - minimum.b;
+    }
+}
+
+ColorQuantizer::ColorQuantizer(const QList<QRgb> &palette)
+    : m_palette(palette)
+    , m_maximumColors(palette.count())
+    , m_dithering(Configuration::EnumImport_Dithering::NoDithering)
+{
+}
+
+void ColorQuantizer::setMaximumColors(int maximumColors)
+{
+    m_maximumColors = std::max(1, maximumColors);
+}
+
+void ColorQuantizer::setDithering(Configuration::EnumImport_Dithering::type dithering)
+{
+    m_dithering = dithering;
+}
+
+void ColorQuantizer::quantize(uchar *pixels, int width, int height) const
+{
+    if (m_palette.isEmpty() || (width <= 0) || (height <= 0)) {
+        return;
+    }
+
+    // collect the distinct opaque colors and their frequencies, a histogram for each band of rows
+    int bands = std::min(height, QThreadPool::globalInstance()->maxThreadCount() * 4);
+    int rowsPerBand = (height + bands - 1) / bands;
+    std::vector<QHash<QRgb, quint32>> histograms(bands);
+
+    parallelFor(bands, [&](int begin, int end) {
+        for (int band = begin; band < end; ++band) {
+            QHash<QRgb, quint32> &histogram = histograms[band];
+            const uchar *pixel = pixels + qsizetype(std::min(band * rowsPerBand, height)) * width * 4;
+            const uchar *last = pixels + qsizetype(std::min((band + 1) * rowsPerBand, height)) * width * 4;
+
+            for (; pixel < last; pixel += 4) {
+                if (pixel[3]) {
+                    ++histogram[qRgb(pixel[0], pixel[1], pixel[2])];
+                }
+            }
+        }
+    });
+
+    QHash<QRgb, int> colorIndexes;
+    std::vector<QRgb> colors;
+    std::vector<quint32> counts;
+
+    for (const QHash<QRgb, quint32> &histogram : histograms) {
+        for (auto it = histogram.constBegin(); it != histogram.constEnd(); ++it) {
+            auto index = colorIndexes.constFind(it.key());
+
+            if (index == colorIndexes.constEnd()) {
+                colorIndexes.insert(it.key(), int(colors.size()));
+                colors.push_back(it.key());
+                counts.push_back(it.value());
+            } else {
+                counts[index.value()] += it.value();
+            }
+        }
+    }
+
+    histograms.clear();
+
+    int colorCount = int(colors.size());
+
+    if (colorCount == 0) {
+        return;
+    }
+
+    std::vector<Lab> labs(colorCount);
+
+    parallelFor(colorCount, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            labs[i] = toLab(colors[i]);
+        }
+    });
+
+    // match every color against the whole palette
+    LabPalette palette(std::vector<QRgb>(m_palette.cbegin(), m_palette.cend()));
+    std::vector<int> matches(colorCount);
+
+    parallelFor(colorCount, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            matches[i] = palette.nearest(labs[i]);
+        }
+    });
+
+    std::vector<bool> used(palette.count(), false);
+
+    for (int match : matches) {
+        used[match] = true;
+    }
+
+    std::vector<QRgb> selected;
+
+    if (std::count(used.cbegin(), used.cend(), true) <= m_maximumColors) {
+        for (int i = 0; i < palette.count(); ++i) {
+            if (used[i]) {
+                selected.push_back(palette.rgb(i));
+            }
+        }
+    } else {
+        // too many colors, divide the image colors by a weighted median cut and use the nearest palette color to each division
+        std::vector<int> order(colorCount);
+        std::iota(order.begin(), order.end(), 0);
+
+        std::vector<Box> boxes;
+        boxes.push_back(Box{0, colorCount, 0, 0.0f});
+        measure(boxes.front(), order, labs);
+
+        while (int(boxes.size()) < m_maximumColors) {
+            auto widest = std::max_element(boxes.begin(), boxes.end(), [](const Box &a, const Box &b) {
+                return ((a.end - a.begin > 1) ? a.extent : -1.0f) < ((b.end - b.begin > 1) ? b.extent : -1.0f);
+            });
+
+            if (widest->end - widest->begin < 2) {
+                break;
+            }
+
+            Box box = *widest;
+            std::sort(order.begin() + box.begin, order.begin() + box.end, [&](int a, int b) {
+                return component(labs[a], box.axis) < component(labs[b], box.axis);
+            });
+
+            quint64 total = 0;
+
+            for (int i = box.begin; i < box.end; ++i) {
+                total += counts[order[i]];
+            }
+
+            quint64 accumulated = 0;
+            int median = box.begin;
+
+            while ((median < box.end - 1) && (accumulated + counts[order[median]] <= total / 2)) {
+                accumulated += counts[order[median++]];
+            }
+
+            median = std::max(median, box.begin + 1);
+
+            Box upper{median, box.end, 0, 0.0f};
+            widest->end = median;
+            measure(*widest, order, labs);
+            measure(upper, order, labs);
+            boxes.push_back(upper);
+        }
+
+        std::vector<bool> chosen(palette.count(), false);
+
+        for (const Box &box : boxes) {
+            double weight = 0.0;
+            double L = 0.0;
+            double a = 0.0;
+            double b = 0.0;
+
+            for (int i = box.begin; i < box.end; ++i) {
+                const Lab &lab = labs[order[i]];
+                double count = counts[order[i]];
+                weight += count;
+                L += lab.L * count;
+                a += lab.a * count;
+                b += lab.b * count;
+            }
+
+            chosen[palette.nearest(Lab{float(L / weight), float(a / weight), float(b / weight)})] = true;
+        }
+
+        for (int i = 0; i < palette.count(); ++i) {
+            if (chosen[i]) {
+                selected.push_back(palette.rgb(i));
+            }
+        }
+    }
+
+    LabPalette selectedPalette(selected);
+
+    if (m_dithering == Configuration::EnumImport_Dithering::FloydSteinberg) {
+        // the error of each pixel is carried to its neighbours, so the pixels are processed in order
+        std::vector<Lab> currentErrors(width + 2, Lab{0.0f, 0.0f, 0.0f});
+        std::vector<Lab> nextErrors(width + 2, Lab{0.0f, 0.0f, 0.0f});
+        uchar *pixel = pixels;
+
+        for (int y = 0; y < height; ++y) {
+            std::fill(nextErrors.begin(), nextErrors.end(), Lab{0.0f, 0.0f, 0.0f});
+
+            for (int x = 0; x < width; ++x, pixel += 4) {
+                if (pixel[3] == 0) {
+                    continue;
+                }
+
+                const Lab &error = currentErrors[x + 1];
+                Lab lab = labs[colorIndexes.value(qRgb(pixel[0], pixel[1], pixel[2]))];
+                Lab wanted{lab.L + error.L, lab.a + error.a, lab.b + error.b};
+
+                int index = selectedPalette.nearest(wanted);
+                Lab actual = selectedPalette.lab(index);
+                Lab difference{wanted.L - actual.L, wanted.a - actual.a, wanted.b - actual.b};
+
+                auto spread = [&difference](Lab &target, float fraction) {
+                    target.L += difference.L * fraction;
+                    target.a += difference.a * fraction;
+                    target.b += difference.b * fraction;
+                };
+
+                spread(currentErrors[x + 2], 7.0f / 16.0f);
+                spread(nextErrors[x], 3.0f / 16.0f);
+                spread(nextErrors[x + 1], 5.0f / 16.0f);
+                spread(nextErrors[x + 2], 1.0f / 16.0f);
+
+                QRgb rgb = selectedPalette.rgb(index);
+                pixel[0] = qRed(rgb);
+                pixel[1] = qGreen(rgb);
+                pixel[2] = qBlue(rgb);
+            }
+
+            std::swap(currentErrors, nextErrors);
+        }
+
+        return;
+    }
+
+    if (m_dithering == Configuration::EnumImport_Dithering::Ordered) {
+        // the threshold offsets are scaled to the average distance between the selected colors
+        float spacing = 0.0f;
+
+        if (selectedPalette.count() > 1) {
+            for (int i = 0; i < selectedPalette.count(); ++i) {
+                float nearestDistance = std::numeric_limits<float>::max();
+                Lab lab = selectedPalette.lab(i);
+
+                for (int j = 0; j < selectedPalette.count(); ++j) {
+                    if (i != j) {
+                        Lab other = selectedPalette.lab(j);
+                        float dL = lab.L - other.L;
+                        float da = lab.a - other.a;
+                        float db = lab.b - other.b;
+                        nearestDistance = std::min(nearestDistance, std::sqrt(dL * dL + da * da + db * db));
+                    }
+                }
+
+                spacing += nearestDistance;
+            }
+
+            spacing /= selectedPalette.count();
+        }
+
+        static const int bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+
+        parallelFor(height, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                uchar *pixel = pixels + qsizetype(y) * width * 4;
+
+                for (int x = 0; x < width; ++x, pixel += 4) {
+                    if (pixel[3] == 0) {
+                        continue;
+                    }
+
+                    // only the lightness is offset, the same offset on a and b would shift every color towards magenta or green
+                    float offset = ((bayer[y % 4][x % 4] + 0.5f) / 16.0f - 0.5f) * spacing;
+                    Lab lab = labs[colorIndexes.value(qRgb(pixel[0], pixel[1], pixel[2]))];
+                    QRgb rgb = selectedPalette.rgb(selectedPalette.nearest(Lab{lab.L + offset, lab.a, lab.b}));
+                    pixel[0] = qRed(rgb);
+                    pixel[1] = qGreen(rgb);
+                    pixel[2] = qBlue(rgb);
+                }
+            }
+        });
+
+        return;
+    }
+
+    // without dithering each distinct color is matched once
+    std::vector<QRgb> replacements(colorCount);
+
+    parallelFor(colorCount, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            replacements[i] = selectedPalette.rgb(selectedPalette.nearest(labs[i]));
+        }
+    });
+
+    parallelFor(height, [&](int begin, int end) {
+        QRgb previous = 0;
+        QRgb replacement = 0;
+        bool hasPrevious = false;
+        uchar *pixel = pixels + qsizetype(begin) * width * 4;
+        uchar *last = pixels + qsizetype(end) * width * 4;
+
+        for (; pixel < last; pixel += 4) {
+            if (pixel[3] == 0) {
+                continue;
+            }
+
+            QRgb rgb = qRgb(pixel[0], pixel[1], pixel[2]);
+
+            // neighbouring pixels are often the same color, so avoid the lookup
+            if (!hasPrevious || (rgb != previous)) {
+                previous = rgb;
+                replacement = replacements[colorIndexes.value(rgb)];
+                hasPrevious = true;
+            }
+
+            pixel[0] = qRed(replacement);
+            pixel[1] = qGreen(replacement);
+            pixel[2] = qBlue(replacement);
+        }
+    });
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines a color quantizer that reduces the colors of an image to
+ * the colors of a floss scheme, working in the CIELAB color space.
+ */
+
+#ifndef ColorQuantizer_H
+#define ColorQuantizer_H
+
+// Qt includes
+#include <QList>
+#include <QRgb>
+
+// Application includes
+#include "configuration.h"
+
+/**
+ * This class reduces the colors of an RGBA image to at most a given number of
+ * colors chosen from a palette, usually the colors of a floss scheme.
+ *
+ * The distinct colors of the image are collected with their frequencies and
+ * converted to CIELAB, where the distance between colors is close to the
+ * perceived difference. Each is matched to its nearest palette color. If more
+ * palette colors are used than allowed, the image colors are divided by a
+ * weighted median cut in CIELAB, the nearest palette color to the mean of each
+ * division is selected, and the image colors are matched again against the
+ * selected colors only. The pixels are then replaced with their matched color,
+ * optionally with ordered or Floyd-Steinberg dithering.
+ *
+ * The palette is held as separate arrays of L, a and b values so the nearest
+ * color search is a simple loop the compiler can vectorise, and the histogram,
+ * conversions, matching and undithered or ordered output are divided between
+ * the threads of the global thread pool. Floyd-Steinberg dithering diffuses
+ * the error from pixel to pixel so it is done on a single thread.
+ */
+class ColorQuantizer
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param palette is the list of colors the image will be reduced to
+     */
+    explicit ColorQuantizer(const QList<QRgb> &palette);
+
+    /**
+     * Set the maximum number of palette colors used, the default is all of them.
+     *
+     * @param maximumColors is the maximum number of colors
+     */
+    void setMaximumColors(int maximumColors);
+
+    /**
+     * Set the dithering applied when the pixels are replaced, the default is none.
+     *
+     * @param dithering is the dithering method
+     */
+    void setDithering(Configuration::EnumImport_Dithering::type dithering);
+
+    /**
+     * Quantize an image in place. Pixels with an alpha of 0 are left unchanged,
+     * other pixels have their color replaced and their alpha retained.
+     *
+     * @param pixels is a pointer to the image data as 8 bit RGBA values without padding
+     * @param width is the width of the image in pixels
+     * @param height is the height of the image in pixels
+     */
+    void quantize(uchar *pixels, int width, int height) const;
+
+private:
+    QList<QRgb> m_palette; /**< The colors the image will be reduced to */
+    int m_maximumColors; /**< The maximum number of palette colors used */
+    Configuration::EnumImport_Dithering::type m_dithering; /**< The dithering applied to the pixels */
+};
+
+#endif // ColorQuantizer_H
@@ -50,23 +50,36 @@ void FilePropertiesCommand::undo()
     m_document->palette()->update();
 }
 
-ImportImageCommand::ImportImageCommand(Document *document)
+ImportImageCommand::ImportImageCommand(Document *document, StitchData &stitches, const DocumentPalette &palette)
     : QUndoCommand(i18n("Import Image"))
     , m_document(document)
+    , m_palette(palette)
 {
+    // take the imported stitches without copying them, the command then holds the state
+    // that is not in the document, exchanging it with the document on redo and undo
+    m_stitches.swap(stitches);
 }
 
 void ImportImageCommand::redo()
 {
     QUndoCommand::redo();
-    m_document->editor()->readDocumentSettings();
-    m_document->preview()->readDocumentSettings();
-    m_document->palette()->update();
+    swapDocumentState();
 }
 
 void ImportImageCommand::undo()
 {
     QUndoCommand::undo();
+    swapDocumentState();
+}
+
+void ImportImageCommand::swapDocumentState()
+{
+    m_document->pattern()->stitches().swap(m_stitches);
+
+    DocumentPalette palette = m_document->pattern()->palette();
+    m_document->pattern()->palette() = m_palette;
+    m_palette = palette;
+
     m_document->editor()->readDocumentSettings();
     m_document->preview()->readDocumentSettings();
     m_document->palette()->update();
@@ -677,15 +690,10 @@ CropToSelectionCommand::CropToSelectionCommand(Document *document, const QRect &
 
 void CropToSelectionCommand::redo()
 {
-    QList<Stitch::Type> maskStitches;
-    maskStitches << Stitch::TLQtr << Stitch::TRQtr << Stitch::BLQtr << Stitch::BTHalf << Stitch::TL3Qtr << Stitch::BRQtr << Stitch::TBHalf << Stitch::TR3Qtr
-                 << Stitch::BL3Qtr << Stitch::BR3Qtr << Stitch::Full << Stitch::TLSmallHalf << Stitch::TRSmallHalf << Stitch::BLSmallHalf << Stitch::BRSmallHalf
-                 << Stitch::TLSmallFull << Stitch::TRSmallFull << Stitch::BLSmallFull << Stitch::BRSmallFull;
-
     QDataStream stream(&m_originalPattern, QIODevice::WriteOnly);
     stream << m_document->pattern()->stitches();
 
-    Pattern *pattern = m_document->pattern()->copy(m_selectionArea, -1, maskStitches, false, false);
+    Pattern *pattern = m_document->pattern()->copy(m_selectionArea, -1, StitchMask::all(), false, false);
     m_document->pattern()->stitches().clear();
     m_document->pattern()->stitches().resize(m_selectionArea.width(), m_selectionArea.height());
     m_document->pattern()->paste(pattern, QPoint(0, 0), true);
@@ -958,65 +966,9 @@ PaletteReplaceColorCommand::PaletteReplaceColorCommand(Document *document, int o
 
 void PaletteReplaceColorCommand::redo()
 {
-    if (m_stitches.count() || m_backstitches.count() || m_knots.count()) {
-        // populated from a previous redo call
-        // iterator over the existing pointers
-        for (Stitch *stitch : m_stitches) {
-            stitch->colorIndex = m_replacementIndex;
-        }
-
-        for (Backstitch *backstitch : m_backstitches) {
-            backstitch->colorIndex = m_replacementIndex;
-        }
-
-        for (Knot *knot : m_knots) {
-            knot->colorIndex = m_replacementIndex;
-        }
-    } else {
-        // search the stitch data for stitches of the required color
-        StitchData &stitchData = m_document->pattern()->stitches();
-
-        for (int row = 0; row < stitchData.height(); ++row) {
-            for (int col = 0; col < stitchData.width(); ++col) {
-                StitchQueue *queue = stitchData.stitchQueueAt(QPoint(col, row));
-
-                if (queue) {
-                    QListIterator<Stitch *> stitchIterator(*queue);
-
-                    while (stitchIterator.hasNext()) {
-                        Stitch *stitch = stitchIterator.next();
-
-                        if (stitch->colorIndex == m_originalIndex) {
-                            m_stitches.append(stitch);
-                            stitch->colorIndex = m_replacementIndex;
-                        }
-                    }
-                }
-            }
-        }
-
-        QListIterator<Backstitch *> backstitchIterator = stitchData.backstitchIterator();
-
-        while (backstitchIterator.hasNext()) {
-            Backstitch *backstitch = backstitchIterator.next();
-
-            if (backstitch->colorIndex == m_originalIndex) {
-                m_backstitches.append(backstitch);
-                backstitch->colorIndex = m_replacementIndex;
-            }
-        }
-
-        QListIterator<Knot *> knotIterator = stitchData.knotIterator();
-
-        while (knotIterator.hasNext()) {
-            Knot *knot = knotIterator.next();
-
-            if (knot->colorIndex == m_originalIndex) {
-                m_knots.append(knot);
-                knot->colorIndex = m_replacementIndex;
-            }
-        }
-    }
+    QMap<int, int> colorIndexes;
+    colorIndexes.insert(m_originalIndex, m_replacementIndex);
+    m_changes = m_document->pattern()->stitches().remapColors(colorIndexes);
 
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -1025,23 +977,11 @@ void PaletteReplaceColorCommand::redo()
 
 void PaletteReplaceColorCommand::undo()
 {
-    QListIterator<Stitch *> stitchIterator(m_stitches);
-
-    while (stitchIterator.hasNext()) {
-        stitchIterator.next()->colorIndex = m_originalIndex;
-    }
-
-    QListIterator<Backstitch *> backstitchIterator(m_backstitches);
-
-    while (backstitchIterator.hasNext()) {
-        backstitchIterator.next()->colorIndex = m_originalIndex;
-    }
-
-    QListIterator<Knot *> knotIterator(m_knots);
-
-    while (knotIterator.hasNext()) {
-        knotIterator.next()->colorIndex = m_originalIndex;
-    }
+    // the changes record which stitches of the replacement color were originally the original color
+    QMap<int, int> colorIndexes;
+    colorIndexes.insert(m_replacementIndex, m_originalIndex);
+    m_document->pattern()->stitches().remapColors(colorIndexes, m_changes);
+    m_changes.clear();
 
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -1091,7 +1031,7 @@ void UpdatePrinterConfigurationCommand::undo()
 EditCutCommand::EditCutCommand(Document *document,
                                const QRect &selectionArea,
                                int colorMask,
-                               const QList<Stitch::Type> &stitchMasks,
+                               const StitchMask &stitchMasks,
                                bool excludeBackstitches,
                                bool excludeKnots)
     : QUndoCommand(i18n("Cut"))
@@ -1172,7 +1112,7 @@ void EditPasteCommand::undo()
 MirrorSelectionCommand::MirrorSelectionCommand(Document *document,
                                                const QRect &selectionArea,
                                                int colorMask,
-                                               const QList<Stitch::Type> &stitchMasks,
+                                               const StitchMask &stitchMasks,
                                                bool excludeBackstitches,
                                                bool excludeKnots,
                                                Qt::Orientation orientation,
@@ -1227,7 +1167,7 @@ void MirrorSelectionCommand::undo()
 RotateSelectionCommand::RotateSelectionCommand(Document *document,
                                                const QRect &selectionArea,
                                                int colorMask,
-                                               const QList<Stitch::Type> &stitchMasks,
+                                               const StitchMask &stitchMasks,
                                                bool excludeBackstitches,
                                                bool excludeKnots,
                                                StitchData::Rotation rotation,
@@ -48,14 +48,18 @@ private:
 class ImportImageCommand : public QUndoCommand
 {
 public:
-    explicit ImportImageCommand(Document *);
+    ImportImageCommand(Document *, StitchData &, const DocumentPalette &);
     virtual ~ImportImageCommand() = default;
 
     virtual void redo() Q_DECL_OVERRIDE;
     virtual void undo() Q_DECL_OVERRIDE;
 
 private:
+    void swapDocumentState();
+
     Document *m_document;
+    StitchData m_stitches;
+    DocumentPalette m_palette;
 };
 
 class PaintStitchesCommand : public QUndoCommand
@@ -588,9 +592,7 @@ private:
     Document *m_document;
     int m_originalIndex;
     int m_replacementIndex;
-    QList<Stitch *> m_stitches;
-    QList<Backstitch *> m_backstitches;
-    QList<Knot *> m_knots;
+    StitchData::ColorChanges m_changes;
 };
 
 class PaletteSwapColorCommand : public QUndoCommand
@@ -628,7 +630,7 @@ public:
     EditCutCommand(Document *document,
                    const QRect &selectionArea,
                    int colorMask,
-                   const QList<Stitch::Type> &stitchMasks,
+                   const StitchMask &stitchMasks,
                    bool excludeBackstitches,
                    bool excludeKnots);
     virtual ~EditCutCommand();
@@ -640,7 +642,7 @@ private:
     Document *m_document;
     QRect m_selectionArea;
     int m_colorMask;
-    QList<Stitch::Type> m_stitchMasks;
+    StitchMask m_stitchMasks;
     bool m_excludeBackstitches;
     bool m_excludeKnots;
 
@@ -671,7 +673,7 @@ public:
     MirrorSelectionCommand(Document *,
                            const QRect &,
                            int,
-                           const QList<Stitch::Type> &,
+                           const StitchMask &,
                            bool,
                            bool,
                            Qt::Orientation,
@@ -689,7 +691,7 @@ private:
     Document *m_document;
     QRect m_selectionArea;
     int m_colorMask;
-    QList<Stitch::Type> m_stitchMasks;
+    StitchMask m_stitchMasks;
     bool m_excludeBackstitches;
     bool m_excludeKnots;
     Qt::Orientation m_orientation;
@@ -706,7 +708,7 @@ public:
     RotateSelectionCommand(Document *,
                            const QRect &,
                            int,
-                           const QList<Stitch::Type> &,
+                           const StitchMask &,
                            bool,
                            bool,
                            StitchData::Rotation,
@@ -724,7 +726,7 @@ private:
     Document *m_document;
     QRect m_selectionArea;
     int m_colorMask;
-    QList<Stitch::Type> m_stitchMasks;
+    StitchMask m_stitchMasks;
     bool m_excludeBackstitches;
     bool m_excludeKnots;
     StitchData::Rotation m_rotation;
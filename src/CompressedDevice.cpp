@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements a QIODevice that compresses data written to it, or
+ * decompresses data read from it, in frames on an underlying device.
+ */
+
+// Class include
+#include "CompressedDevice.h"
+
+// Qt includes
+#include <QtEndian>
+
+// KF includes
+#include <KLocalizedString>
+
+/**
+ * The largest compressed frame that will be accepted when reading, anything
+ * larger indicates a corrupt file.
+ */
+static const quint32 maximumFrameSize = 16 * 1024 * 1024;
+
+CompressedDevice::CompressedDevice(QIODevice *device, int frameSize)
+    : m_device(device)
+    , m_frameSize(frameSize)
+    , m_position(0)
+    , m_finished(false)
+    , m_failed(false)
+{
+}
+
+CompressedDevice::~CompressedDevice()
+{
+    if (isOpen()) {
+        close();
+    }
+}
+
+bool CompressedDevice::isSequential() const
+{
+    return true;
+}
+
+bool CompressedDevice::finish()
+{
+    if (!m_finished && !m_failed) {
+        if (openMode() & QIODevice::WriteOnly) {
+            if (m_buffer.size()) {
+                writeFrame();
+            }
+
+            char marker[4] = {0, 0, 0, 0};
+
+            if (!m_failed && m_device->write(marker, 4) != 4) {
+                setErrorString(m_device->errorString());
+                m_failed = true;
+            }
+
+            m_finished = true;
+        } else if (openMode() & QIODevice::ReadOnly) {
+            while (readFrame()) {
+                // discard any remaining data in the section
+            }
+        }
+    }
+
+    return !m_failed;
+}
+
+void CompressedDevice::close()
+{
+    finish();
+    QIODevice::close();
+}
+
+qint64 CompressedDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 read = 0;
+
+    while (read < maxSize) {
+        if (m_position == m_buffer.size() && !readFrame()) {
+            break;
+        }
+
+        qint64 available = qMin(maxSize - read, qint64(m_buffer.size() - m_position));
+        memcpy(data + read, m_buffer.constData() + m_position, available);
+        m_position += available;
+        read += available;
+    }
+
+    return (read == 0 && m_failed) ? -1 : read;
+}
+
+qint64 CompressedDevice::writeData(const char *data, qint64 maxSize)
+{
+    qint64 written = 0;
+
+    if (m_buffer.capacity() < m_frameSize) {
+        m_buffer.reserve(m_frameSize);
+    }
+
+    while (written < maxSize) {
+        qint64 available = qMin(maxSize - written, qint64(m_frameSize - m_buffer.size()));
+        m_buffer.append(data + written, available);
+        written += available;
+
+        if (m_buffer.size() == m_frameSize && !writeFrame()) {
+            return -1;
+        }
+    }
+
+    return written;
+}
+
+bool CompressedDevice::writeFrame()
+{
+    QByteArray frame = qCompress(m_buffer);
+    char length[4];
+    qToBigEndian<quint32>(frame.size(), length);
+
+    if ((m_device->write(length, 4) != 4) || (m_device->write(frame) != frame.size())) {
+        setErrorString(m_device->errorString());
+        m_failed = true;
+    }
+
+    m_buffer.resize(0);
+
+    return !m_failed;
+}
+
+bool CompressedDevice::readFrame()
+{
+    m_buffer.clear();
+    m_position = 0;
+
+    if (m_finished || m_failed) {
+        return false;
+    }
+
+    char length[4];
+
+    if (m_device->read(length, 4) != 4) {
+        setErrorString(i18n("Unexpected end of compressed data"));
+        m_failed = true;
+        return false;
+    }
+
+    quint32 frameSize = qFromBigEndian<quint32>(length);
+
+    if (frameSize == 0) {
+        m_finished = true;
+        return false;
+    }
+
+    if (frameSize > maximumFrameSize) {
+        setErrorString(i18n("Invalid compressed frame size %1", frameSize));
+        m_failed = true;
+        return false;
+    }
+
+    QByteArray frame = m_device->read(frameSize);
+
+    if (quint32(frame.size()) != frameSize) {
+        setErrorString(i18n("Unexpected end of compressed data"));
+        m_failed = true;
+        return false;
+    }
+
+    m_buffer = qUncompress(frame);
+
+    if (m_buffer.isEmpty()) {
+        setErrorString(i18n("Failed to decompress data"));
+        m_failed = true;
+        return false;
+    }
+
+    return true;
+}
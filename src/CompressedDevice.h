@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines a QIODevice that compresses data written to it, or
+ * decompresses data read from it, in frames on an underlying device.
+ */
+
+#ifndef CompressedDevice_H
+#define CompressedDevice_H
+
+// Qt includes
+#include <QByteArray>
+#include <QIODevice>
+
+/**
+ * This class wraps an underlying QIODevice and allows a QDataStream to be used
+ * to write a compressed section of a file, or to read it back again.
+ *
+ * Data is collected into frames of a fixed maximum size, each frame being
+ * compressed with qCompress and written as a quint32 length followed by the
+ * compressed bytes. A zero length marks the end of the section. Only a single
+ * frame is held in memory at any time, so compressing a large section does not
+ * require a copy of the whole section.
+ *
+ * The section must be completed by calling finish(), which writes the final
+ * frame and the end marker when writing, or skips to the end marker when
+ * reading, leaving the underlying device positioned after the section.
+ */
+class CompressedDevice : public QIODevice
+{
+public:
+    /**
+     * Constructor to initialise the device over an underlying device. The
+     * underlying device must already be open in the required mode.
+     *
+     * @param device is a pointer to the underlying QIODevice
+     * @param frameSize is the maximum number of uncompressed bytes in a frame
+     */
+    explicit CompressedDevice(QIODevice *device, int frameSize = 65536);
+
+    /**
+     * Destructor, finishes the section if it has not already been finished.
+     */
+    ~CompressedDevice() override;
+
+    /**
+     * The device can only be read or written in sequence.
+     *
+     * @return @c true
+     */
+    bool isSequential() const override;
+
+    /**
+     * Finish the section, writing any pending frame and the end marker, or
+     * reading up to and including the end marker.
+     *
+     * @return @c true if successful, @c false if the underlying device failed
+     */
+    bool finish();
+
+    /**
+     * Finish the section and close the device.
+     */
+    void close() override;
+
+protected:
+    /**
+     * Read decompressed data, reading further frames from the underlying
+     * device as required.
+     *
+     * @param data is a pointer to the buffer to read into
+     * @param maxSize is the maximum number of bytes to read
+     *
+     * @return the number of bytes read, or -1 on error
+     */
+    qint64 readData(char *data, qint64 maxSize) override;
+
+    /**
+     * Write data, compressing and writing a frame to the underlying device
+     * each time a frame is filled.
+     *
+     * @param data is a pointer to the buffer to write from
+     * @param maxSize is the number of bytes to write
+     *
+     * @return the number of bytes written, or -1 on error
+     */
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    /**
+     * Compress the pending data and write it as a frame.
+     *
+     * @return @c true if successful, @c false otherwise
+     */
+    bool writeFrame();
+
+    /**
+     * Read and decompress the next frame.
+     *
+     * @return @c true if a frame was read, @c false at the end marker or on error
+     */
+    bool readFrame();
+
+    QIODevice *m_device; /**< The underlying device */
+    int m_frameSize; /**< The maximum number of uncompressed bytes in a frame */
+    QByteArray m_buffer; /**< The uncompressed data of the current frame */
+    int m_position; /**< The read position in m_buffer */
+    bool m_finished; /**< @c true when the end marker has been written or read */
+    bool m_failed; /**< @c true if an error occurred on the underlying device */
+};
+
+#endif // CompressedDevice_H
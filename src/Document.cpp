@@ -10,13 +10,19 @@
 
 #include "Document.h"
 
+#include <QBuffer>
 #include <QDataStream>
 #include <QFile>
+#include <QHash>
+#include <QImage>
 #include <QVariant>
 
 #include <KLocalizedString>
 #include <KMessageBox>
 
+#include "BackgroundImage.h"
+#include "ByteCursor.h"
+#include "CompressedDevice.h"
 #include "Editor.h"
 #include "Exceptions.h"
 #include "Floss.h"
@@ -26,6 +32,46 @@
 #include "Preview.h"
 #include "SchemeManager.h"
 
+/**
+    The largest number of cells accepted in a PC Stitch pattern, a larger size indicates a corrupt file.
+    */
+static const int maximumPCStitchCells = 4000 * 4000;
+
+/**
+    Convert a 1 based PC Stitch color to a palette index, a color outside the palette indicates a corrupt file.
+    @param color the PC Stitch color
+    @param colors the number of colors in the palette
+    @return the palette index
+    */
+static int pcStitchColorIndex(int color, int colors)
+{
+    if ((color < 1) || (color > colors)) {
+        throw FailedReadFile(QString(i18n("Invalid color %1", color)));
+    }
+
+    return color - 1;
+}
+
+/**
+    Convert a 1 based PC Stitch cell and one of the 9 positions in it, numbered from the top left, to a snap point.
+    A point outside the pattern indicates a corrupt file.
+    @param x the cell column
+    @param y the cell row
+    @param position the position in the cell
+    @param snapArea the snap points of the pattern
+    @return the snap point
+    */
+static QPoint pcStitchSnapPoint(int x, int y, int position, const QRect &snapArea)
+{
+    QPoint point((x - 1) * 2 + ((position - 1) % 3), (y - 1) * 2 + ((position - 1) / 3));
+
+    if ((position < 1) || (position > 9) || !snapArea.contains(point)) {
+        throw FailedReadFile(QString(i18n("Invalid backstitch position")));
+    }
+
+    return point;
+}
+
 Document::Document()
     : m_editor(nullptr)
     , m_palette(nullptr)
@@ -202,6 +248,22 @@ void Document::readKXStitch(QDataStream &stream)
         stream >> version;
 
         switch (version) {
+        case 105: {
+            stream.setVersion(QDataStream::Qt_4_0); // maintain consistancy in the qt types
+            quint32 summarySize;
+            stream >> summarySize; // the summary is only used by DocumentSummary::read
+
+            if ((qint64(summarySize) > stream.device()->size() - stream.device()->pos()) || (stream.skipRawData(summarySize) != int(summarySize))) {
+                throw FailedReadFile(QString(i18n("Unexpected end of file")));
+            }
+
+            readSection(stream, m_properties);
+            readSection(stream, m_backgroundImages);
+            readSection(stream, *m_pattern);
+            readSection(stream, m_printerConfiguration);
+            break;
+        }
+
         case 104:
             stream.setVersion(QDataStream::Qt_4_0); // maintain consistancy in the qt types
             stream >> m_properties;
@@ -288,35 +350,260 @@ void Document::readPCStitch(QDataStream &stream)
 {
     initialiseNew();
 
-    char header[23];
-    stream.readRawData(header, 23);
+    // the file is parsed from memory, a buffer already in memory is used in place
+    QIODevice *device = stream.device();
+    device->seek(0);
+    QBuffer *buffer = qobject_cast<QBuffer *>(device);
+    QByteArray data = (buffer) ? buffer->data() : device->readAll();
+
+    if (data.size() < 23) {
+        throw InvalidFile();
+    }
+
+    ByteCursor cursor(data);
+    const char *header = cursor.readRaw(23);
 
     if (strncmp(header, "PCStitch 5 Pattern File", 23) == 0) {
-        readPCStitch5File(stream);
+        readPCStitch5File(cursor);
     } else if (strncmp(header, "PCStitch 6 Pattern File", 23) == 0) {
-        readPCStitch6File(stream);
+        readPCStitch6File(cursor);
     } else if (strncmp(header, "PCStitch 7 Pattern File", 23) == 0) {
-        readPCStitch7File(stream);
+        readPCStitch7File(cursor);
     } else {
         throw InvalidFile();
     }
 }
 
-void Document::write(QDataStream &stream)
+void Document::write(QDataStream &stream, bool compress)
 {
     stream.setVersion(QDataStream::Qt_4_0); // maintain consistancy in the qt types
     stream.writeRawData("KXStitchDoc", 11);
     stream << version;
-    stream << m_properties;
-    stream << m_backgroundImages;
-    stream << *m_pattern;
-    stream << m_printerConfiguration;
+
+    // the summary is written uncompressed and preceded by its size so it can be read or skipped
+    QByteArray summaryData;
+    QDataStream summaryStream(&summaryData, QIODevice::WriteOnly);
+    summaryStream.setVersion(QDataStream::Qt_4_0);
+    summaryStream << ((m_patternData.isNull()) ? summary() : m_snapshotSummary);
+    stream << quint32(summaryData.size());
+    stream.writeRawData(summaryData.constData(), summaryData.size());
+
+    writeSection(stream, m_properties, compress);
+    writeSection(stream, m_backgroundImages, compress);
+
+    if (m_patternData.isNull()) {
+        writeSection(stream, *m_pattern, compress);
+    } else {
+        writeSectionData(stream, m_patternData, compress);
+    }
+
+    writeSection(stream, m_printerConfiguration, compress);
 
     if (stream.status() != QDataStream::Ok) {
         throw FailedWriteFile(stream.status());
     }
 }
 
+/**
+    Create a summary of the document to be written at the start of the file.
+    The thumbnail has one pixel per cell, colored with a full stitch in the cell if
+    there is one, otherwise with the first stitch, or the fabric color for empty cells.
+    It is scaled down to fit DocumentSummary::thumbnailSize if the pattern is larger.
+    @return the DocumentSummary
+    */
+DocumentSummary Document::summary()
+{
+    StitchData &stitches = m_pattern->stitches();
+    int width = stitches.width();
+    int height = stitches.height();
+    int stitchCount = 0;
+
+    QHash<int, QRgb> colors;
+    const QMap<int, DocumentFloss *> flosses = m_pattern->palette().flosses();
+
+    for (auto it = flosses.constBegin(); it != flosses.constEnd(); ++it) {
+        colors.insert(it.key(), it.value()->flossColor().rgb());
+    }
+
+    QImage thumbnail;
+
+    if (width && height) {
+        thumbnail = QImage(width, height, QImage::Format_RGB32);
+        thumbnail.fill(property(QStringLiteral("fabricColor")).value<QColor>());
+
+        for (int y = 0; y < height; ++y) {
+            QRgb *line = reinterpret_cast<QRgb *>(thumbnail.scanLine(y));
+
+            for (int x = 0; x < width; ++x) {
+                StitchQueue *queue = stitches.stitchQueueAt(x, y);
+
+                if (queue == nullptr || queue->isEmpty()) {
+                    continue;
+                }
+
+                stitchCount += queue->count();
+                Stitch *stitch = queue->first();
+
+                for (Stitch *s : std::as_const(*queue)) {
+                    if (s->type == Stitch::Full) {
+                        stitch = s;
+                        break;
+                    }
+                }
+
+                line[x] = colors.value(stitch->colorIndex, line[x]);
+            }
+        }
+
+        if ((width > DocumentSummary::thumbnailSize) || (height > DocumentSummary::thumbnailSize)) {
+            thumbnail = thumbnail.scaled(DocumentSummary::thumbnailSize, DocumentSummary::thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+    }
+
+    return DocumentSummary(property(QStringLiteral("title")).toString(),
+                           width,
+                           height,
+                           colors.count(),
+                           stitchCount,
+                           stitches.backstitches().count(),
+                           stitches.knots().count(),
+                           thumbnail);
+}
+
+/**
+    Create a copy of the document contents that can be written on another thread
+    whilst this document continues to be edited. The pattern is serialized into a
+    buffer and the summary, including its thumbnail, is created here on the calling
+    thread, so the time taken still grows with the size of the pattern. Only the
+    compression and the writing of the file are left for the other thread. The
+    properties, printer configuration and the background image data are implicitly
+    shared. The copy can only be written.
+    The copy must be deleted on the thread that created it.
+    @return a pointer to the new Document
+    */
+Document *Document::snapshot()
+{
+    Document *document = new Document;
+
+    document->m_url = m_url;
+    document->m_properties = m_properties;
+
+    auto backgroundImages = m_backgroundImages.backgroundImages();
+
+    while (backgroundImages.hasNext()) {
+        document->m_backgroundImages.addBackgroundImage(QSharedPointer<BackgroundImage>(new BackgroundImage(*backgroundImages.next())));
+    }
+
+    QDataStream patternStream(&document->m_patternData, QIODevice::WriteOnly);
+    patternStream.setVersion(QDataStream::Qt_4_0);
+    patternStream << *m_pattern;
+
+    document->m_snapshotSummary = summary();
+    document->m_printerConfiguration = m_printerConfiguration;
+
+    return document;
+}
+
+/**
+    Write a section of the document, optionally compressed.
+    The compressed data is written in frames as it is streamed, so the section
+    is never held in memory in its entirety.
+    @param stream the stream to write to
+    @param section the object to be written
+    @param compress true if the section should be compressed
+    */
+template <class T>
+void Document::writeSection(QDataStream &stream, const T &section, bool compress)
+{
+    if (compress) {
+        stream << qint32(Zlib);
+
+        CompressedDevice device(stream.device());
+        device.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+        QDataStream sectionStream(&device);
+        sectionStream.setVersion(stream.version());
+        sectionStream << section;
+
+        if (sectionStream.status() != QDataStream::Ok) {
+            throw FailedWriteFile(sectionStream.status());
+        }
+
+        if (!device.finish()) {
+            throw FailedWriteFile(QDataStream::WriteFailed);
+        }
+    } else {
+        stream << qint32(Uncompressed);
+        stream << section;
+    }
+}
+
+/**
+    Write a section of the document that has already been serialized, optionally compressed.
+    The section is written in the same format as writeSection.
+    @param stream the stream to write to
+    @param data the serialized section
+    @param compress true if the section should be compressed
+    */
+void Document::writeSectionData(QDataStream &stream, const QByteArray &data, bool compress)
+{
+    if (compress) {
+        stream << qint32(Zlib);
+
+        CompressedDevice device(stream.device());
+        device.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+
+        if ((device.write(data) != data.size()) || !device.finish()) {
+            throw FailedWriteFile(QDataStream::WriteFailed);
+        }
+    } else {
+        stream << qint32(Uncompressed);
+
+        if (stream.writeRawData(data.constData(), data.size()) != data.size()) {
+            throw FailedWriteFile(QDataStream::WriteFailed);
+        }
+    }
+}
+
+/**
+    Read a section of the document written by writeSection.
+    @param stream the stream to read from
+    @param section the object to be read
+    */
+template <class T>
+void Document::readSection(QDataStream &stream, T &section)
+{
+    qint32 codec;
+    stream >> codec;
+
+    switch (codec) {
+    case Uncompressed:
+        stream >> section;
+        break;
+
+    case Zlib: {
+        CompressedDevice device(stream.device());
+        device.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        QDataStream sectionStream(&device);
+        sectionStream.setVersion(stream.version());
+        sectionStream >> section;
+
+        if ((sectionStream.status() != QDataStream::Ok) || !device.finish()) {
+            throw FailedReadFile(QString(i18n("Failed reading compressed section.\n%1", device.errorString())));
+        }
+
+        break;
+    }
+
+    default:
+        throw InvalidFileVersion(QString(i18n("Section codec %1", codec)));
+        break;
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        throw FailedReadFile(stream.status());
+    }
+}
+
 QVariant Document::property(const QString &name) const
 {
     QVariant p;
@@ -335,7 +622,7 @@ void Document::setProperty(const QString &name, const QVariant &value)
     m_properties[name] = value;
 }
 
-void Document::readPCStitch5File(QDataStream &stream)
+void Document::readPCStitch5File(ByteCursor &cursor)
 {
     /* File Format
         uchar[256]      // header 'PCStitch 5 Pattern File'
@@ -413,35 +700,30 @@ void Document::readPCStitch5File(QDataStream &stream)
         uchar[4]        // unknown;
         uchar[4]        // unknown;
     */
-    stream.setByteOrder(QDataStream::LittleEndian);
-    stream.device()->seek(256);
+    cursor.seek(256);
+    cursor.skip(8); // unknown
 
-    quint32 unknown32;
-    stream >> unknown32;
-    stream >> unknown32;
+    quint16 width = cursor.readUInt16();
+    quint16 height = cursor.readUInt16();
 
-    quint16 width;
-    quint16 height;
-    stream >> width;
-    stream >> height;
+    if (int(width) * int(height) > maximumPCStitchCells) {
+        throw FailedReadFile(QString(i18n("Invalid pattern size %1 x %2", width, height)));
+    }
 
     m_pattern->stitches().resize(width, height);
     setProperty(QStringLiteral("unitsFormat"), Configuration::EnumDocument_UnitsFormat::Stitches);
 
-    quint16 clothCount;
-    stream >> clothCount;
-    setProperty(QStringLiteral("horizontalClothCount"), double(clothCount));
-    stream >> clothCount;
-    setProperty(QStringLiteral("verticalClothCount"), double(clothCount));
+    setProperty(QStringLiteral("horizontalClothCount"), double(cursor.readUInt16()));
+    setProperty(QStringLiteral("verticalClothCount"), double(cursor.readUInt16()));
     setProperty(QStringLiteral("clothCountUnits"), Configuration::EnumEditor_ClothCountUnits::Inches);
 
-    setProperty(QStringLiteral("author"), readPCStitchString(stream));
-    setProperty(QStringLiteral("copyright"), readPCStitchString(stream));
-    setProperty(QStringLiteral("title"), readPCStitchString(stream));
-    setProperty(QStringLiteral("fabric"), readPCStitchString(stream));
+    setProperty(QStringLiteral("author"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("copyright"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("title"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("fabric"), readPCStitchString(cursor));
     setProperty(QStringLiteral("fabricColor"), QColor(Qt::white));
 
-    QString instructions = readPCStitchString(stream);
+    QString instructions = readPCStitchString(cursor);
 
     if (!instructions.isEmpty()) {
         int index = instructions.indexOf(QLatin1String("}}")); // end of font defs
@@ -457,16 +739,12 @@ void Document::readPCStitch5File(QDataStream &stream)
 
     setProperty(QStringLiteral("instructions"), instructions);
 
-    char buffer[51];
-    stream.readRawData(buffer, 25);
-
-    if (strncmp(buffer, "PCStitch 5 Floss Palette!", 25) == 0) {
-        quint16 colors;
-        stream >> colors;
+    if (strncmp(cursor.readRaw(25), "PCStitch 5 Floss Palette!", 25) == 0) {
+        quint16 colors = cursor.readUInt16();
 
-        stream.readRawData(buffer, 30); // this should be 'DMC       Anchor    Coates    '
+        cursor.skip(30); // this should be 'DMC       Anchor    Coates    '
 
-        QString fontName = readPCStitchString(stream); // the font name, usually 'PCStitch Symbols'
+        QString fontName = readPCStitchString(cursor); // the font name, usually 'PCStitch Symbols'
 
         m_pattern->palette().setSchemeName(QStringLiteral("DMC")); // assume this palette will be DMC
         FlossScheme *scheme = SchemeManager::scheme(QStringLiteral("DMC"));
@@ -475,22 +753,25 @@ void Document::readPCStitch5File(QDataStream &stream)
             throw FailedReadFile(QString(i18n("The floss scheme DMC was not found"))); // this shouldn't happen because DMC should always be available
         }
 
-        stream >> unknown32;
+        cursor.skip(4); // unknown
 
-        for (int i = 0; i < colors; i++) {
 #pragma pack(push)
 #pragma pack(1)
-            struct PALETTE_ENTRY {
-                unsigned char RGBA[4];
-                char colorName[30];
-                char colorDescription[50];
-                unsigned char symbol;
-                unsigned short stitchStrands;
-                unsigned short backstitchStrands;
-            } paletteEntry;
+        struct PALETTE_ENTRY {
+            unsigned char RGBA[4];
+            char colorName[30];
+            char colorDescription[50];
+            unsigned char symbol;
+            unsigned short stitchStrands;
+            unsigned short backstitchStrands;
+        };
 #pragma pack(pop)
 
-            stream.readRawData(reinterpret_cast<char *>(&paletteEntry), sizeof(struct PALETTE_ENTRY));
+        cursor.requireRecords(colors, sizeof(struct PALETTE_ENTRY));
+
+        for (int i = 0; i < colors; i++) {
+            PALETTE_ENTRY paletteEntry;
+            memcpy(&paletteEntry, cursor.readRaw(sizeof(struct PALETTE_ENTRY)), sizeof(struct PALETTE_ENTRY));
 
             QColor color(int(paletteEntry.RGBA[0]), int(paletteEntry.RGBA[1]), int(paletteEntry.RGBA[2]));
             QString colorName = QString::fromLatin1(paletteEntry.colorName, 10).trimmed();
@@ -539,92 +820,96 @@ void Document::readPCStitch5File(QDataStream &stream)
                                  Stitch::BLQtr,
                                  Stitch::BRQtr}; // conversion of PCStitch to KXStitch
 
+    int stitchTypes = sizeof(stitchType) / sizeof(Stitch::Type);
     int documentWidth = m_pattern->stitches().width();
     int documentHeight = m_pattern->stitches().height();
     int cells = documentWidth * documentHeight;
+    int colors = m_pattern->palette().flosses().count();
+    QRect snapArea(0, 0, documentWidth * 2 + 1, documentHeight * 2 + 1);
 
-    quint16 cellCount;
+    for (int i = 0; i < cells;) {
+        quint16 cellCount = cursor.readUInt16();
+        quint8 color = cursor.readUInt8();
+        quint8 type = cursor.readUInt8();
 
-    for (int i = 0; i < cells; i += cellCount) {
-        quint8 color;
-        quint8 type;
+        // an empty run or a run past the end of the pattern indicates a corrupt file
+        if ((cellCount == 0) || (cellCount > cells - i)) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data")));
+        }
 
-        stream >> cellCount;
-        stream >> color;
-        stream >> type;
+        // types without a KXStitch equivalent, such as petite stitches, are skipped
+        if ((type != 0xff) && (type < stitchTypes)) {
+            int colorIndex = pcStitchColorIndex(color, colors);
 
-        if (type != 0xff) {
             for (int c = 0; c < cellCount; c++) {
                 int xc = (i + c) / documentHeight;
                 int yc = (i + c) % documentHeight;
-                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], color - 1); // color-1 because PCStitch uses 1 based array
+                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], colorIndex);
             }
         }
+
+        i += cellCount;
     }
 
-    quint32 extras;
-    stream >> extras;
+    quint32 extras = cursor.readUInt32();
+    cursor.requireRecords(extras, 12);
 
     while (extras--) {
-        quint16 x;
-        quint16 y;
-        quint8 color;
-        quint8 type;
+        int x = cursor.readUInt16();
+        int y = cursor.readUInt16();
 
-        stream >> x;
-        stream >> y;
+        if ((x < 1) || (x > documentWidth) || (y < 1) || (y > documentHeight)) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data")));
+        }
 
         for (int dx = 0; dx < 4; dx++) {
-            stream >> color;
-            stream >> type;
+            quint8 color = cursor.readUInt8();
+            quint8 type = cursor.readUInt8();
 
-            if (type != 0xff) {
-                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], color - 1);
+            if ((type != 0xff) && (type < stitchTypes)) {
+                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], pcStitchColorIndex(color, colors));
             }
         }
     }
 
     // read french knots
 
-    quint32 knots;
-    stream >> knots;
+    quint32 knots = cursor.readUInt32();
+    cursor.requireRecords(knots, 5);
 
     while (knots--) {
-        quint16 x;
-        quint16 y;
-        quint8 color;
+        int x = cursor.readUInt16();
+        int y = cursor.readUInt16();
+        int color = cursor.readUInt8();
+        QPoint position(x - 1, y - 1);
 
-        stream >> x;
-        stream >> y;
-        stream >> color;
-        m_pattern->stitches().addFrenchKnot(QPoint(x - 1, y - 1), color - 1);
+        if (!snapArea.contains(position)) {
+            throw FailedReadFile(QString(i18n("Invalid knot position")));
+        }
+
+        m_pattern->stitches().addFrenchKnot(position, pcStitchColorIndex(color, colors));
     }
 
     // read backstitches
 
-    quint32 backstitches;
-    stream >> backstitches;
+    quint32 backstitches = cursor.readUInt32();
+    cursor.requireRecords(backstitches, 13);
 
     while (backstitches--) {
-        quint16 sx;
-        quint16 sy;
-        quint16 sp;
-        quint16 ex;
-        quint16 ey;
-        quint16 ep;
-        quint8 color;
-        stream >> sx >> sy >> sp >> ex >> ey >> ep >> color;
-        m_pattern->stitches().addBackstitch(QPoint(--sx * 2 + ((sp - 1) % 3), --sy * 2 + ((sp - 1) / 3)),
-                                            QPoint(--ex * 2 + ((ep - 1) % 3), --ey * 2 + ((ep - 1) / 3)),
-                                            color - 1);
-    }
-
-    if (stream.status() != QDataStream::Ok) {
-        throw FailedReadFile(QString(i18n("Stream error")));
+        int sx = cursor.readUInt16();
+        int sy = cursor.readUInt16();
+        int sp = cursor.readUInt16();
+        int ex = cursor.readUInt16();
+        int ey = cursor.readUInt16();
+        int ep = cursor.readUInt16();
+        int color = cursor.readUInt8();
+        m_pattern->stitches().addBackstitch(pcStitchSnapPoint(sx, sy, sp, snapArea),
+                                            pcStitchSnapPoint(ex, ey, ep, snapArea),
+                                            pcStitchColorIndex(color, colors));
     }
 }
 
-void Document::readPCStitch6File(QDataStream &stream)
+void Document::readPCStitch6File(ByteCursor &cursor)
 {
     /* File Format
         uchar[256]      // header 'PCStitch 6 Pattern File'
@@ -707,37 +992,30 @@ void Document::readPCStitch6File(QDataStream &stream)
         uchar[4]        // unknown
         uchar[4]        // unknown
     */
-    stream.setByteOrder(QDataStream::LittleEndian);
-    stream.device()->seek(256);
-
-    quint16 unknown16;
-    quint32 unknown32;
+    cursor.seek(256);
+    cursor.skip(8); // unknown
 
-    stream >> unknown32;
-    stream >> unknown32;
+    quint16 width = cursor.readUInt16();
+    quint16 height = cursor.readUInt16();
 
-    quint16 width;
-    quint16 height;
-    stream >> width;
-    stream >> height;
+    if (int(width) * int(height) > maximumPCStitchCells) {
+        throw FailedReadFile(QString(i18n("Invalid pattern size %1 x %2", width, height)));
+    }
 
     m_pattern->stitches().resize(width, height);
     setProperty(QStringLiteral("unitsFormat"), Configuration::EnumDocument_UnitsFormat::Stitches);
 
-    quint16 clothCount;
-    stream >> clothCount;
-    setProperty(QStringLiteral("horizontalClothCount"), double(clothCount));
-    stream >> clothCount;
-    setProperty(QStringLiteral("verticalClothCount"), double(clothCount));
+    setProperty(QStringLiteral("horizontalClothCount"), double(cursor.readUInt16()));
+    setProperty(QStringLiteral("verticalClothCount"), double(cursor.readUInt16()));
     setProperty(QStringLiteral("clothCountUnits"), Configuration::EnumEditor_ClothCountUnits::Inches);
 
-    setProperty(QStringLiteral("author"), readPCStitchString(stream));
-    setProperty(QStringLiteral("copyright"), readPCStitchString(stream));
-    setProperty(QStringLiteral("title"), readPCStitchString(stream));
-    setProperty(QStringLiteral("fabric"), readPCStitchString(stream));
+    setProperty(QStringLiteral("author"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("copyright"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("title"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("fabric"), readPCStitchString(cursor));
     setProperty(QStringLiteral("fabricColor"), QColor(Qt::white));
 
-    QString instructions = readPCStitchString(stream);
+    QString instructions = readPCStitchString(cursor);
 
     if (!instructions.isEmpty()) {
         int index = instructions.indexOf(QLatin1String("}}")); // end of font defs
@@ -751,19 +1029,14 @@ void Document::readPCStitch6File(QDataStream &stream)
 
     setProperty(QStringLiteral("instructions"), instructions);
 
-    char buffer[125];
-    stream.readRawData(buffer, 25);
-
-    if (strncmp(buffer, "PCStitch 6 Floss Palette!", 25) == 0) {
-        stream >> unknown16;
-        stream.readRawData(buffer, 40);
+    if (strncmp(cursor.readRaw(25), "PCStitch 6 Floss Palette!", 25) == 0) {
+        cursor.skip(42); // unknown and 'DMC' padded with spaces
 
-        quint16 colors;
-        stream >> colors;
+        quint16 colors = cursor.readUInt16();
 
-        readPCStitchString(stream); // symbols font
+        readPCStitchString(cursor); // symbols font
 
-        stream >> unknown32;
+        cursor.skip(4); // unknown
 
         m_pattern->palette().setSchemeName(QStringLiteral("DMC"));
         FlossScheme *scheme = SchemeManager::scheme(QStringLiteral("DMC"));
@@ -772,24 +1045,27 @@ void Document::readPCStitch6File(QDataStream &stream)
             throw FailedReadFile(QString(i18n("The floss scheme DMC was not found"))); // this shouldn't happen because DMC should always be available
         }
 
-        for (int i = 0; i < colors; i++) {
 #pragma pack(push)
 #pragma pack(1) // pack the structure
-            struct PALETTE_ENTRY {
-                char colorDescription_1[30];
-                unsigned char RGBA[4];
-                char colorName_1[10];
-                unsigned char unknown_1[59];
-                unsigned short stitchStrands;
-                unsigned short backstitchStrands;
-                unsigned short unknown_2;
-                char colorDescription_2[30];
-                unsigned char unknown_3[5];
-                char colorName_2[25]; // seems to be Black all the time
-            } paletteEntry;
+        struct PALETTE_ENTRY {
+            char colorDescription_1[30];
+            unsigned char RGBA[4];
+            char colorName_1[10];
+            unsigned char unknown_1[59];
+            unsigned short stitchStrands;
+            unsigned short backstitchStrands;
+            unsigned short unknown_2;
+            char colorDescription_2[30];
+            unsigned char unknown_3[5];
+            char colorName_2[25]; // seems to be Black all the time
+        };
 #pragma pack(pop)
 
-            stream.readRawData(reinterpret_cast<char *>(&paletteEntry), sizeof(struct PALETTE_ENTRY));
+        cursor.requireRecords(colors, sizeof(struct PALETTE_ENTRY));
+
+        for (int i = 0; i < colors; i++) {
+            PALETTE_ENTRY paletteEntry;
+            memcpy(&paletteEntry, cursor.readRaw(sizeof(struct PALETTE_ENTRY)), sizeof(struct PALETTE_ENTRY));
 
             QColor color = QColor(paletteEntry.RGBA[0], paletteEntry.RGBA[1], paletteEntry.RGBA[2]);
             QString colorName = QString::fromLatin1(paletteEntry.colorName_1, 10).trimmed(); // minus the white space
@@ -834,92 +1110,96 @@ void Document::readPCStitch6File(QDataStream &stream)
                                  Stitch::BLQtr,
                                  Stitch::BRQtr}; // conversion of PCStitch to KXStitch
 
+    int stitchTypes = sizeof(stitchType) / sizeof(Stitch::Type);
     int documentWidth = m_pattern->stitches().width();
     int documentHeight = m_pattern->stitches().height();
     int cells = documentWidth * documentHeight;
+    int colors = m_pattern->palette().flosses().count();
+    QRect snapArea(0, 0, documentWidth * 2 + 1, documentHeight * 2 + 1);
 
-    quint16 cellCount;
+    for (int i = 0; i < cells;) {
+        quint16 cellCount = cursor.readUInt16();
+        quint8 color = cursor.readUInt8();
+        quint8 type = cursor.readUInt8();
 
-    for (int i = 0; i < cells; i += cellCount) {
-        quint8 color;
-        quint8 type;
+        // an empty run or a run past the end of the pattern indicates a corrupt file
+        if ((cellCount == 0) || (cellCount > cells - i)) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data")));
+        }
 
-        stream >> cellCount;
-        stream >> color;
-        stream >> type;
+        // types without a KXStitch equivalent, such as petite stitches, are skipped
+        if ((type != 0xff) && (type < stitchTypes)) {
+            int colorIndex = pcStitchColorIndex(color, colors);
 
-        if (type != 0xff) {
             for (int c = 0; c < cellCount; c++) {
                 int xc = (i + c) / documentHeight;
                 int yc = (i + c) % documentHeight;
-                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], color - 1); // color-1 because PCStitch uses 1 based array
+                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], colorIndex);
             }
         }
+
+        i += cellCount;
     }
 
-    quint32 extras;
-    stream >> extras;
+    quint32 extras = cursor.readUInt32();
+    cursor.requireRecords(extras, 12);
 
     while (extras--) {
-        qint16 x;
-        qint16 y;
-        quint8 color;
-        quint8 type;
+        int x = cursor.readInt16();
+        int y = cursor.readInt16();
 
-        stream >> x;
-        stream >> y;
+        if ((x < 1) || (x > documentWidth) || (y < 1) || (y > documentHeight)) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data")));
+        }
 
         for (int dx = 0; dx < 4; dx++) {
-            stream >> color;
-            stream >> type;
+            quint8 color = cursor.readUInt8();
+            quint8 type = cursor.readUInt8();
 
-            if (type != 0xff) {
-                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], color - 1);
+            if ((type != 0xff) && (type < stitchTypes)) {
+                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], pcStitchColorIndex(color, colors));
             }
         }
     }
 
     // read french knots
 
-    quint32 knots;
-    stream >> knots;
+    quint32 knots = cursor.readUInt32();
+    cursor.requireRecords(knots, 5);
 
     while (knots--) {
-        qint16 x;
-        qint16 y;
-        quint8 color;
+        int x = cursor.readInt16();
+        int y = cursor.readInt16();
+        int color = cursor.readUInt8();
+        QPoint position(x - 1, y - 1);
 
-        stream >> x;
-        stream >> y;
-        stream >> color;
-        m_pattern->stitches().addFrenchKnot(QPoint(x - 1, y - 1), color - 1);
+        if (!snapArea.contains(position)) {
+            throw FailedReadFile(QString(i18n("Invalid knot position")));
+        }
+
+        m_pattern->stitches().addFrenchKnot(position, pcStitchColorIndex(color, colors));
     }
 
     // read backstitches
 
-    qint32 backstitches;
-    stream >> backstitches;
+    quint32 backstitches = cursor.readUInt32();
+    cursor.requireRecords(backstitches, 14);
 
     while (backstitches--) {
-        qint16 sx;
-        qint16 sy;
-        qint16 sp;
-        qint16 ex;
-        qint16 ey;
-        qint16 ep;
-        quint16 color;
-        stream >> sx >> sy >> sp >> ex >> ey >> ep >> color;
-        m_pattern->stitches().addBackstitch(QPoint(--sx * 2 + ((sp - 1) % 3), --sy * 2 + ((sp - 1) / 3)),
-                                            QPoint(--ex * 2 + ((ep - 1) % 3), --ey * 2 + ((ep - 1) / 3)),
-                                            color - 1);
-    }
-
-    if (stream.status() != QDataStream::Ok) {
-        throw FailedReadFile(QString(i18n("Stream error")));
+        int sx = cursor.readInt16();
+        int sy = cursor.readInt16();
+        int sp = cursor.readInt16();
+        int ex = cursor.readInt16();
+        int ey = cursor.readInt16();
+        int ep = cursor.readInt16();
+        int color = cursor.readUInt16();
+        m_pattern->stitches().addBackstitch(pcStitchSnapPoint(sx, sy, sp, snapArea),
+                                            pcStitchSnapPoint(ex, ey, ep, snapArea),
+                                            pcStitchColorIndex(color, colors));
     }
 }
 
-void Document::readPCStitch7File(QDataStream &stream)
+void Document::readPCStitch7File(ByteCursor &cursor)
 {
     /* File Format
         uchar[256]      // header 'PCStitch 7 Pattern File'
@@ -1014,40 +1294,34 @@ void Document::readPCStitch7File(QDataStream &stream)
             quint16     // color, 1 based index of color list
         } repeated for backstitches
     */
-    stream.setByteOrder(QDataStream::LittleEndian);
-    stream.device()->seek(256);
+    cursor.seek(256);
+    cursor.skip(8); // unknown
 
-    quint32 unknown32;
-    stream >> unknown32;
-    stream >> unknown32;
+    quint16 width = cursor.readUInt16();
+    quint16 height = cursor.readUInt16();
 
-    quint16 width;
-    quint16 height;
-    stream >> width;
-    stream >> height;
+    if (int(width) * int(height) > maximumPCStitchCells) {
+        throw FailedReadFile(QString(i18n("Invalid pattern size %1 x %2", width, height)));
+    }
 
     m_pattern->stitches().resize(width, height);
     setProperty(QStringLiteral("unitsFormat"), Configuration::EnumDocument_UnitsFormat::Stitches);
 
-    quint16 clothCount;
-    stream >> clothCount;
-    setProperty(QStringLiteral("horizontalClothCount"), double(clothCount));
-    stream >> clothCount;
-    setProperty(QStringLiteral("verticalClothCount"), double(clothCount));
+    setProperty(QStringLiteral("horizontalClothCount"), double(cursor.readUInt16()));
+    setProperty(QStringLiteral("verticalClothCount"), double(cursor.readUInt16()));
     setProperty(QStringLiteral("clothCountUnits"), Configuration::EnumEditor_ClothCountUnits::Inches);
 
-    unsigned char r;
-    unsigned char g;
-    unsigned char b;
-    unsigned char a;
-    stream >> r >> g >> b >> a;
+    quint8 r = cursor.readUInt8();
+    quint8 g = cursor.readUInt8();
+    quint8 b = cursor.readUInt8();
+    cursor.skip(1); // alpha
     setProperty(QStringLiteral("fabricColor"), QColor(r, g, b)); // alpha defaults to 255
-    setProperty(QStringLiteral("author"), readPCStitchString(stream));
-    setProperty(QStringLiteral("copyright"), readPCStitchString(stream));
-    setProperty(QStringLiteral("title"), readPCStitchString(stream));
-    setProperty(QStringLiteral("fabric"), readPCStitchString(stream));
+    setProperty(QStringLiteral("author"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("copyright"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("title"), readPCStitchString(cursor));
+    setProperty(QStringLiteral("fabric"), readPCStitchString(cursor));
 
-    QString instructions = readPCStitchString(stream);
+    QString instructions = readPCStitchString(cursor);
 
     if (!instructions.isEmpty()) {
         int index = instructions.indexOf(QLatin1String("}}")); // end of font defs
@@ -1061,21 +1335,16 @@ void Document::readPCStitch7File(QDataStream &stream)
 
     setProperty(QStringLiteral("instructions"), instructions);
 
-    QString keywords(readPCStitchString(stream));
-    QString website(readPCStitchString(stream));
-
-    quint16 defaultStitchStrands;
-    quint16 defaultBackstitchStrands;
-    stream >> defaultStitchStrands >> defaultBackstitchStrands;
+    QString keywords(readPCStitchString(cursor));
+    QString website(readPCStitchString(cursor));
 
-    char *buffer = new char[25];
-    stream.readRawData(buffer, 25);
+    quint16 defaultStitchStrands = cursor.readUInt16();
+    quint16 defaultBackstitchStrands = cursor.readUInt16();
 
-    if (strncmp(buffer, "PCStitch Floss Palette!!!", 25) == 0) {
-        stream >> unknown32;
+    if (strncmp(cursor.readRaw(25), "PCStitch Floss Palette!!!", 25) == 0) {
+        cursor.skip(4); // unknown
 
-        quint16 colors;
-        stream >> colors;
+        quint16 colors = cursor.readUInt16();
 
         m_pattern->palette().setSchemeName(QStringLiteral("DMC"));
         FlossScheme *scheme = SchemeManager::scheme(QStringLiteral("DMC"));
@@ -1084,26 +1353,29 @@ void Document::readPCStitch7File(QDataStream &stream)
             throw FailedReadFile(QString(i18n("The floss scheme DMC was not found"))); // this shouldn't happen because DMC should always be available
         }
 
-        for (int i = 0; i < colors; i++) {
 #pragma pack(push)
 #pragma pack(1)
-            struct PALETTE_ENTRY {
-                char scheme[33];
-                char colorName_1[10];
-                char colorDescription_1[30];
-                uchar unknown_1[4];
-                uchar RGBA_1[4];
-                uchar unknown_2[81];
-                char font[30];
-                uchar unknown_3[7];
-                char colorDescription_2[30];
-                uchar RGBA_2[4];
-                char colorName_2[10];
-                uchar unknown_4[7];
-            } paletteEntry;
+        struct PALETTE_ENTRY {
+            char scheme[33];
+            char colorName_1[10];
+            char colorDescription_1[30];
+            uchar unknown_1[4];
+            uchar RGBA_1[4];
+            uchar unknown_2[81];
+            char font[30];
+            uchar unknown_3[7];
+            char colorDescription_2[30];
+            uchar RGBA_2[4];
+            char colorName_2[10];
+            uchar unknown_4[7];
+        };
 #pragma pack(pop)
 
-            stream.readRawData(reinterpret_cast<char *>(&paletteEntry), sizeof(struct PALETTE_ENTRY));
+        cursor.requireRecords(colors, sizeof(struct PALETTE_ENTRY));
+
+        for (int i = 0; i < colors; i++) {
+            PALETTE_ENTRY paletteEntry;
+            memcpy(&paletteEntry, cursor.readRaw(sizeof(struct PALETTE_ENTRY)), sizeof(struct PALETTE_ENTRY));
 
             QColor color = QColor(int(paletteEntry.RGBA_1[0]), int(paletteEntry.RGBA_1[1]), int(paletteEntry.RGBA_1[2]));
             QString colorName = QString::fromLatin1(paletteEntry.colorName_1, 10).trimmed(); // minus the white space
@@ -1148,107 +1420,101 @@ void Document::readPCStitch7File(QDataStream &stream)
                                  Stitch::BLQtr,
                                  Stitch::BRQtr}; // conversion of PCStitch to KXStitch
     // TODO above needs to include petite stitches
+    int stitchTypes = sizeof(stitchType) / sizeof(Stitch::Type);
     int documentWidth = m_pattern->stitches().width();
     int documentHeight = m_pattern->stitches().height();
     int cells = documentWidth * documentHeight;
+    int colors = m_pattern->palette().flosses().count();
+    QRect snapArea(0, 0, documentWidth * 2 + 1, documentHeight * 2 + 1);
 
-    quint16 cellCount;
+    for (int i = 0; i < cells;) {
+        quint16 cellCount = cursor.readUInt16();
+        quint8 color = cursor.readUInt8();
+        quint8 type = cursor.readUInt8();
 
-    for (int i = 0; i < cells; i += cellCount) {
-        quint8 color;
-        quint8 type;
+        // an empty run or a run past the end of the pattern indicates a corrupt file
+        if ((cellCount == 0) || (cellCount > cells - i)) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data")));
+        }
 
-        stream >> cellCount;
-        stream >> color;
-        stream >> type;
+        // types without a KXStitch equivalent, such as petite stitches, are skipped
+        if ((type != 0xff) && (type < stitchTypes)) {
+            int colorIndex = pcStitchColorIndex(color, colors);
 
-        if (type != 0xff) {
             for (int c = 0; c < cellCount; c++) {
                 int xc = (i + c) / documentHeight;
                 int yc = (i + c) % documentHeight;
-                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], color - 1); // color-1 because PCStitch uses 1 based array
+                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], colorIndex);
             }
         }
+
+        i += cellCount;
     }
 
-    quint32 extras;
-    stream >> extras;
+    quint32 extras = cursor.readUInt32();
+    cursor.requireRecords(extras, 12);
 
     while (extras--) {
-        quint16 x;
-        quint16 y;
-        quint8 color;
-        quint8 type;
+        int x = cursor.readUInt16();
+        int y = cursor.readUInt16();
 
-        stream >> x;
-        stream >> y;
+        if ((x < 1) || (x > documentWidth) || (y < 1) || (y > documentHeight)) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data")));
+        }
 
         for (int dx = 0; dx < 4; dx++) {
-            stream >> color;
-            stream >> type;
+            quint8 color = cursor.readUInt8();
+            quint8 type = cursor.readUInt8();
 
-            if (type != 0xff) {
-                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], color - 1);
+            if ((type != 0xff) && (type < stitchTypes)) {
+                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], pcStitchColorIndex(color, colors));
             }
         }
     }
 
     // read french knots
 
-    quint32 knots;
-    stream >> knots;
+    quint32 knots = cursor.readUInt32();
+    cursor.requireRecords(knots, 6);
 
     while (knots--) {
-        quint16 x;
-        quint16 y;
-        quint16 color;
+        int x = cursor.readUInt16();
+        int y = cursor.readUInt16();
+        int color = cursor.readUInt16();
+        QPoint position(x - 1, y - 1);
 
-        stream >> x;
-        stream >> y;
-        stream >> color;
-        m_pattern->stitches().addFrenchKnot(QPoint(x - 1, y - 1), color - 1);
+        if (!snapArea.contains(position)) {
+            throw FailedReadFile(QString(i18n("Invalid knot position")));
+        }
+
+        m_pattern->stitches().addFrenchKnot(position, pcStitchColorIndex(color, colors));
     }
 
     // read backstitches
 
-    quint32 backstitches;
-    stream >> backstitches;
+    quint32 backstitches = cursor.readUInt32();
+    cursor.requireRecords(backstitches, 14);
 
     while (backstitches--) {
-        quint16 sx;
-        quint16 sy;
-        quint16 sp;
-        quint16 ex;
-        quint16 ey;
-        quint16 ep;
-        quint16 color;
-        stream >> sx >> sy >> sp >> ex >> ey >> ep >> color;
-        m_pattern->stitches().addBackstitch(QPoint(--sx * 2 + ((sp - 1) % 3), --sy * 2 + ((sp - 1) / 3)),
-                                            QPoint(--ex * 2 + ((ep - 1) % 3), --ey * 2 + ((ep - 1) / 3)),
-                                            color - 1);
-    }
-
-    if (stream.status() != QDataStream::Ok) {
-        throw FailedReadFile(QString(i18n("Stream error")));
+        int sx = cursor.readUInt16();
+        int sy = cursor.readUInt16();
+        int sp = cursor.readUInt16();
+        int ex = cursor.readUInt16();
+        int ey = cursor.readUInt16();
+        int ep = cursor.readUInt16();
+        int color = cursor.readUInt16();
+        m_pattern->stitches().addBackstitch(pcStitchSnapPoint(sx, sy, sp, snapArea),
+                                            pcStitchSnapPoint(ex, ey, ep, snapArea),
+                                            pcStitchColorIndex(color, colors));
     }
 }
 
-QString Document::readPCStitchString(QDataStream &stream)
+QString Document::readPCStitchString(ByteCursor &cursor)
 {
-    char *buffer;
-    quint16 stringSize;
-    stream >> stringSize;
-    buffer = new char[stringSize + 1];
-    stream.readRawData(buffer, stringSize);
-    buffer[stringSize] = '\0';
-    QString string = QString::fromLatin1(buffer);
-    delete[] buffer;
-
-    if (stream.status() != QDataStream::Ok) {
-        throw FailedReadFile(QString(i18n("Stream error")));
-    }
+    quint16 stringSize = cursor.readUInt16();
+    const char *data = cursor.readRaw(stringSize);
 
-    return string;
+    return QString::fromLatin1(data, qstrnlen(data, stringSize));
 }
 
 void Document::readKXStitchV2File(QDataStream &stream)
@@ -16,11 +16,13 @@
 #include <QUrl>
 
 #include "BackgroundImages.h"
+#include "DocumentSummary.h"
 #include "Exceptions.h"
 #include "Pattern.h"
 #include "PrinterConfiguration.h"
 #include "configuration.h"
 
+class ByteCursor;
 class Editor;
 class Palette;
 class Preview;
@@ -35,7 +37,10 @@ public:
 
     void readKXStitch(QDataStream &);
     void readPCStitch(QDataStream &);
-    void write(QDataStream &);
+    void write(QDataStream &, bool);
+
+    Document *snapshot();
+    DocumentSummary summary();
 
     void setUrl(const QUrl &);
     QUrl url() const;
@@ -59,10 +64,10 @@ public:
     void setPrinterConfiguration(const PrinterConfiguration &);
 
 private:
-    void readPCStitch5File(QDataStream &);
-    void readPCStitch6File(QDataStream &);
-    void readPCStitch7File(QDataStream &);
-    QString readPCStitchString(QDataStream &);
+    void readPCStitch5File(ByteCursor &);
+    void readPCStitch6File(ByteCursor &);
+    void readPCStitch7File(ByteCursor &);
+    QString readPCStitchString(ByteCursor &);
 
     void readKXStitchV2File(QDataStream &);
     void readKXStitchV3File(QDataStream &);
@@ -71,7 +76,16 @@ private:
     void readKXStitchV6File(QDataStream &);
     void readKXStitchV7File(QDataStream &);
 
-    static const int version = 104;
+    template <class T> void writeSection(QDataStream &, const T &, bool);
+    void writeSectionData(QDataStream &, const QByteArray &, bool);
+    template <class T> void readSection(QDataStream &, T &);
+
+    enum SectionCodec {
+        Uncompressed = 0,
+        Zlib = 1
+    };
+
+    static const int version = 105;
 
     QMap<QString, QVariant> m_properties;
 
@@ -86,6 +100,9 @@ private:
     BackgroundImages m_backgroundImages;
     Pattern *m_pattern;
     PrinterConfiguration m_printerConfiguration;
+
+    QByteArray m_patternData;          // the serialized pattern of a snapshot, written in place of m_pattern
+    DocumentSummary m_snapshotSummary; // the summary of the document a snapshot was taken from
 };
 
 #endif // Document_H
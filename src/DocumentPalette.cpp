@@ -10,6 +10,10 @@
 
 #include "DocumentPalette.h"
 
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
 #include <KLocalizedString>
 #include <KMessageBox>
 
@@ -21,6 +25,8 @@
 
 #include "configuration.h"
 
+#include <algorithm>
+
 class DocumentPaletteData : public QSharedData
 {
 public:
@@ -28,12 +34,22 @@ public:
     DocumentPaletteData(const DocumentPaletteData &);
     ~DocumentPaletteData();
 
+    void invalidateCache();
+    void updateCache() const;
+
     static const int version = 103; // added m_symbolLibrary
 
     QString m_schemeName;
     QString m_symbolLibrary;
     int m_currentIndex;
     QMap<int, DocumentFloss *> m_documentFlosses;
+
+    // the sorted order and color lookup are created when first needed after the flosses change,
+    // the mutex guards their creation as const functions may be called from any thread on shared data
+    mutable QMutex m_cacheMutex;
+    mutable bool m_cacheValid;
+    mutable QVector<int> m_sortedFlosses;
+    mutable QHash<QRgb, int> m_colorIndexes;
 };
 
 DocumentPaletteData::DocumentPaletteData()
@@ -41,6 +57,7 @@ DocumentPaletteData::DocumentPaletteData()
     , m_schemeName(Configuration::palette_DefaultScheme())
     , m_symbolLibrary(QLatin1String("kxstitch"))
     , m_currentIndex(-1)
+    , m_cacheValid(false)
 {
 }
 
@@ -49,6 +66,7 @@ DocumentPaletteData::DocumentPaletteData(const DocumentPaletteData &other)
     , m_schemeName(other.m_schemeName)
     , m_symbolLibrary(other.m_symbolLibrary)
     , m_currentIndex(other.m_currentIndex)
+    , m_cacheValid(false)
 {
     for (QMap<int, DocumentFloss *>::const_iterator i = other.m_documentFlosses.constBegin(); i != other.m_documentFlosses.constEnd(); ++i) {
         m_documentFlosses.insert(i.key(), new DocumentFloss(other.m_documentFlosses.value(i.key())));
@@ -60,13 +78,51 @@ DocumentPaletteData::~DocumentPaletteData()
     qDeleteAll(m_documentFlosses);
 }
 
+void DocumentPaletteData::invalidateCache()
+{
+    QMutexLocker locker(&m_cacheMutex);
+    m_cacheValid = false;
+}
+
+/**
+    Create the sorted order of the flosses and the lookup from a floss color to its index
+    if the flosses have changed since they were last created. Must be called with
+    m_cacheMutex locked.
+    */
+void DocumentPaletteData::updateCache() const
+{
+    if (m_cacheValid) {
+        return;
+    }
+
+    // sort by the length of the name and then the name, so numeric names are in their natural order
+    m_sortedFlosses = m_documentFlosses.keys().toVector();
+    std::stable_sort(m_sortedFlosses.begin(), m_sortedFlosses.end(), [this](int index1, int index2) {
+        QString flossName1(m_documentFlosses.value(index1)->flossName());
+        QString flossName2(m_documentFlosses.value(index2)->flossName());
+
+        return (flossName1.length() < flossName2.length()) || ((flossName1.length() == flossName2.length()) && (flossName1 < flossName2));
+    });
+
+    // where flosses share a color the highest index is used
+    m_colorIndexes.clear();
+
+    for (QMap<int, DocumentFloss *>::const_iterator i = m_documentFlosses.constBegin(); i != m_documentFlosses.constEnd(); ++i) {
+        m_colorIndexes.insert(i.value()->flossColor().rgb(), i.key());
+    }
+
+    m_cacheValid = true;
+}
+
 DocumentPalette::DocumentPalette()
     : d(new DocumentPaletteData)
+    , m_allFlossesChanged(true)
 {
 }
 
 DocumentPalette::DocumentPalette(const DocumentPalette &other)
     : d(other.d)
+    , m_allFlossesChanged(true)
 {
 }
 
@@ -91,30 +147,10 @@ QMap<int, DocumentFloss *> DocumentPalette::flosses() const
 
 QVector<int> DocumentPalette::sortedFlosses() const
 {
-    int colors = d->m_documentFlosses.count();
-    QVector<int> sorted = d->m_documentFlosses.keys().toVector();
-
-    bool exchanged;
-
-    do {
-        exchanged = false;
-
-        for (int i = 0; i < colors - 1; ++i) {
-            QString flossName1(d->m_documentFlosses.value(sorted[i])->flossName());
-            QString flossName2(d->m_documentFlosses.value(sorted[i + 1])->flossName());
-            int length1 = flossName1.length();
-            int length2 = flossName2.length();
-
-            if (((flossName1 > flossName2) && (length1 >= length2)) || (length1 > length2)) {
-                int tmp = sorted.value(i);
-                sorted[i] = sorted.value(i + 1);
-                sorted[i + 1] = tmp;
-                exchanged = true;
-            }
-        }
-    } while (exchanged);
+    QMutexLocker locker(&d->m_cacheMutex);
+    d->updateCache();
 
-    return sorted;
+    return d->m_sortedFlosses;
 }
 
 QList<qint16> DocumentPalette::usedSymbols() const
@@ -178,6 +214,8 @@ void DocumentPalette::setSchemeName(const QString &schemeName)
         delete documentFloss;
         replace(i.key(), replacement);
     }
+
+    markChanged();
 }
 
 void DocumentPalette::setSymbolLibrary(const QString &symbolLibrary)
@@ -191,6 +229,8 @@ void DocumentPalette::setSymbolLibrary(const QString &symbolLibrary)
         foreach (DocumentFloss *documentFloss, d->m_documentFlosses) {
             documentFloss->setStitchSymbol(indexes.takeFirst());
         }
+
+        markChanged();
     }
 }
 
@@ -202,6 +242,8 @@ void DocumentPalette::setCurrentIndex(int currentIndex)
 void DocumentPalette::add(int flossIndex, DocumentFloss *documentFloss)
 {
     d->m_documentFlosses.insert(flossIndex, documentFloss);
+    d->invalidateCache();
+    flossChanged(flossIndex);
 
     if (d->m_currentIndex == -1) {
         d->m_currentIndex = 0;
@@ -219,10 +261,10 @@ int DocumentPalette::add(const QColor &srcColor)
         floss = scheme->convert(srcColor);
     }
 
-    for (QMap<int, DocumentFloss *>::const_iterator i = d->m_documentFlosses.constBegin(); i != d->m_documentFlosses.constEnd(); ++i) {
-        if (i.value()->flossColor() == floss->color()) {
-            colorIndex = i.key();
-        }
+    {
+        QMutexLocker locker(&d->m_cacheMutex);
+        d->updateCache();
+        colorIndex = d->m_colorIndexes.value(floss->color().rgb(), -1);
     }
 
     if (colorIndex == -1) { // the color hasn't been found in the existing list
@@ -239,6 +281,8 @@ int DocumentPalette::add(const QColor &srcColor)
 DocumentFloss *DocumentPalette::remove(int flossIndex)
 {
     DocumentFloss *documentFloss = d->m_documentFlosses.take(flossIndex);
+    d->invalidateCache();
+    flossChanged(flossIndex);
 
     if (d->m_documentFlosses.count() == 0) {
         d->m_currentIndex = -1;
@@ -251,6 +295,8 @@ DocumentFloss *DocumentPalette::replace(int flossIndex, DocumentFloss *documentF
 {
     DocumentFloss *old = d->m_documentFlosses.take(flossIndex);
     d->m_documentFlosses.insert(flossIndex, documentFloss);
+    d->invalidateCache();
+    flossChanged(flossIndex);
     return old;
 }
 
@@ -259,11 +305,52 @@ void DocumentPalette::swap(int originalIndex, int swappedIndex)
     DocumentFloss *original = d->m_documentFlosses.take(originalIndex);
     d->m_documentFlosses.insert(originalIndex, d->m_documentFlosses.take(swappedIndex));
     d->m_documentFlosses.insert(swappedIndex, original);
+    d->invalidateCache();
+    flossChanged(originalIndex);
+    flossChanged(swappedIndex);
+}
+
+/**
+    Mark the whole palette as changed, so it is recorded in full rather than from changedFlosses().
+    */
+void DocumentPalette::markChanged()
+{
+    m_allFlossesChanged = true;
+    m_changedFlosses.clear();
+}
+
+bool DocumentPalette::allFlossesChanged() const
+{
+    return m_allFlossesChanged;
+}
+
+/**
+    Get the indexes of the flosses that have been added, removed or replaced since resetChanges().
+    The scheme name and symbol library are unchanged unless allFlossesChanged() is true.
+    @return a QSet of floss indexes
+    */
+QSet<int> DocumentPalette::changedFlosses() const
+{
+    return m_changedFlosses;
+}
+
+void DocumentPalette::resetChanges()
+{
+    m_allFlossesChanged = false;
+    m_changedFlosses.clear();
+}
+
+void DocumentPalette::flossChanged(int flossIndex)
+{
+    if (!m_allFlossesChanged) {
+        m_changedFlosses.insert(flossIndex);
+    }
 }
 
 DocumentPalette &DocumentPalette::operator=(const DocumentPalette &other)
 {
     d = other.d;
+    markChanged();
     return *this;
 }
 
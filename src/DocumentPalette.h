@@ -14,6 +14,7 @@
 #include <QDataStream>
 #include <QList>
 #include <QMap>
+#include <QSet>
 #include <QSharedDataPointer>
 #include <QStringList>
 
@@ -49,6 +50,11 @@ public:
     void swap(int, int);
     qint16 freeSymbol() const;
 
+    void markChanged();
+    bool allFlossesChanged() const;
+    QSet<int> changedFlosses() const;
+    void resetChanges();
+
     DocumentPalette &operator=(const DocumentPalette &);
     bool operator==(const DocumentPalette &) const;
     bool operator!=(const DocumentPalette &) const;
@@ -58,8 +64,12 @@ public:
 
 private:
     int freeIndex() const;
+    void flossChanged(int);
 
     QSharedDataPointer<DocumentPaletteData> d;
+
+    QSet<int> m_changedFlosses;
+    bool m_allFlossesChanged;
 };
 
 QDataStream &operator<<(QDataStream &, const DocumentPalette &);
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements the summary of a document written at the start of a
+ * KXStitch file.
+ */
+
+// Class include
+#include "DocumentSummary.h"
+
+// Qt includes
+#include <QFile>
+#include <QIODevice>
+
+// KF includes
+#include <KLocalizedString>
+
+// Application includes
+#include "Exceptions.h"
+
+/**
+ * The first version of the KXStitch file format that contains a summary.
+ */
+static const qint32 firstSummaryFileVersion = 105;
+
+DocumentSummary::DocumentSummary()
+    : m_width(0)
+    , m_height(0)
+    , m_colors(0)
+    , m_stitches(0)
+    , m_backstitches(0)
+    , m_knots(0)
+{
+}
+
+DocumentSummary::DocumentSummary(const QString &title, int width, int height, int colors, int stitches, int backstitches, int knots, const QImage &thumbnail)
+    : m_title(title)
+    , m_width(width)
+    , m_height(height)
+    , m_colors(colors)
+    , m_stitches(stitches)
+    , m_backstitches(backstitches)
+    , m_knots(knots)
+    , m_thumbnail(thumbnail)
+{
+}
+
+QString DocumentSummary::title() const
+{
+    return m_title;
+}
+
+int DocumentSummary::width() const
+{
+    return m_width;
+}
+
+int DocumentSummary::height() const
+{
+    return m_height;
+}
+
+int DocumentSummary::colors() const
+{
+    return m_colors;
+}
+
+int DocumentSummary::stitches() const
+{
+    return m_stitches;
+}
+
+int DocumentSummary::backstitches() const
+{
+    return m_backstitches;
+}
+
+int DocumentSummary::knots() const
+{
+    return m_knots;
+}
+
+QImage DocumentSummary::thumbnail() const
+{
+    return m_thumbnail;
+}
+
+bool DocumentSummary::read(QIODevice *device)
+{
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_4_0);
+
+    char header[11];
+
+    if ((stream.readRawData(header, 11) != 11) || (strncmp(header, "KXStitchDoc", 11) != 0)) {
+        return false;
+    }
+
+    qint32 fileVersion;
+    quint32 size;
+    stream >> fileVersion;
+
+    if ((stream.status() != QDataStream::Ok) || (fileVersion < firstSummaryFileVersion)) {
+        return false;
+    }
+
+    stream >> size;
+
+    // a size beyond the end of the file indicates a corrupt file, so it is checked before anything is allocated
+    if ((stream.status() != QDataStream::Ok) || (qint64(size) > device->size() - device->pos())) {
+        return false;
+    }
+
+    // only the summary is read, the rest of the file is not touched
+    QByteArray data = device->read(size);
+
+    if (data.size() != qint64(size)) {
+        return false;
+    }
+
+    QDataStream summaryStream(data);
+    summaryStream.setVersion(QDataStream::Qt_4_0);
+
+    try {
+        summaryStream >> *this;
+    } catch (const InvalidFileVersion &e) {
+        return false;
+    }
+
+    return (summaryStream.status() == QDataStream::Ok);
+}
+
+bool DocumentSummary::read(const QString &fileName)
+{
+    QFile file(fileName);
+
+    return file.open(QIODevice::ReadOnly) && read(&file);
+}
+
+QDataStream &operator<<(QDataStream &stream, const DocumentSummary &summary)
+{
+    stream << qint32(summary.version);
+    stream << summary.m_title;
+    stream << summary.m_width;
+    stream << summary.m_height;
+    stream << summary.m_colors;
+    stream << summary.m_stitches;
+    stream << summary.m_backstitches;
+    stream << summary.m_knots;
+    stream << summary.m_thumbnail;
+
+    return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, DocumentSummary &summary)
+{
+    qint32 version;
+
+    stream >> version;
+
+    switch (version) {
+    case 100:
+        stream >> summary.m_title;
+        stream >> summary.m_width;
+        stream >> summary.m_height;
+        stream >> summary.m_colors;
+        stream >> summary.m_stitches;
+        stream >> summary.m_backstitches;
+        stream >> summary.m_knots;
+        stream >> summary.m_thumbnail;
+        break;
+
+    default:
+        throw InvalidFileVersion(QString(i18n("Document summary version %1", version)));
+        break;
+    }
+
+    return stream;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines the summary of a document written at the start of a
+ * KXStitch file.
+ */
+
+#ifndef DocumentSummary_H
+#define DocumentSummary_H
+
+// Qt includes
+#include <QDataStream>
+#include <QImage>
+#include <QString>
+
+class QIODevice;
+
+/**
+ * This class holds a summary of a document, the pattern size, the number of
+ * colors and stitches and a small thumbnail of the pattern.
+ *
+ * The summary is written immediately after the file header by Document::write,
+ * preceded by its length, so it can be read by read() without parsing any of
+ * the document sections and without creating a Document. This allows file
+ * browsers and other tools to show the contents of a file cheaply.
+ *
+ * Files written before the summary was added do not have one and read() will
+ * return false for them.
+ */
+class DocumentSummary
+{
+public:
+    /**
+     * Constructor, creates an empty summary.
+     */
+    DocumentSummary();
+
+    /**
+     * Constructor.
+     *
+     * @param title is the title of the document
+     * @param width is the width of the pattern in cells
+     * @param height is the height of the pattern in cells
+     * @param colors is the number of colors in the palette
+     * @param stitches is the number of stitches
+     * @param backstitches is the number of backstitches
+     * @param knots is the number of french knots
+     * @param thumbnail is a small image of the pattern
+     */
+    DocumentSummary(const QString &title, int width, int height, int colors, int stitches, int backstitches, int knots, const QImage &thumbnail);
+
+    QString title() const; /**< Get the title of the document */
+    int width() const; /**< Get the width of the pattern in cells */
+    int height() const; /**< Get the height of the pattern in cells */
+    int colors() const; /**< Get the number of colors in the palette */
+    int stitches() const; /**< Get the number of stitches */
+    int backstitches() const; /**< Get the number of backstitches */
+    int knots() const; /**< Get the number of french knots */
+    QImage thumbnail() const; /**< Get the thumbnail of the pattern */
+
+    /**
+     * Read the summary from the start of a KXStitch file. The device is read from
+     * its current position, which should be the start of the file.
+     *
+     * @param device is the QIODevice to read from
+     *
+     * @return true if the summary was read, false if the file is not a KXStitch file or has no summary
+     */
+    bool read(QIODevice *device);
+
+    /**
+     * Read the summary from a KXStitch file.
+     *
+     * @param fileName is the path of the file
+     *
+     * @return true if the summary was read, false if the file could not be read or has no summary
+     */
+    bool read(const QString &fileName);
+
+    static const int version = 100; /**< The version of the stream format */
+    static const int thumbnailSize = 128; /**< The maximum width and height of the thumbnail */
+
+    /**
+     * Write the summary to a stream.
+     *
+     * @param stream is a reference to the QDataStream to write to
+     * @param summary is a const reference to the DocumentSummary to write
+     *
+     * @return a reference to the QDataStream
+     */
+    friend QDataStream &operator<<(QDataStream &stream, const DocumentSummary &summary);
+
+    /**
+     * Read the summary from a stream, throws InvalidFileVersion for an unknown version.
+     *
+     * @param stream is a reference to the QDataStream to read from
+     * @param summary is a reference to the DocumentSummary to read in to
+     *
+     * @return a reference to the QDataStream
+     */
+    friend QDataStream &operator>>(QDataStream &stream, DocumentSummary &summary);
+
+private:
+    QString m_title; /**< The title of the document */
+    qint32 m_width; /**< The width of the pattern in cells */
+    qint32 m_height; /**< The height of the pattern in cells */
+    qint32 m_colors; /**< The number of colors in the palette */
+    qint32 m_stitches; /**< The number of stitches */
+    qint32 m_backstitches; /**< The number of backstitches */
+    qint32 m_knots; /**< The number of french knots */
+    QImage m_thumbnail; /**< A thumbnail of the pattern, no larger than thumbnailSize */
+};
+
+QDataStream &operator<<(QDataStream &, const DocumentSummary &);
+QDataStream &operator>>(QDataStream &, DocumentSummary &);
+
+#endif // DocumentSummary_H
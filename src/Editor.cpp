@@ -427,22 +427,20 @@ void Editor::fitToHeight()
     zoom(heightScaleFactor);
 }
 
-QList<Stitch::Type> Editor::maskStitches() const
+StitchMask Editor::maskStitches() const
 {
-    QList<Stitch::Type> maskStitches;
+    if (!m_maskStitch) {
+        return StitchMask::all();
+    }
 
-    if (m_maskStitch) {
-        if (m_currentStitchType == StitchFull) {
-            maskStitches << Stitch::Full;
-        } else {
-            for (int i = 0; i < 4; ++i) {
-                maskStitches << stitchMap[m_currentStitchType][i];
-            }
-        }
+    StitchMask maskStitches;
+
+    if (m_currentStitchType == StitchFull) {
+        maskStitches << Stitch::Full;
     } else {
-        maskStitches << Stitch::TLQtr << Stitch::TRQtr << Stitch::BLQtr << Stitch::BTHalf << Stitch::TL3Qtr << Stitch::BRQtr << Stitch::TBHalf << Stitch::TR3Qtr
-                     << Stitch::BL3Qtr << Stitch::BR3Qtr << Stitch::Full << Stitch::TLSmallHalf << Stitch::TRSmallHalf << Stitch::BLSmallHalf
-                     << Stitch::BRSmallHalf << Stitch::TLSmallFull << Stitch::TRSmallFull << Stitch::BLSmallFull << Stitch::BRSmallFull;
+        for (int i = 0; i < 4; ++i) {
+            maskStitches << stitchMap[m_currentStitchType][i];
+        }
     }
 
     return maskStitches;
@@ -256,7 +256,7 @@ private:
 
     void processBitmap(QUndoCommand *, const QBitmap &);
     QRect visibleCells();
-    QList<Stitch::Type> maskStitches() const;
+    StitchMask maskStitches() const;
 
     Document *m_document;
     Preview *m_preview;
@@ -10,6 +10,243 @@
 
 #include "FlossScheme.h"
 
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+    The number of levels of each color component in the lookup table, each level covers
+    4 of the 256 component values.
+    */
+static const int colorTableLevels = 64;
+static const int colorTableShift = 2;
+static const int colorTableCells = colorTableLevels * colorTableLevels * colorTableLevels;
+static const qint32 colorTableVersion = 100;
+
+/**
+    A lookup table from a color to the flosses that may be the nearest to it.
+
+    The RGB color cube is divided into cells and each cell holds the indexes of the
+    flosses that could be the nearest to any color in the cell. A floss further from
+    the centre of a cell than the nearest floss to the centre plus the diameter of the
+    cell can not be the nearest to a color in the cell, so only the remaining candidates
+    need to be searched, which is usually one or two flosses rather than the whole scheme.
+    */
+class FlossColorTable
+{
+public:
+    QByteArray colors; // the RGB values of the flosses the table was created from
+    QVector<quint32> offsets; // the start of the candidates of each cell, followed by the end of the last cell
+    QVector<quint16> candidates; // the indexes of the candidate flosses of each cell
+};
+
+/**
+    Squared distance between two colors in RGB space, as used by ImageMagick to map colors.
+    */
+static int colorDistance(int red, int green, int blue, const uchar *color)
+{
+    int dr = red - color[0];
+    int dg = green - color[1];
+    int db = blue - color[2];
+
+    return dr * dr + dg * dg + db * db;
+}
+
+/**
+    Create the candidates for the cells with one red level.
+    @param colors the RGB values of the flosses
+    @param red the red level
+    @return a list of the number of candidates of each cell followed by the candidates
+    */
+static QVector<quint16> createColorTablePlane(const QByteArray &colors, int red)
+{
+    const uchar *rgb = reinterpret_cast<const uchar *>(colors.constData());
+    int count = colors.size() / 3;
+
+    // the furthest a color in a cell can be from its centre is half the diagonal of the cell
+    const double halfCell = ((1 << colorTableShift) - 1) / 2.0;
+    const double cellRadius = std::sqrt(3.0) * halfCell;
+
+    QVector<quint16> plane(colorTableLevels * colorTableLevels);
+    QVector<double> distances(count);
+
+    for (int green = 0; green < colorTableLevels; ++green) {
+        for (int blue = 0; blue < colorTableLevels; ++blue) {
+            double centreRed = (red << colorTableShift) + halfCell;
+            double centreGreen = (green << colorTableShift) + halfCell;
+            double centreBlue = (blue << colorTableShift) + halfCell;
+            double nearest = std::numeric_limits<double>::max();
+
+            for (int i = 0; i < count; ++i) {
+                double dr = centreRed - rgb[i * 3];
+                double dg = centreGreen - rgb[i * 3 + 1];
+                double db = centreBlue - rgb[i * 3 + 2];
+                distances[i] = std::sqrt(dr * dr + dg * dg + db * db);
+                nearest = std::min(nearest, distances[i]);
+            }
+
+            double limit = nearest + 2 * cellRadius + 0.001;
+            quint16 candidates = 0;
+
+            for (int i = 0; i < count; ++i) {
+                if (distances.at(i) <= limit) {
+                    plane.append(quint16(i));
+                    ++candidates;
+                }
+            }
+
+            plane[green * colorTableLevels + blue] = candidates;
+        }
+    }
+
+    return plane;
+}
+
+/**
+    Create a lookup table for a list of floss colors, dividing the work between threads by red level.
+    @param colors the RGB values of the flosses
+    @return a pointer to the new table
+    */
+static QSharedPointer<FlossColorTable> createColorTable(const QByteArray &colors)
+{
+    QList<int> levels;
+
+    for (int red = 0; red < colorTableLevels; ++red) {
+        levels.append(red);
+    }
+
+    QList<QVector<quint16>> planes = QtConcurrent::blockingMapped(levels, [&colors](int red) {
+        return createColorTablePlane(colors, red);
+    });
+
+    QSharedPointer<FlossColorTable> table(new FlossColorTable);
+    table->colors = colors;
+    table->offsets.reserve(colorTableCells + 1);
+
+    const int planeCells = colorTableLevels * colorTableLevels;
+
+    for (const QVector<quint16> &plane : std::as_const(planes)) {
+        quint32 offset = table->candidates.count();
+
+        // the counts at the start of the plane become offsets into the candidates
+        for (int cell = 0; cell < planeCells; ++cell) {
+            table->offsets.append(offset);
+            offset += plane.at(cell);
+        }
+
+        table->candidates.append(plane.mid(planeCells));
+    }
+
+    table->offsets.append(table->candidates.count());
+
+    return table;
+}
+
+/**
+    Read a lookup table previously written to a file.
+    @param fileName the name of the file
+    @param colors the RGB values of the current flosses, the table is only used if it was created from the same colors
+    @return a pointer to the table, or a null pointer if the file could not be read or is out of date
+    */
+static QSharedPointer<FlossColorTable> readColorTable(const QString &fileName, const QByteArray &colors)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QSharedPointer<FlossColorTable>();
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_0);
+
+    char header[11];
+    qint32 version;
+
+    if ((stream.readRawData(header, 11) != 11) || (strncmp(header, "KXStitchLUT", 11) != 0)) {
+        return QSharedPointer<FlossColorTable>();
+    }
+
+    stream >> version;
+
+    if (version != colorTableVersion) {
+        return QSharedPointer<FlossColorTable>();
+    }
+
+    QSharedPointer<FlossColorTable> table(new FlossColorTable);
+    stream >> table->colors;
+
+    if ((stream.status() != QDataStream::Ok) || (table->colors != colors)) {
+        return QSharedPointer<FlossColorTable>();
+    }
+
+    stream >> table->offsets;
+    stream >> table->candidates;
+
+    if ((stream.status() != QDataStream::Ok) || (table->offsets.count() != colorTableCells + 1) || (table->offsets.last() != quint32(table->candidates.count()))) {
+        return QSharedPointer<FlossColorTable>();
+    }
+
+    // the candidates of each cell run from its offset to the next one, so the offsets must start
+    // at zero and never decrease for every range to lie within the candidates
+    if (table->offsets.first() != 0) {
+        return QSharedPointer<FlossColorTable>();
+    }
+
+    for (int i = 1; i < table->offsets.count(); ++i) {
+        if (table->offsets.at(i) < table->offsets.at(i - 1)) {
+            return QSharedPointer<FlossColorTable>();
+        }
+    }
+
+    int count = colors.size() / 3;
+
+    for (quint16 candidate : std::as_const(table->candidates)) {
+        if (candidate >= count) {
+            return QSharedPointer<FlossColorTable>();
+        }
+    }
+
+    return table;
+}
+
+/**
+    Write a lookup table to a file so it does not need to be created again.
+    A failure to write is ignored as the table can be created when needed.
+    @param fileName the name of the file
+    @param table the table to write
+    */
+static void writeColorTable(const QString &fileName, const FlossColorTable &table)
+{
+    if (fileName.isEmpty() || !QDir().mkpath(QFileInfo(fileName).path())) {
+        return;
+    }
+
+    QSaveFile file(fileName);
+
+    if (file.open(QIODevice::WriteOnly)) {
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_4_0);
+
+        stream.writeRawData("KXStitchLUT", 11);
+        stream << colorTableVersion;
+        stream << table.colors;
+        stream << table.offsets;
+        stream << table.candidates;
+
+        if (stream.status() == QDataStream::Ok) {
+            file.commit();
+        }
+    }
+}
+
 FlossScheme::FlossScheme()
     : m_map(nullptr)
 {
@@ -20,24 +257,36 @@ FlossScheme::~FlossScheme()
     delete m_map;
 }
 
+/**
+    Find the floss nearest to a color using the color lookup table, which is created or read
+    from the disk when first needed. This may be called from any thread.
+    @param color the color to convert
+    @return a pointer to the nearest Floss, or nullptr if the scheme has no flosses
+    */
 Floss *FlossScheme::convert(const QColor &color)
 {
-    createImageMap();
+    QSharedPointer<const FlossColorTable> table = colorTable();
 
-    char c[3];
-    c[0] = (char)color.red();
-    c[1] = (char)color.green();
-    c[2] = (char)color.blue();
-#if MagickLibVersion >= 0x642
-    Magick::Image image = Magick::Image(1, 1, "RGB", MagickCore::CharPixel, c);
-#else
-    Magick::Image image = Magick::Image(1, 1, "RGB", MagickLib::CharPixel, c);
-#endif
-    image.map(*m_map);
+    int red = color.red();
+    int green = color.green();
+    int blue = color.blue();
+    int cell = ((red >> colorTableShift) * colorTableLevels + (green >> colorTableShift)) * colorTableLevels + (blue >> colorTableShift);
+    const uchar *colors = reinterpret_cast<const uchar *>(table->colors.constData());
+
+    Floss *matched = nullptr;
+    int closest = std::numeric_limits<int>::max();
+
+    for (quint32 i = table->offsets.at(cell); i < table->offsets.at(cell + 1); ++i) {
+        int index = table->candidates.at(i);
+        int distance = colorDistance(red, green, blue, colors + index * 3);
 
-    const Magick::ColorRGB rgb = image.pixelColor(0, 0);
+        if (distance < closest) {
+            matched = m_flosses.at(index);
+            closest = distance;
+        }
+    }
 
-    return find(QColor((int)(255 * rgb.red()), (int)(255 * rgb.green()), (int)(255 * rgb.blue())));
+    return matched;
 }
 
 Floss *FlossScheme::find(const QString &name) const
@@ -57,6 +306,11 @@ Floss *FlossScheme::find(const QString &name) const
 
 Floss *FlossScheme::find(const QColor &color) const
 {
+    // colors mapped to the scheme will usually be an exact floss color
+    if (Floss *floss = m_colorFlosses.value(color.rgb())) {
+        return floss;
+    }
+
     QListIterator<Floss *> flossIterator(m_flosses);
 
     Floss *matched = nullptr;
@@ -96,17 +350,35 @@ const QList<Floss *> &FlossScheme::flosses() const
 void FlossScheme::addFloss(Floss *floss)
 {
     m_flosses.append(floss);
-    delete m_map;
-    m_map = nullptr;
+
+    // the first floss of a color is kept, matching the linear search in find
+    if (!m_colorFlosses.contains(floss->color().rgb())) {
+        m_colorFlosses.insert(floss->color().rgb(), floss);
+    }
+
+    resetColorMaps();
 }
 
 void FlossScheme::clearScheme()
 {
     qDeleteAll(m_flosses);
     m_flosses.clear();
+    m_colorFlosses.clear();
 
-    delete m_map;
-    m_map = nullptr;
+    resetColorMaps();
+}
+
+void FlossScheme::colorsChanged()
+{
+    m_colorFlosses.clear();
+
+    for (Floss *floss : std::as_const(m_flosses)) {
+        if (!m_colorFlosses.contains(floss->color().rgb())) {
+            m_colorFlosses.insert(floss->color().rgb(), floss);
+        }
+    }
+
+    resetColorMaps();
 }
 
 void FlossScheme::setSchemeName(const QString &name)
@@ -119,8 +391,16 @@ void FlossScheme::setPath(const QString &name)
     m_path = name;
 }
 
+/**
+    Create an image of the floss colors used by ImageMagick to map the colors of an image
+    to the scheme. The image is created when first needed and is deleted when the flosses
+    change, so callers should take a copy of it before the flosses can change.
+    @return a pointer to the image
+    */
 Magick::Image *FlossScheme::createImageMap()
 {
+    QMutexLocker locker(&m_mapMutex);
+
     if (m_map == nullptr) {
         char *pixels = new char[(m_flosses.size() + 1) * 4];
         char *pixel = pixels;
@@ -149,3 +429,71 @@ Magick::Image *FlossScheme::createImageMap()
 
     return m_map;
 }
+
+QSharedPointer<const FlossColorTable> FlossScheme::colorTable()
+{
+    QMutexLocker locker(&m_colorTableMutex);
+
+    if (m_colorTable.isNull()) {
+        QByteArray colors;
+        colors.reserve(m_flosses.count() * 3);
+
+        for (const Floss *floss : std::as_const(m_flosses)) {
+            colors.append(char(floss->color().red()));
+            colors.append(char(floss->color().green()));
+            colors.append(char(floss->color().blue()));
+        }
+
+        QString fileName = colorTablePath();
+        QSharedPointer<FlossColorTable> table = readColorTable(fileName, colors);
+
+        if (table.isNull()) {
+            table = createColorTable(colors);
+            writeColorTable(fileName, *table);
+        }
+
+        m_colorTable = table;
+    }
+
+    return m_colorTable;
+}
+
+/**
+    The lookup table is stored next to the scheme file when that directory is writable,
+    otherwise in the schemes directory of the writable application data location that is
+    used for calibrated schemes.
+    @return the path of the lookup table file, or an empty string if there is nowhere to store it
+    */
+QString FlossScheme::colorTablePath() const
+{
+    QFileInfo fileInfo(m_path);
+    QString fileName = (fileInfo.completeBaseName().isEmpty() ? m_schemeName : fileInfo.completeBaseName()) + QLatin1String(".lut");
+
+    if (!m_path.isEmpty() && QFileInfo(fileInfo.path()).isWritable()) {
+        return fileInfo.path() + QLatin1Char('/') + fileName;
+    }
+
+    QString writableDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+
+    if (writableDir.isEmpty()) {
+        return QString();
+    }
+
+    return writableDir + QLatin1String("/schemes/") + fileName;
+}
+
+/**
+    Discard the image map and the lookup table after the flosses have changed, they are
+    created again when next needed.
+    */
+void FlossScheme::resetColorMaps()
+{
+    {
+        QMutexLocker locker(&m_mapMutex);
+        delete m_map;
+        m_map = nullptr;
+    }
+
+    QMutexLocker locker(&m_colorTableMutex);
+    m_colorTable.clear();
+}
@@ -12,8 +12,11 @@
 #define FlossScheme_H
 
 #include <QColor>
+#include <QHash>
 #include <QList>
 #include <QListIterator>
+#include <QMutex>
+#include <QSharedPointer>
 #include <QString>
 
 // wrap include to silence unused-parameter warning from Magick++ include file
@@ -25,6 +28,8 @@
 
 #include "Floss.h"
 
+class FlossColorTable;
+
 class FlossScheme
 {
 public:
@@ -40,15 +45,24 @@ public:
 
     void addFloss(Floss *floss);
     void clearScheme();
+    void colorsChanged();
     Magick::Image *createImageMap();
     void setSchemeName(const QString &name);
     void setPath(const QString &name);
 
 private:
+    QSharedPointer<const FlossColorTable> colorTable();
+    QString colorTablePath() const;
+    void resetColorMaps();
+
     QString m_schemeName;
     QString m_path;
     QList<Floss *> m_flosses;
+    QHash<QRgb, Floss *> m_colorFlosses; // exact floss colors, maintained as flosses are added so find can be called from any thread
+    QMutex m_mapMutex; // guards the creation of m_map so createImageMap can be called from any thread
     Magick::Image *m_map;
+    QMutex m_colorTableMutex; // guards the creation of m_colorTable so convert can be called from any thread
+    QSharedPointer<const FlossColorTable> m_colorTable; // the lookup table used by convert, created when first needed
 };
 
 #endif // FlossScheme_H
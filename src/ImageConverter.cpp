@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements the conversion of images to KXStitch patterns from
+ * the command line without creating a MainWindow.
+ */
+
+// Class include
+#include "ImageConverter.h"
+
+// Qt includes
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+// KF includes
+#include <KLocalizedString>
+
+// Application includes
+#include "Document.h"
+#include "FlossScheme.h"
+#include "ImportImageReader.h"
+#include "ImportPipeline.h"
+#include "SchemeManager.h"
+#include "SymbolLibrary.h"
+#include "SymbolManager.h"
+#include "configuration.h"
+
+// C++ includes
+#include <algorithm>
+
+/**
+ * The result of converting a single image.
+ */
+struct ImageConversionResult {
+    QString source; /**< The path of the image */
+    QString destination; /**< The path of the pattern file */
+    QString error; /**< A description of the failure, empty if successful */
+    QSize size; /**< The size of the pattern in stitches */
+    int colors = 0; /**< The number of colors in the pattern */
+    qint64 read = 0; /**< The time taken to read the image in milliseconds */
+    ImportTimings stages; /**< The time taken by each stage of the ImportPipeline */
+    qint64 stitches = 0; /**< The time taken to create the stitches in milliseconds */
+    qint64 write = 0; /**< The time taken to write the pattern in milliseconds */
+    qint64 elapsed = 0; /**< The total time taken in milliseconds */
+};
+
+/**
+ * Convert a single image, called on a thread from the pool.
+ *
+ * @param source is the path of the image
+ * @param destination is the path of the KXStitch file to write
+ * @param options is the ImageConversionOptions, with the scheme and cloth count resolved
+ * @param common is the ImportParameters shared by all the images, the crop and image size are set for each image
+ * @param maximumImageSize is the largest width or height the image is reduced to when read, 0 to read it at full size
+ * @param compress is true if the sections of the pattern file are compressed
+ *
+ * @return the ImageConversionResult
+ */
+static ImageConversionResult
+convertImage(const QString &source,
+             const QString &destination,
+             const ImageConversionOptions &options,
+             const ImportParameters &common,
+             int maximumImageSize,
+             bool compress)
+{
+    ImageConversionResult result;
+    result.source = source;
+    result.destination = destination;
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    QElapsedTimer timer;
+    timer.start();
+
+    try {
+        Magick::Image image = ImportImageReader::read(source, maximumImageSize);
+        result.read = timer.restart();
+
+        QRect imageRect(0, 0, image.columns(), image.rows());
+        ImportParameters parameters = common;
+        parameters.crop = options.crop.isValid() ? options.crop.intersected(imageRect) : imageRect;
+
+        if (parameters.crop.isEmpty()) {
+            result.error = i18n("The crop area is outside the image.");
+            result.elapsed = elapsed.elapsed();
+            return result;
+        }
+
+        parameters.imageSize = parameters.crop.size() * options.scale / 100;
+
+        if (options.useFractionals) {
+            parameters.imageSize *= 2;
+        }
+
+        parameters.imageSize = parameters.imageSize.expandedTo(QSize(1, 1));
+
+        ImportPipeline pipeline(image);
+        Magick::Image convertedImage = pipeline.convert(parameters, &result.stages);
+        timer.restart();
+
+        Document document;
+        StitchData stitches;
+        DocumentPalette palette = document.pattern()->palette();
+        palette.setSchemeName(options.schemeName);
+
+        ImportPipeline::createStitches(convertedImage, options.useFractionals, parameters.ignoreColor, parameters.ignoreColorValue, stitches, palette);
+
+        result.size = QSize(stitches.width(), stitches.height());
+        result.colors = palette.flosses().count();
+
+        document.pattern()->stitches().swap(stitches);
+        document.pattern()->palette() = palette;
+        document.setProperty(QStringLiteral("horizontalClothCount"), options.clothCount);
+        document.setProperty(QStringLiteral("verticalClothCount"), options.clothCount);
+        document.setUrl(QUrl::fromLocalFile(destination));
+        result.stitches = timer.restart();
+
+        QSaveFile output(destination);
+
+        if (output.open(QIODevice::WriteOnly)) {
+            QDataStream outputStream(&output);
+            document.write(outputStream, compress);
+
+            if (!output.commit()) {
+                result.error = output.errorString();
+            }
+        } else {
+            result.error = output.errorString();
+        }
+
+        result.write = timer.restart();
+    } catch (const Magick::Exception &e) {
+        result.error = QString::fromStdString(e.what());
+    } catch (const FailedWriteFile &e) {
+        result.error = i18n("Failed to save the file.\n%1", e.statusMessage());
+    }
+
+    result.elapsed = elapsed.elapsed();
+
+    return result;
+}
+
+int ImageConverter::run(const QStringList &sources, const QString &outputDirectory, const ImageConversionOptions &options, int jobs)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (!outputDirectory.isEmpty() && !QDir().mkpath(outputDirectory)) {
+        err << i18n("Unable to create the output directory %1", outputDirectory) << Qt::endl;
+        return 1;
+    }
+
+    // the shared managers and the color map of the scheme are created lazily, so create them
+    // here before any threads use them
+    SchemeManager::schemes();
+    SymbolManager::libraries();
+
+    QString schemeName = options.schemeName.isEmpty() ? Configuration::palette_DefaultScheme() : options.schemeName;
+    FlossScheme *scheme = SchemeManager::scheme(schemeName);
+
+    if (scheme == nullptr) {
+        err << i18n("The floss scheme %1 was not found", schemeName) << Qt::endl;
+        return 1;
+    }
+
+    int symbolCount = SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count();
+    int maximumColors = (options.maximumColors > 0) ? options.maximumColors
+                                                    : (Configuration::import_UseMaximumColors() ? Configuration::import_MaximumColors() : symbolCount);
+
+    ImportParameters common;
+    common.quantizer = Configuration::import_Quantizer();
+    common.dithering = Configuration::import_Dithering();
+    common.maximumColors = std::min(maximumColors, symbolCount);
+    common.colorMap = *(scheme->createImageMap());
+    common.ignoreColor = options.ignoreColor.isValid();
+
+    if (common.ignoreColor) {
+        common.ignoreColorValue = Magick::ColorRGB(options.ignoreColor.redF(), options.ignoreColor.greenF(), options.ignoreColor.blueF());
+    }
+
+    for (const Floss *floss : scheme->flosses()) {
+        common.flossColors.append(floss->color().rgb());
+    }
+
+    ImageConversionOptions resolved = options;
+    resolved.schemeName = schemeName;
+    resolved.clothCount = (options.clothCount > 0.0) ? options.clothCount : Configuration::editor_HorizontalClothCount();
+
+    QThreadPool pool;
+
+    if (jobs > 0) {
+        pool.setMaxThreadCount(jobs);
+    }
+
+    QList<QPair<QString, QString>> files;
+    QHash<QString, QString> destinations; // the path of each pattern to the image it is converted from
+
+    for (const QString &source : sources) {
+        QFileInfo sourceInfo(source);
+        QString directory = outputDirectory.isEmpty() ? sourceInfo.absolutePath() : outputDirectory;
+        QString destination = QDir(directory).absoluteFilePath(sourceInfo.completeBaseName() + QLatin1String(".kxs"));
+
+        // images with the same base name, such as a.png and a.jpg, would overwrite each other's pattern
+        // so only the first is converted
+        if (destinations.contains(destination)) {
+            err << i18n("%1: The pattern %2 is already being converted from %3", source, destination, destinations.value(destination)) << Qt::endl;
+            continue;
+        }
+
+        destinations.insert(destination, source);
+        files.append(qMakePair(source, destination));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // nothing changes the configuration while converting, so the Document and createStitches on
+    // each thread can read it, large images are reduced as the ImportImageDlg would reduce them
+    bool compress = Configuration::document_CompressFiles();
+    int maximumImageSize = Configuration::import_ReduceLargeImages() ? Configuration::import_MaximumImageSize() : 0;
+
+    QFuture<ImageConversionResult> future =
+        QtConcurrent::mapped(&pool, files, [&resolved, &common, maximumImageSize, compress](const QPair<QString, QString> &file) {
+            return convertImage(file.first, file.second, resolved, common, maximumImageSize, compress);
+        });
+
+    int converted = 0;
+    ImageConversionResult totals;
+
+    // results are reported in order as they become available
+    for (int i = 0; i < files.count(); ++i) {
+        ImageConversionResult result = future.resultAt(i);
+
+        QString stages = i18n("read %1 ms, crop %2 ms, sample %3 ms, reduce %4 ms, map %5 ms, stitches %6 ms, write %7 ms",
+                              result.read,
+                              result.stages.crop,
+                              result.stages.sample,
+                              result.stages.reduce,
+                              result.stages.map,
+                              result.stitches,
+                              result.write);
+
+        if (result.error.isEmpty()) {
+            out << i18n("%1 -> %2, %3 x %4 stitches, %5 colors (%6 ms: %7)",
+                        result.source,
+                        result.destination,
+                        result.size.width(),
+                        result.size.height(),
+                        result.colors,
+                        result.elapsed,
+                        stages)
+                << Qt::endl;
+            ++converted;
+        } else {
+            err << i18n("%1: %2 (%3 ms: %4)", result.source, result.error.simplified(), result.elapsed, stages) << Qt::endl;
+        }
+
+        totals.read += result.read;
+        totals.stages.crop += result.stages.crop;
+        totals.stages.sample += result.stages.sample;
+        totals.stages.reduce += result.stages.reduce;
+        totals.stages.map += result.stages.map;
+        totals.stitches += result.stitches;
+        totals.write += result.write;
+    }
+
+    out << i18n("Converted %1 of %2 images in %3 ms using %4 threads", converted, sources.count(), timer.elapsed(), pool.maxThreadCount()) << Qt::endl;
+    out << i18n("Total time of each stage: read %1 ms, crop %2 ms, sample %3 ms, reduce %4 ms, map %5 ms, stitches %6 ms, write %7 ms",
+                totals.read,
+                totals.stages.crop,
+                totals.stages.sample,
+                totals.stages.reduce,
+                totals.stages.map,
+                totals.stitches,
+                totals.write)
+        << Qt::endl;
+
+    return (converted == sources.count()) ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines the conversion of images to KXStitch patterns from the
+ * command line without creating a MainWindow.
+ */
+
+#ifndef ImageConverter_H
+#define ImageConverter_H
+
+// Qt includes
+#include <QColor>
+#include <QRect>
+#include <QString>
+#include <QStringList>
+
+/**
+ * The options of an image conversion, matching the settings of the ImportImageDlg.
+ */
+struct ImageConversionOptions {
+    QRect crop; /**< The area of each image to use, after any reduction of large images, an invalid rectangle for the whole image */
+    int scale = 100; /**< The size of the pattern as a percentage of the image size */
+    double clothCount = 0.0; /**< The cloth count of the patterns, 0 to use the configured cloth count */
+    int maximumColors = 0; /**< The maximum number of colors, 0 to use the configured maximum */
+    QString schemeName; /**< The floss scheme, empty to use the configured scheme */
+    QColor ignoreColor; /**< The color treated as transparent, an invalid color for none */
+    bool useFractionals = false; /**< true to use fractional stitches */
+};
+
+/**
+ * This class converts a list of images to KXStitch pattern files using the
+ * same ImportPipeline as the ImportImageDlg.
+ *
+ * Each image is read by the ImportImageReader, reducing large images as the
+ * ImportImageDlg does, and converted and written by a separate Document on a
+ * thread from a thread pool, so images are converted in parallel. Images that
+ * would write the same pattern file as an earlier image are not converted. The
+ * result of each image is reported on the standard output, or the standard
+ * error for failures, in the order the images were given, along with the time
+ * taken by each stage, and the total time of each stage is reported at the end.
+ */
+class ImageConverter
+{
+public:
+    /**
+     * Convert the images.
+     *
+     * @param sources is a list of paths of the images to convert
+     * @param outputDirectory is the directory for the patterns, if empty each pattern is written alongside its image
+     * @param options is the ImageConversionOptions applied to every image
+     * @param jobs is the maximum number of images converted at the same time, 0 to use the number of processors
+     *
+     * @return 0 if all the images were converted, 1 otherwise
+     */
+    static int run(const QStringList &sources, const QString &outputDirectory, const ImageConversionOptions &options, int jobs);
+};
+
+#endif // ImageConverter_H
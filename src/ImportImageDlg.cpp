@@ -11,8 +11,10 @@
 #include "ImportImageDlg.h"
 
 #include <QApplication>
+#include <QImage>
+#include <QLocale>
 #include <QPainter>
-#include <QProgressDialog>
+#include <QtConcurrent>
 
 #include <KHelpClient>
 #include <KLocalizedString>
@@ -33,11 +35,18 @@ const uchar alphaData[] = {0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00,
 
 ImportImageDlg::ImportImageDlg(QWidget *parent, const Magick::Image &originalImage)
     : QDialog(parent)
+    , m_timer(0)
     , m_alphaSelect(nullptr)
     , m_originalImage(originalImage)
+    , m_pipeline(originalImage)
 {
     ui.setupUi(this);
 
+    // conversions run one at a time, a stale conversion is canceled and abandoned at the end of its current stage
+    m_pool.setMaxThreadCount(1);
+    connect(&m_watcher, &QFutureWatcher<ImportResult>::resultReadyAt, this, &ImportImageDlg::resultReady);
+    connect(&m_watcher, &QFutureWatcher<ImportResult>::finished, this, &ImportImageDlg::conversionFinished);
+
     m_crop = QRect(0, 0, m_originalImage.columns(), m_originalImage.rows());
     m_originalSize = QSize(m_crop.width(), m_crop.height());
     updateWindowTitle();
@@ -47,6 +56,8 @@ ImportImageDlg::ImportImageDlg(QWidget *parent, const Magick::Image &originalIma
     ui.UseMaximumColors->blockSignals(true);
     ui.MaximumColors->blockSignals(true);
     ui.IgnoreColor->blockSignals(true);
+    ui.Quantizer->blockSignals(true);
+    ui.Dithering->blockSignals(true);
     ui.ColorButton->blockSignals(true);
     ui.HorizontalClothCount->blockSignals(true);
     ui.VerticalClothCount->blockSignals(true);
@@ -68,6 +79,8 @@ ImportImageDlg::ImportImageDlg(QWidget *parent, const Magick::Image &originalIma
     ui.UseMaximumColors->blockSignals(false);
     ui.MaximumColors->blockSignals(false);
     ui.IgnoreColor->blockSignals(false);
+    ui.Quantizer->blockSignals(false);
+    ui.Dithering->blockSignals(false);
     ui.ColorButton->blockSignals(false);
     ui.HorizontalClothCount->blockSignals(false);
     ui.VerticalClothCount->blockSignals(false);
@@ -79,6 +92,12 @@ ImportImageDlg::ImportImageDlg(QWidget *parent, const Magick::Image &originalIma
     connect(ui.ImagePreview, &ScaledPixmapLabel::imageCropped, this, &ImportImageDlg::imageCropped);
 }
 
+ImportImageDlg::~ImportImageDlg()
+{
+    m_future.cancel();
+    m_pool.waitForDone();
+}
+
 void ImportImageDlg::updateWindowTitle()
 {
     QString caption = i18n("Import Image - Image Size %1 x %2 pixels", m_crop.width(), m_crop.height());
@@ -171,6 +190,20 @@ void ImportImageDlg::on_IgnoreColor_toggled(bool checked)
     renderPixmap();
 }
 
+void ImportImageDlg::on_Quantizer_currentIndexChanged(int index)
+{
+    ui.Dithering->setEnabled(index == Configuration::EnumImport_Quantizer::CIELab);
+
+    killTimer(m_timer);
+    m_timer = startTimer(500);
+}
+
+void ImportImageDlg::on_Dithering_currentIndexChanged(int)
+{
+    killTimer(m_timer);
+    m_timer = startTimer(500);
+}
+
 void ImportImageDlg::on_ColorButton_clicked(bool)
 {
     m_alphaSelect = new AlphaSelect(ui.ImagePreview);
@@ -265,7 +298,6 @@ void ImportImageDlg::on_CropReset_clicked(bool checked)
 {
     Q_UNUSED(checked);
 
-    m_convertedImage = m_originalImage;
     m_crop = QRect(0, 0, m_originalImage.columns(), m_originalImage.rows());
     updateWindowTitle();
 
@@ -274,11 +306,12 @@ void ImportImageDlg::on_CropReset_clicked(bool checked)
 
 void ImportImageDlg::imageCropped(const QRectF &rectF)
 {
-    // rectF is new crop rectangle relative to m_convertedImage size
-    // scale rect from m_convertedImage size to m_originalSize
+    // rectF is new crop rectangle relative to m_pixmap size, which may be the converted
+    // image size or a reduced preview size
+    // scale rect from m_pixmap size to m_originalSize
     // m_original size may be cropped from m_originalImage, but is not scaled.
     // add new crop to original one.
-    double scaleFactor = (double)m_originalSize.width() / (double)m_convertedImage.columns();
+    double scaleFactor = (double)m_originalSize.width() / (double)m_pixmap.width();
     QRect scaledCrop = QRect(scaleFactor * rectF.left(), scaleFactor * rectF.top(), scaleFactor * rectF.width(), scaleFactor * rectF.height());
     m_crop = QRect(m_crop.left() + scaledCrop.left(), m_crop.top() + scaledCrop.top(), scaledCrop.width(), scaledCrop.height());
 
@@ -297,25 +330,11 @@ void ImportImageDlg::on_UseFractionals_toggled(bool checked)
 
 void ImportImageDlg::calculateSizes()
 {
-    m_convertedImage = m_originalImage;
-
     if (m_crop.isValid()) {
-        m_convertedImage.chop(Magick::Geometry(m_crop.left(), m_crop.top()));
-        m_convertedImage.crop(Magick::Geometry(m_crop.width(), m_crop.height()));
-        m_originalSize = QSize(m_convertedImage.columns(), m_convertedImage.rows());
+        m_originalSize = m_crop.size();
     }
 
     m_preferredSize = m_originalSize * ui.PatternScale->value() / 100;
-    QSize imageSize = m_preferredSize;
-
-    if (ui.UseFractionals->isChecked()) {
-        imageSize *= 2;
-    }
-
-    Magick::Geometry geometry(imageSize.width(), imageSize.height());
-    geometry.percent(false);
-    geometry.aspect(true); // set to true to ignore maintaining the aspect ratio
-    m_convertedImage.sample(geometry);
     on_HorizontalClothCount_valueChanged(ui.HorizontalClothCount->value());
 }
 
@@ -325,92 +344,90 @@ void ImportImageDlg::createImageMap()
     m_colorMap = *(scheme->createImageMap());
 }
 
-void ImportImageDlg::renderPixmap()
+ImportParameters ImportImageDlg::importParameters() const
 {
-    QPixmap alpha;
-    alpha.loadFromData(alphaData, 143);
+    int symbolCount = SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count();
+
+    ImportParameters parameters;
+    parameters.crop = m_crop;
+    parameters.imageSize = m_preferredSize;
+
+    if (ui.UseFractionals->isChecked()) {
+        parameters.imageSize *= 2;
+    }
 
-    ui.ImagePreview->setCursor(Qt::WaitCursor);
+    parameters.imageSize = parameters.imageSize.expandedTo(QSize(1, 1));
+    parameters.previewSize = ui.ImagePreview->size() * ui.ImagePreview->devicePixelRatioF();
+    parameters.quantizer = static_cast<Configuration::EnumImport_Quantizer::type>(ui.Quantizer->currentIndex());
+    parameters.dithering = static_cast<Configuration::EnumImport_Dithering::type>(ui.Dithering->currentIndex());
+    parameters.maximumColors = ui.UseMaximumColors->isChecked() ? std::min<int>(ui.MaximumColors->value(), symbolCount) : symbolCount;
+
+    for (const Floss *floss : SchemeManager::scheme(ui.FlossScheme->currentText())->flosses()) {
+        parameters.flossColors.append(floss->color().rgb());
+    }
+
+    parameters.colorMap = m_colorMap;
+    parameters.ignoreColor = ui.IgnoreColor->isChecked();
+    parameters.ignoreColorValue = m_ignoreColorValue;
+
+    return parameters;
+}
+
+void ImportImageDlg::renderPixmap()
+{
     calculateSizes();
-    m_convertedImage.modifyImage();
 
-    m_pixmap = QPixmap(m_convertedImage.columns(), m_convertedImage.rows());
-    m_pixmap.fill();
+    // cancel any conversion in progress, its results are no longer wanted
+    m_future.cancel();
 
-    m_convertedImage.quantizeColorSpace(Magick::RGBColorspace);
-    m_convertedImage.quantizeColors(
-        ui.UseMaximumColors->isChecked()
-            ? std::min<int>(ui.MaximumColors->value(), SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count())
-            : SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count());
-    m_convertedImage.quantize();
-    m_convertedImage.map(m_colorMap);
-    m_convertedImage.modifyImage();
+    ImportPipeline *pipeline = &m_pipeline;
+    ImportParameters parameters = importParameters();
 
-    QPainter painter;
-    painter.begin(&m_pixmap);
-    painter.drawTiledPixmap(m_pixmap.rect(), alpha);
-    int width = m_convertedImage.columns();
-    int height = m_convertedImage.rows();
-    int pixelCount = width * height;
+    m_future = QtConcurrent::run(&m_pool, [pipeline, parameters](QPromise<ImportResult> &promise) {
+        pipeline->process(promise, parameters);
+    });
+    m_watcher.setFuture(m_future);
 
-    QProgressDialog progress(i18n("Rendering preview"), i18n("Cancel"), 0, pixelCount, this);
-    progress.setWindowModality(Qt::WindowModal);
+    ui.ImagePreview->setCursor(Qt::BusyCursor);
+}
 
-/*
- * ImageMagick prior to V7 used matte (opacity) to determine if an image has transparency.
- * 0.0 for transparent to 1.0 for opaque
- *
- * ImageMagick V7 now uses alpha (transparency).
- * 1.0 for transparent to 0.0 for opaque
- *
- * Access to pixels has changed too, V7 can use pixelColor to access the color of a particular
- * pixel, but although this was available in V6, it doesn't appear to produce the same result
- * and has resulted in black images when importing.
- */
-#if MagickLibVersion < 0x700
-    bool hasTransparency = m_convertedImage.matte();
-    double transparent = 1.0;
-    const Magick::PixelPacket *pixels = m_convertedImage.getConstPixels(0, 0, width, height);
-#else
-    bool hasTransparency = m_convertedImage.alpha();
-    double transparent = 0.0;
-#endif
-
-    for (int dy = 0; dy < height; dy++) {
-        QApplication::processEvents();
-        progress.setValue(dy * width);
-
-        if (progress.wasCanceled()) {
-            break;
-        }
+void ImportImageDlg::resultReady(int index)
+{
+    showResult(m_watcher.resultAt(index));
+}
 
-        for (int dx = 0; dx < width; dx++) {
-#if MagickLibVersion < 0x700
-            Magick::ColorRGB rgb = Magick::Color(*pixels++);
-#else
-            Magick::ColorRGB rgb = m_convertedImage.pixelColor(dx, dy);
-#endif
-
-            if (hasTransparency && (rgb.alpha() == transparent)) {
-                // ignore this pixel as it is transparent
-            } else {
-                if (!(ui.IgnoreColor->isChecked() && rgb == m_ignoreColorValue)) {
-                    QColor color((int)(255 * rgb.red()), (int)(255 * rgb.green()), (int)(255 * rgb.blue()));
-                    painter.setPen(QPen(color));
-                    painter.drawPoint(dx, dy);
-                }
-            }
-        }
+void ImportImageDlg::conversionFinished()
+{
+    ui.ImagePreview->setCursor(Qt::ArrowCursor);
+}
+
+void ImportImageDlg::showResult(const ImportResult &result)
+{
+    if (result.complete) {
+        m_convertedImage = result.image;
     }
 
+    QPixmap alpha;
+    alpha.loadFromData(alphaData, 143);
+
+    m_pixmap = QPixmap(result.preview.size());
+
+    QPainter painter;
+    painter.begin(&m_pixmap);
+    painter.drawTiledPixmap(m_pixmap.rect(), alpha);
+    painter.drawImage(0, 0, result.preview);
     painter.end();
+
     ui.ImagePreview->setPixmap(m_pixmap);
-    ui.ImagePreview->setCursor(Qt::ArrowCursor);
+    ui.ImagePreview->setToolTip(i18n("Memory used by the import %1, peak %2",
+                                     QLocale().formattedDataSize(result.memory),
+                                     QLocale().formattedDataSize(result.peakMemory)));
 }
 
 void ImportImageDlg::timerEvent(QTimerEvent *)
 {
     killTimer(m_timer);
+    m_timer = 0;
     renderPixmap();
 }
 
@@ -428,6 +445,13 @@ void ImportImageDlg::pickColor()
 
 void ImportImageDlg::selectColor(const QPoint &p)
 {
+    if (m_convertedImage.columns() == 0) {
+        // the first conversion has not completed
+        delete m_alphaSelect;
+        m_alphaSelect = nullptr;
+        return;
+    }
+
     QSize trueSize(m_convertedImage.columns(), m_convertedImage.rows());
     QRect pixmapRect = m_alphaSelect->pixmapRect();
 
@@ -451,6 +475,25 @@ void ImportImageDlg::selectColor(const QPoint &p)
 
 void ImportImageDlg::on_DialogButtonBox_accepted()
 {
+    // the full size image may still be being converted, wait for it rather than use a stale one
+    if (m_future.isRunning() || m_timer) {
+        // a pending timer means the settings changed since the running conversion started,
+        // so it is replaced by a conversion of the current settings
+        if (m_timer) {
+            killTimer(m_timer);
+            m_timer = 0;
+            renderPixmap();
+        }
+
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        m_future.waitForFinished();
+        QApplication::restoreOverrideCursor();
+
+        if (m_future.resultCount() && m_future.resultAt(m_future.resultCount() - 1).complete) {
+            m_convertedImage = m_future.resultAt(m_future.resultCount() - 1).image;
+        }
+    }
+
     accept();
 }
 
@@ -467,7 +510,6 @@ void ImportImageDlg::on_DialogButtonBox_helpRequested()
 void ImportImageDlg::on_DialogButtonBox_clicked(QAbstractButton *button)
 {
     if (ui.DialogButtonBox->button(QDialogButtonBox::Reset) == button) {
-        m_convertedImage = m_originalImage;
         resetImportParameters();
         renderPixmap();
     }
@@ -568,6 +610,9 @@ void ImportImageDlg::resetImportParameters()
     ui.MaximumColors->setValue(Configuration::import_MaximumColors());
     ui.MaximumColors->setMaximum(SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count());
     ui.MaximumColors->setToolTip(QString(i18n("Colors limited to %1 due to the number of symbols available", ui.MaximumColors->maximum())));
+    ui.Quantizer->setCurrentIndex(Configuration::import_Quantizer());
+    ui.Dithering->setCurrentIndex(Configuration::import_Dithering());
+    ui.Dithering->setEnabled(ui.Quantizer->currentIndex() == Configuration::EnumImport_Quantizer::CIELab);
 }
 
 #include "moc_ImportImageDlg.cpp"
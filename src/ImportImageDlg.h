@@ -13,8 +13,11 @@
 
 #include <QAction>
 #include <QDialog>
+#include <QFuture>
+#include <QFutureWatcher>
 #include <QPixmap>
 #include <QSize>
+#include <QThreadPool>
 #include <QTimer>
 #include <QWidget>
 
@@ -26,6 +29,7 @@
 #pragma GCC diagnostic pop
 
 #include "AlphaSelect.h"
+#include "ImportPipeline.h"
 #include "ui_ImportImage.h"
 
 class SchemeManager;
@@ -38,7 +42,7 @@ class ImportImageDlg : public QDialog
 
 public:
     ImportImageDlg(QWidget *, const Magick::Image &);
-    virtual ~ImportImageDlg() = default;
+    virtual ~ImportImageDlg();
 
     Magick::Image convertedImage() const;
     bool ignoreColor() const;
@@ -59,6 +63,8 @@ private slots:
     void on_UseMaximumColors_toggled(bool);
     void on_MaximumColors_valueChanged(int);
     void on_IgnoreColor_toggled(bool);
+    void on_Quantizer_currentIndexChanged(int);
+    void on_Dithering_currentIndexChanged(int);
     void on_ColorButton_clicked(bool);
     void on_HorizontalClothCount_valueChanged(double);
     void on_VerticalClothCount_valueChanged(double);
@@ -73,6 +79,8 @@ private slots:
     void on_DialogButtonBox_rejected();
     void on_DialogButtonBox_helpRequested();
     void on_DialogButtonBox_clicked(QAbstractButton *);
+    void resultReady(int);
+    void conversionFinished();
 
 private:
     void updateWindowTitle();
@@ -80,7 +88,9 @@ private:
     void clothCountChanged(double, double);
     void calculateSizes();
     void createImageMap();
+    ImportParameters importParameters() const;
     void renderPixmap();
+    void showResult(const ImportResult &);
     void pickColor();
 
     Ui::ImportImage ui;
@@ -95,6 +105,10 @@ private:
     Magick::Image m_convertedImage;
     Magick::Image m_colorMap;
     QRect m_crop;
+    ImportPipeline m_pipeline;
+    QThreadPool m_pool;
+    QFuture<ImportResult> m_future;
+    QFutureWatcher<ImportResult> m_watcher;
 };
 
 #endif // ImportImageDlg_H
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements the reading of images for import, reducing large
+ * images to a working size.
+ */
+
+// Class include
+#include "ImportImageReader.h"
+
+// Qt includes
+#include <QImage>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QSize>
+#include <QVector>
+
+// C++ includes
+#include <algorithm>
+
+/**
+ * The approximate number of bytes of each band of rows converted from a large image.
+ */
+static const qint64 bandBytes = 32 * 1024 * 1024;
+
+/**
+ * This class averages the pixels of a large image in to a reduced image, a
+ * row at a time, so the large image can be supplied in bands from the top.
+ * The colors are weighted by their alpha so transparent pixels do not darken
+ * the colors of their neighbours.
+ */
+class BoxFilter
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param sourceSize is the size of the large image
+     * @param image is the reduced image, in the QImage::Format_RGBA8888 format
+     */
+    BoxFilter(const QSize &sourceSize, QImage &image)
+        : m_sourceSize(sourceSize)
+        , m_image(image)
+        , m_columns(sourceSize.width())
+        , m_sums(image.width() * 5, 0)
+        , m_row(-1)
+    {
+        for (int x = 0; x < sourceSize.width(); ++x) {
+            m_columns[x] = qint64(x) * image.width() / sourceSize.width();
+        }
+    }
+
+    /**
+     * Add a band of rows of the large image.
+     *
+     * @param band is the band of rows
+     * @param top is the row of the large image the band starts at
+     */
+    void add(const QImage &band, int top)
+    {
+        QImage rgba = band.convertToFormat(QImage::Format_RGBA8888);
+
+        for (int y = 0; y < rgba.height(); ++y) {
+            int row = qint64(top + y) * m_image.height() / m_sourceSize.height();
+
+            if (row != m_row) {
+                flush();
+                m_row = row;
+            }
+
+            const uchar *pixel = rgba.constScanLine(y);
+
+            for (int x = 0; x < rgba.width(); ++x, pixel += 4) {
+                quint64 *sum = m_sums.data() + m_columns.at(x) * 5;
+                sum[0] += pixel[0] * pixel[3];
+                sum[1] += pixel[1] * pixel[3];
+                sum[2] += pixel[2] * pixel[3];
+                sum[3] += pixel[3];
+                sum[4]++;
+            }
+        }
+    }
+
+    /**
+     * Write the averages of the current row to the reduced image.
+     */
+    void flush()
+    {
+        if (m_row == -1) {
+            return;
+        }
+
+        uchar *pixel = m_image.scanLine(m_row);
+
+        for (int x = 0; x < m_image.width(); ++x, pixel += 4) {
+            quint64 *sum = m_sums.data() + x * 5;
+
+            if (sum[3]) {
+                pixel[0] = uchar(sum[0] / sum[3]);
+                pixel[1] = uchar(sum[1] / sum[3]);
+                pixel[2] = uchar(sum[2] / sum[3]);
+                pixel[3] = uchar(sum[3] / sum[4]);
+            } else {
+                pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+            }
+        }
+
+        m_sums.fill(0);
+        m_row = -1;
+    }
+
+private:
+    QSize m_sourceSize; /**< The size of the large image */
+    QImage &m_image; /**< The reduced image */
+    QVector<int> m_columns; /**< The column of the reduced image for each column of the large image */
+    QVector<quint64> m_sums; /**< The weighted color, alpha and pixel count sums of each pixel of the current row */
+    int m_row; /**< The row of the reduced image being accumulated, -1 if none */
+};
+
+Magick::Image ImportImageReader::read(const QString &fileName, int maximumSize)
+{
+    QImageReader reader(fileName);
+    QSize sourceSize = reader.size();
+
+    if ((maximumSize <= 0) || !sourceSize.isValid() || (std::max(sourceSize.width(), sourceSize.height()) <= maximumSize)) {
+        return Magick::Image(fileName.toStdString());
+    }
+
+    QSize size = sourceSize.scaled(maximumSize, maximumSize, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+    QImage image;
+
+    if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        // the plugin decodes directly at the reduced size
+        reader.setScaledSize(size);
+        image = reader.read().convertToFormat(QImage::Format_RGBA8888);
+    } else {
+        // the plugin can only decode the full image, decoding a clip rectangle would still decode
+        // the rows above it for every band, so it is decoded once and reduced in bands
+        QImage source = reader.read();
+
+        if (!source.isNull()) {
+            image = QImage(size, QImage::Format_RGBA8888);
+            BoxFilter filter(sourceSize, image);
+
+            // convert the decoded image in bands so only one converted band is held with it
+            int bandRows = std::max<qint64>(1, bandBytes / (qint64(sourceSize.width()) * 4));
+
+            for (int top = 0; top < source.height(); top += bandRows) {
+                filter.add(source.copy(0, top, source.width(), std::min(bandRows, source.height() - top)), top);
+            }
+
+            filter.flush();
+        }
+    }
+
+    if (image.isNull() || (image.size() != size)) {
+        // Qt was unable to decode the image so let ImageMagick read it, reducing it straight away
+        Magick::Image magickImage(fileName.toStdString());
+        Magick::Geometry geometry(size.width(), size.height());
+        geometry.aspect(true);
+        magickImage.resize(geometry);
+
+        return magickImage;
+    }
+
+    return Magick::Image(image.width(), image.height(), "RGBA", Magick::CharPixel, image.constBits());
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines the reading of images for import, reducing large images
+ * to a working size.
+ */
+
+#ifndef ImportImageReader_H
+#define ImportImageReader_H
+
+// Qt includes
+#include <QString>
+
+// wrap include to silence unused-parameter warning from Magick++ include file
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsuggest-override"
+#include <Magick++.h>
+#pragma GCC diagnostic pop
+
+/**
+ * This class reads an image to be imported, reducing it so neither its width
+ * nor its height is larger than a maximum size.
+ *
+ * Images that are already small enough are read by ImageMagick as they always
+ * have been. For larger images, where the Qt image plugin for the format can
+ * decode at a reduced size, as the JPEG plugin does, the image is decoded
+ * directly at the reduced size and the full size image is never held in
+ * memory. Other formats that Qt can read, such as PNG and TIFF, are decoded
+ * once at full size and averaged in to the reduced image in bands, the decoded
+ * image is released as soon as it has been reduced. Formats that Qt can not
+ * read fall back to ImageMagick, which also reads them at full size before
+ * reducing them.
+ *
+ * In every case the dialog, pipeline and preview only see the reduced image,
+ * so the memory they use is bounded by the reduced size.
+ */
+class ImportImageReader
+{
+public:
+    /**
+     * Read an image.
+     *
+     * @param fileName is the path of the image file
+     * @param maximumSize is the largest width or height of the returned image, 0 to read the image at full size
+     *
+     * @return the image, which may be reduced in size
+     */
+    static Magick::Image read(const QString &fileName, int maximumSize);
+};
+
+#endif // ImportImageReader_H
@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements the pipeline that converts an image to the reduced
+ * color image used to create a pattern on import.
+ */
+
+// Class include
+#include "ImportPipeline.h"
+
+// Qt includes
+#include <QByteArray>
+#include <QColor>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVector>
+
+// Application includes
+#include "ColorQuantizer.h"
+#include "DocumentFloss.h"
+#include "Floss.h"
+#include "FlossScheme.h"
+#include "SchemeManager.h"
+#include "SymbolLibrary.h"
+#include "SymbolManager.h"
+
+// C++ includes
+#include <algorithm>
+
+/**
+ * Update a cached stage if it has not been created or was created from different parameters.
+ *
+ * @param stage is the cached stage
+ * @param key is the parameters the stage depends on
+ * @param create is a function returning the new value of the stage
+ */
+template <class Stage, class Key, class Function>
+static void update(Stage &stage, const Key &key, Function create)
+{
+    if (!stage.valid || !(stage.key == key)) {
+        stage.value = create();
+        stage.key = key;
+        stage.valid = true;
+    }
+}
+
+/**
+ * Read the pixels of an image in order as packed colors, classifying each one as transparent or
+ * as the ignored color.
+ *
+ * ImageMagick prior to V7 used matte (opacity) to determine if an image has transparency.
+ * 0.0 for transparent to 1.0 for opaque
+ *
+ * ImageMagick V7 now uses alpha (transparency).
+ * 1.0 for transparent to 0.0 for opaque
+ *
+ * Access to pixels has changed too, V7 can use pixelColor to access the color of a particular
+ * pixel, but although this was available in V6, it doesn't appear to produce the same result
+ * and has resulted in black images when importing.
+ */
+class PixelReader
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param image is the image to read, which must outlive the reader
+     * @param ignoreColor is true if the pixels of ignoreColorValue are to be classified as ignored
+     * @param ignoreColorValue is the color to ignore
+     */
+    PixelReader(const Magick::Image &image, bool ignoreColor, const Magick::ColorRGB &ignoreColorValue)
+        : m_ignoreColor(ignoreColor)
+#if MagickLibVersion < 0x700
+        , m_hasTransparency(image.matte())
+        , m_ignoreColorValue(ignoreColorValue)
+        , m_pixels(image.getConstPixels(0, 0, image.columns(), image.rows()))
+#else
+        , m_hasTransparency(image.alpha())
+        , m_ignoreRgb(qRgb(qRound(255 * ignoreColorValue.red()), qRound(255 * ignoreColorValue.green()), qRound(255 * ignoreColorValue.blue())))
+        , m_pixelData(qsizetype(image.columns()) * image.rows() * 4, Qt::Uninitialized)
+#endif
+    {
+#if MagickLibVersion >= 0x700
+        // export all the pixels as 8 bit RGBA in one call rather than fetching each one with pixelColor
+        image.write(0, 0, image.columns(), image.rows(), "RGBA", Magick::CharPixel, m_pixelData.data());
+        m_pixels = reinterpret_cast<const uchar *>(m_pixelData.constData());
+#endif
+    }
+
+    /**
+     * Read the next pixel, the pixels are read row by row.
+     *
+     * @param isTransparent is set true if the pixel is transparent
+     * @param isIgnored is set true if the pixel is the ignored color
+     *
+     * @return the packed color of the pixel
+     */
+    QRgb next(bool &isTransparent, bool &isIgnored)
+    {
+#if MagickLibVersion < 0x700
+        Magick::ColorRGB rgb = Magick::Color(*m_pixels++);
+        isTransparent = m_hasTransparency && (rgb.alpha() == 1.0);
+        isIgnored = m_ignoreColor && (rgb == m_ignoreColorValue);
+
+        return qRgb((int)(255 * rgb.red()), (int)(255 * rgb.green()), (int)(255 * rgb.blue()));
+#else
+        QRgb color = qRgb(m_pixels[0], m_pixels[1], m_pixels[2]);
+        isTransparent = m_hasTransparency && (m_pixels[3] == 0);
+        isIgnored = m_ignoreColor && (color == m_ignoreRgb);
+        m_pixels += 4;
+
+        return color;
+#endif
+    }
+
+private:
+    bool m_ignoreColor;
+    bool m_hasTransparency;
+#if MagickLibVersion < 0x700
+    Magick::ColorRGB m_ignoreColorValue;
+    const Magick::PixelPacket *m_pixels;
+#else
+    QRgb m_ignoreRgb;
+    QByteArray m_pixelData;
+    const uchar *m_pixels;
+#endif
+};
+
+ImportPipeline::ImportPipeline(const Magick::Image &originalImage)
+    : m_originalImage(originalImage)
+    , m_peakMemory(0)
+{
+}
+
+void ImportPipeline::process(QPromise<ImportResult> &promise, const ImportParameters &parameters)
+{
+    QRgb ignoreRgb = qRgb(qRound(255 * parameters.ignoreColorValue.red()),
+                          qRound(255 * parameters.ignoreColorValue.green()),
+                          qRound(255 * parameters.ignoreColorValue.blue()));
+
+    QList<QSize> passes;
+
+    // a first pass at the display size gives a quick preview when the image is larger, unless
+    // the full size image is already available
+    const Pass &full = m_passes[1];
+    MapKey fullMapKey(ReduceKey(SampleKey(parameters.crop, parameters.imageSize), parameters.quantizer, parameters.maximumColors),
+                      parameters.dithering,
+                      parameters.flossColors);
+    bool fullMapped = full.map.valid && (full.map.key == fullMapKey);
+
+    if (!fullMapped && !parameters.previewSize.isEmpty()
+        && ((parameters.imageSize.width() > parameters.previewSize.width()) || (parameters.imageSize.height() > parameters.previewSize.height()))) {
+        passes.append(parameters.imageSize.scaled(parameters.previewSize, Qt::KeepAspectRatio).expandedTo(QSize(1, 1)));
+    }
+
+    passes.append(parameters.imageSize);
+
+    update(m_crop, parameters.crop, [&] {
+        return crop(parameters.crop);
+    });
+
+    for (const QSize &size : std::as_const(passes)) {
+        bool complete = (size == parameters.imageSize);
+        Pass &pass = m_passes[complete ? 1 : 0];
+
+        SampleKey sampleKey(parameters.crop, size);
+        ReduceKey reduceKey(sampleKey, parameters.quantizer, parameters.maximumColors);
+        MapKey mapKey(reduceKey, parameters.dithering, parameters.flossColors);
+        PreviewKey previewKey(mapKey, parameters.ignoreColor, ignoreRgb);
+
+        if (promise.isCanceled()) {
+            return;
+        }
+
+        update(pass.sample, sampleKey, [&] {
+            return sample(m_crop.value, size);
+        });
+
+        if (promise.isCanceled()) {
+            return;
+        }
+
+        update(pass.reduce, reduceKey, [&] {
+            return reduce(pass.sample.value, parameters);
+        });
+
+        if (promise.isCanceled()) {
+            return;
+        }
+
+        update(pass.map, mapKey, [&] {
+            return map(pass.reduce.value, parameters);
+        });
+
+        if (promise.isCanceled()) {
+            return;
+        }
+
+        update(pass.preview, previewKey, [&] {
+            return createPreview(pass.map.value, parameters.ignoreColor, parameters.ignoreColorValue);
+        });
+
+        qint64 bytes = memory();
+        m_peakMemory = std::max(m_peakMemory, bytes);
+
+        promise.addResult(ImportResult{pass.map.value, pass.preview.value, complete, bytes, m_peakMemory});
+    }
+}
+
+Magick::Image ImportPipeline::convert(const ImportParameters &parameters, ImportTimings *timings) const
+{
+    ImportTimings stageTimings;
+    QElapsedTimer timer;
+    timer.start();
+
+    Magick::Image image = crop(parameters.crop);
+    stageTimings.crop = timer.restart();
+
+    image = sample(image, parameters.imageSize);
+    stageTimings.sample = timer.restart();
+
+    image = reduce(image, parameters);
+    stageTimings.reduce = timer.restart();
+
+    image = map(image, parameters);
+    stageTimings.map = timer.restart();
+
+    if (timings) {
+        *timings = stageTimings;
+    }
+
+    return image;
+}
+
+bool ImportPipeline::createStitches(const Magick::Image &image,
+                                    bool useFractionals,
+                                    bool ignoreColor,
+                                    const Magick::ColorRGB &ignoreColorValue,
+                                    StitchData &stitches,
+                                    DocumentPalette &palette,
+                                    const std::function<bool(int)> &progress)
+{
+    int imageWidth = image.columns();
+    int imageHeight = image.rows();
+    int documentWidth = imageWidth;
+    int documentHeight = imageHeight;
+
+    if (useFractionals) {
+        documentWidth /= 2;
+        documentHeight /= 2;
+    }
+
+    QHash<QRgb, int> documentFlosses; // packed pixel color to floss index
+    QList<qint16> symbolIndexes = SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes();
+    FlossScheme *flossScheme = SchemeManager::scheme(palette.schemeName());
+
+    PixelReader reader(image, ignoreColor, ignoreColorValue);
+
+    // the stitches are added directly rather than with a command for each stitch
+    stitches.resize(documentWidth, documentHeight);
+
+    // with fractionals the floss indexes of a pair of rows are kept so the four quarters of
+    // each cell can be classified together, -1 for pixels with no stitch
+    QVector<int> quarterIndexes(useFractionals ? imageWidth * 2 : 0, -1);
+
+    for (int dy = 0; dy < imageHeight; dy++) {
+        if (progress && !progress(dy)) {
+            return false;
+        }
+
+        for (int dx = 0; dx < imageWidth; dx++) {
+            bool isTransparent;
+            bool isIgnored;
+            QRgb color = reader.next(isTransparent, isIgnored);
+
+            if (useFractionals) {
+                quarterIndexes[(dy % 2) * imageWidth + dx] = -1;
+            }
+
+            if (isTransparent) {
+                // ignore this pixel as it is transparent
+            } else {
+                if (!isIgnored) {
+                    int flossIndex = documentFlosses.value(color, -1);
+
+                    if (flossIndex == -1) { // a color not seen before
+                        flossIndex = documentFlosses.count();
+                        qint16 stitchSymbol = symbolIndexes.takeFirst();
+                        Qt::PenStyle backstitchSymbol(Qt::SolidLine);
+                        Floss *floss = flossScheme->find(QColor(color));
+
+                        DocumentFloss *documentFloss = new DocumentFloss(floss->name(),
+                                                                         stitchSymbol,
+                                                                         backstitchSymbol,
+                                                                         Configuration::palette_StitchStrands(),
+                                                                         Configuration::palette_BackstitchStrands());
+                        documentFloss->setFlossColor(floss->color());
+                        palette.add(flossIndex, documentFloss);
+                        documentFlosses.insert(color, flossIndex);
+                    }
+
+                    // at this point
+                    //   flossIndex will be the index for the found color
+                    if (useFractionals) {
+                        quarterIndexes[(dy % 2) * imageWidth + dx] = flossIndex;
+                    } else {
+                        stitches.addStitch(QPoint(dx, dy), Stitch::Full, flossIndex);
+                    }
+                }
+            }
+        }
+
+        if (useFractionals && (dy % 2)) {
+            // both rows of quarters are known, so create the stitches of each cell in one step
+            // rather than adding each quarter and merging them in the stitch queue
+            for (int cx = 0; cx < documentWidth; ++cx) {
+                int colorIndexes[4] = {quarterIndexes.at(cx * 2),
+                                       quarterIndexes.at(cx * 2 + 1),
+                                       quarterIndexes.at(imageWidth + cx * 2),
+                                       quarterIndexes.at(imageWidth + cx * 2 + 1)};
+
+                if (StitchQueue *stitchQueue = StitchQueue::fromQuarters(colorIndexes)) {
+                    stitches.replaceStitchQueueAt(cx, dy / 2, stitchQueue);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+Magick::Image ImportPipeline::crop(const QRect &area) const
+{
+    Magick::Image image = m_originalImage;
+
+    if (area.isValid()) {
+        image.chop(Magick::Geometry(area.left(), area.top()));
+        image.crop(Magick::Geometry(area.width(), area.height()));
+    }
+
+    return image;
+}
+
+Magick::Image ImportPipeline::sample(const Magick::Image &image, const QSize &size)
+{
+    Magick::Image sampled = image;
+    Magick::Geometry geometry(size.width(), size.height());
+    geometry.percent(false);
+    geometry.aspect(true); // set to true to ignore maintaining the aspect ratio
+    sampled.sample(geometry);
+
+    return sampled;
+}
+
+Magick::Image ImportPipeline::reduce(const Magick::Image &image, const ImportParameters &parameters)
+{
+    Magick::Image reduced = image;
+
+    // the CIELAB quantizer reduces the colors and maps them in one step
+    if (parameters.quantizer == Configuration::EnumImport_Quantizer::ImageMagick) {
+        reduced.quantizeColorSpace(Magick::RGBColorspace);
+        reduced.quantizeColors(parameters.maximumColors);
+        reduced.quantize();
+    }
+
+    return reduced;
+}
+
+Magick::Image ImportPipeline::map(const Magick::Image &image, const ImportParameters &parameters)
+{
+    Magick::Image mapped = image;
+
+    if (parameters.quantizer == Configuration::EnumImport_Quantizer::CIELab) {
+        ColorQuantizer quantizer(parameters.flossColors);
+        quantizer.setMaximumColors(parameters.maximumColors);
+        quantizer.setDithering(parameters.dithering);
+
+        int width = mapped.columns();
+        int height = mapped.rows();
+        QByteArray pixelData(qsizetype(width) * height * 4, Qt::Uninitialized);
+        mapped.write(0, 0, width, height, "RGBA", Magick::CharPixel, pixelData.data());
+        quantizer.quantize(reinterpret_cast<uchar *>(pixelData.data()), width, height);
+        mapped.read(width, height, "RGBA", Magick::CharPixel, pixelData.constData());
+    } else {
+        mapped.map(parameters.colorMap);
+    }
+
+    mapped.modifyImage();
+
+    return mapped;
+}
+
+qint64 ImportPipeline::imageBytes(const Magick::Image &image)
+{
+#if MagickLibVersion < 0x700
+    qint64 channels = image.matte() ? 4 : 3;
+#else
+    qint64 channels = image.channels();
+#endif
+
+    return qint64(image.columns()) * image.rows() * channels * sizeof(Magick::Quantum);
+}
+
+qint64 ImportPipeline::memory() const
+{
+    qint64 bytes = imageBytes(m_originalImage);
+
+    if (m_crop.valid && m_crop.key.isValid()) {
+        bytes += imageBytes(m_crop.value);
+    }
+
+    for (const Pass &pass : m_passes) {
+        if (pass.sample.valid) {
+            bytes += imageBytes(pass.sample.value);
+        }
+
+        // the reduce stage of the CIELAB quantizer shares the sampled image
+        if (pass.reduce.valid && (std::get<1>(pass.reduce.key) == Configuration::EnumImport_Quantizer::ImageMagick)) {
+            bytes += imageBytes(pass.reduce.value);
+        }
+
+        if (pass.map.valid) {
+            bytes += imageBytes(pass.map.value);
+        }
+
+        if (pass.preview.valid) {
+            bytes += pass.preview.value.sizeInBytes();
+        }
+    }
+
+    return bytes;
+}
+
+QImage ImportPipeline::createPreview(const Magick::Image &image, bool ignoreColor, const Magick::ColorRGB &ignoreColorValue)
+{
+    int width = image.columns();
+    int height = image.rows();
+
+    QImage preview(width, height, QImage::Format_ARGB32);
+    preview.fill(Qt::transparent);
+
+    PixelReader reader(image, ignoreColor, ignoreColorValue);
+
+    for (int dy = 0; dy < height; dy++) {
+        QRgb *line = reinterpret_cast<QRgb *>(preview.scanLine(dy));
+
+        for (int dx = 0; dx < width; dx++) {
+            bool isTransparent;
+            bool isIgnored;
+            QRgb color = reader.next(isTransparent, isIgnored);
+
+            if (!isTransparent && !isIgnored) {
+                line[dx] = color;
+            }
+        }
+    }
+
+    return preview;
+}
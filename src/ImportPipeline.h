@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines the pipeline that converts an image to the reduced color
+ * image used to create a pattern on import.
+ */
+
+#ifndef ImportPipeline_H
+#define ImportPipeline_H
+
+// Qt includes
+#include <QImage>
+#include <QList>
+#include <QPromise>
+#include <QRect>
+#include <QRgb>
+#include <QSize>
+
+// C++ includes
+#include <functional>
+#include <tuple>
+
+// wrap include to silence unused-parameter warning from Magick++ include file
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsuggest-override"
+#include <Magick++.h>
+#pragma GCC diagnostic pop
+
+// Application includes
+#include "DocumentPalette.h"
+#include "StitchData.h"
+#include "configuration.h"
+
+/**
+ * The parameters of an import, collected from the ImportImageDlg.
+ */
+struct ImportParameters {
+    QRect crop; /**< The area of the original image to use */
+    QSize imageSize; /**< The size of the converted image, twice the pattern size when using fractionals */
+    QSize previewSize; /**< The largest size needed for a preview, an empty size for no preview pass */
+    Configuration::EnumImport_Quantizer::type quantizer; /**< The method used to reduce the colors */
+    Configuration::EnumImport_Dithering::type dithering; /**< The dithering used by the CIELAB quantizer */
+    int maximumColors; /**< The maximum number of colors */
+    QList<QRgb> flossColors; /**< The colors of the floss scheme */
+    Magick::Image colorMap; /**< The image of the floss scheme colors used by ImageMagick */
+    bool ignoreColor; /**< true if a color is treated as transparent */
+    Magick::ColorRGB ignoreColorValue; /**< The color treated as transparent */
+};
+
+/**
+ * The result of an import pass.
+ */
+struct ImportResult {
+    Magick::Image image; /**< The converted image */
+    QImage preview; /**< The converted image with transparent and ignored pixels transparent */
+    bool complete; /**< true if the image is the full size, false for a reduced size preview */
+    qint64 memory; /**< The number of bytes held by the pipeline for the original image and cached stages */
+    qint64 peakMemory; /**< The largest number of bytes held by the pipeline */
+};
+
+/**
+ * The time taken by each stage of a conversion in milliseconds.
+ */
+struct ImportTimings {
+    qint64 crop = 0; /**< The time taken to crop the original image */
+    qint64 sample = 0; /**< The time taken to sample the cropped image to the pattern size */
+    qint64 reduce = 0; /**< The time taken to reduce the number of colors */
+    qint64 map = 0; /**< The time taken to map the colors to the floss scheme */
+};
+
+/**
+ * This class converts an image to the reduced color image used to create a
+ * pattern. The image is cropped, sampled to the pattern size, its colors are
+ * reduced to the colors of a floss scheme and a preview is created.
+ *
+ * The conversion is intended to be run on a worker thread with QtConcurrent.
+ * When the converted image is larger than the area it is displayed in, a pass
+ * at the display size is made first, so a preview can be shown quickly, before
+ * the pass at the full size. Each pass is reported as a result of the promise
+ * and the promise is checked for cancellation between the stages, so a stale
+ * conversion is abandoned when the parameters change.
+ *
+ * The result of each stage, crop, sample, reduce, map and preview, is cached
+ * for each pass along with the parameters it was created from, so a change to
+ * a parameter only repeats the stages that depend on it. Changing the maximum
+ * number of colors starts from the sampled image, and changing the ignored
+ * color only recreates the preview. For the ImageMagick quantizer the reduce
+ * stage quantizes the colors and the map stage maps them to the floss scheme,
+ * the CIELAB quantizer does both in the map stage.
+ *
+ * The process function modifies the cache, so calls must not overlap, which
+ * is achieved by running them on a thread pool with a single thread.
+ */
+class ImportPipeline
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param originalImage is the image being imported
+     */
+    explicit ImportPipeline(const Magick::Image &originalImage);
+
+    /**
+     * Convert the image, reporting an ImportResult for each pass.
+     *
+     * @param promise is the QPromise used to report results and check for cancellation
+     * @param parameters is the ImportParameters
+     */
+    void process(QPromise<ImportResult> &promise, const ImportParameters &parameters);
+
+    /**
+     * Convert the image at the full size on the calling thread.
+     *
+     * @param parameters is the ImportParameters
+     * @param timings is a pointer to an ImportTimings to receive the time taken by each stage, or nullptr
+     *
+     * @return the converted image
+     */
+    Magick::Image convert(const ImportParameters &parameters, ImportTimings *timings = nullptr) const;
+
+    /**
+     * Create the stitches and flosses of a pattern from a converted image. Each pixel is a
+     * full stitch, or a quarter stitch when using fractionals, except transparent pixels and
+     * pixels of the ignored color. The flosses are found in the scheme of the palette.
+     *
+     * @param image is the converted image
+     * @param useFractionals is true if each pixel is a quarter of a cell
+     * @param ignoreColor is true if a color is treated as transparent
+     * @param ignoreColorValue is the color treated as transparent
+     * @param stitches is the StitchData to fill, it is resized to the size of the pattern
+     * @param palette is the DocumentPalette the flosses are added to
+     * @param progress is called with each row of the image before it is converted, returning false cancels the conversion
+     *
+     * @return true if the stitches were created, false if the conversion was canceled
+     */
+    static bool createStitches(const Magick::Image &image,
+                               bool useFractionals,
+                               bool ignoreColor,
+                               const Magick::ColorRGB &ignoreColorValue,
+                               StitchData &stitches,
+                               DocumentPalette &palette,
+                               const std::function<bool(int)> &progress = std::function<bool(int)>());
+
+    /**
+     * Create a preview of a converted image.
+     *
+     * @param image is the converted image
+     * @param ignoreColor is true if a color is treated as transparent
+     * @param ignoreColorValue is the color treated as transparent
+     *
+     * @return a QImage with transparent and ignored pixels transparent
+     */
+    static QImage createPreview(const Magick::Image &image, bool ignoreColor, const Magick::ColorRGB &ignoreColorValue);
+
+private:
+    /**
+     * The cached result of a stage and the parameters it was created from.
+     */
+    template <class Key, class Value>
+    struct Stage {
+        bool valid = false; /**< true if the value has been created */
+        Key key; /**< The parameters the value was created from */
+        Value value; /**< The result of the stage */
+    };
+
+    using SampleKey = std::tuple<QRect, QSize>; /**< The crop area and size */
+    using ReduceKey = std::tuple<SampleKey, int, int>; /**< The sample, quantizer and maximum colors */
+    using MapKey = std::tuple<ReduceKey, int, QList<QRgb>>; /**< The reduction, dithering and floss colors */
+    using PreviewKey = std::tuple<MapKey, bool, QRgb>; /**< The mapping, ignore color flag and ignored color */
+
+    /**
+     * The cached stages of a pass.
+     */
+    struct Pass {
+        Stage<SampleKey, Magick::Image> sample; /**< The cropped image sampled to the pass size */
+        Stage<ReduceKey, Magick::Image> reduce; /**< The sampled image with a reduced number of colors */
+        Stage<MapKey, Magick::Image> map; /**< The reduced image mapped to the floss colors */
+        Stage<PreviewKey, QImage> preview; /**< The preview of the mapped image */
+    };
+
+    Magick::Image crop(const QRect &area) const;
+    static Magick::Image sample(const Magick::Image &image, const QSize &size);
+    static Magick::Image reduce(const Magick::Image &image, const ImportParameters &parameters);
+    static Magick::Image map(const Magick::Image &image, const ImportParameters &parameters);
+    static qint64 imageBytes(const Magick::Image &image);
+    qint64 memory() const;
+
+    Magick::Image m_originalImage; /**< The image being imported */
+    Stage<QRect, Magick::Image> m_crop; /**< The cropped original image, shared by the passes */
+    Pass m_passes[2]; /**< The cached stages of the preview pass and the full size pass */
+    qint64 m_peakMemory; /**< The largest number of bytes held */
+};
+
+#endif // ImportPipeline_H
@@ -62,7 +62,10 @@
 #include <KAboutData>
 #include <KLocalizedString>
 
+#include "BatchConverter.h"
+#include "ImageConverter.h"
 #include "MainWindow.h"
+#include "PatternExporter.h"
 #include "Version.h"
 #include "configuration.h"
 
@@ -78,10 +81,28 @@
     This MainWindow is then shown on the desktop.  If no arguments are provided a new MainWindow is
     created using an empty QUrl, creating a new document, which is then shown on the desktop.
 
+    If the --convert option is given, the arguments are PC Stitch files that are converted to KXStitch
+    files without creating a MainWindow, and the application exits when the conversion is complete.
+
+    If the --import option is given, the arguments are images that are converted to KXStitch patterns
+    with the same conversion as the import image dialog, without creating a MainWindow, and the
+    application exits when the conversion is complete.
+
+    If the --render option is given, the single argument is a document that is rendered to the file
+    named by the option without creating a MainWindow, either as a chart image, as images of the
+    printer pages, or as a PDF of the printer pages, and the application exits when it is complete.
+
     The KApplication instance is then executed which begins the event loop allowing user interaction.
     */
 int main(int argc, char *argv[])
 {
+    // headless modes do not need a display, so use the offscreen platform unless one has been chosen
+    for (int i = 1; i < argc; ++i) {
+        if (((qstrcmp(argv[i], "--convert") == 0) || (qstrcmp(argv[i], "--import") == 0) || (qstrncmp(argv[i], "--render", 8) == 0)) && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        }
+    }
+
     QApplication app(argc, argv);
     KLocalizedString::setApplicationDomain("kxstitch");
 
@@ -109,10 +130,90 @@ int main(int argc, char *argv[])
     aboutData.setupCommandLine(&parser);
     parser.addPositionalArgument(QStringLiteral("urls"), i18n("Document to open."), QStringLiteral("[urls...]"));
 
+    QCommandLineOption convertOption(QStringLiteral("convert"), i18n("Convert the PC Stitch files given as arguments to KXStitch files and exit."));
+    QCommandLineOption importOption(QStringLiteral("import"), i18n("Convert the images given as arguments to KXStitch patterns and exit."));
+    QCommandLineOption outputDirOption(QStringLiteral("output-dir"), i18n("The directory for converted files."), i18n("directory"));
+    QCommandLineOption jobsOption(QStringLiteral("jobs"), i18n("The number of threads used to convert files or render a document."), i18n("count"), QStringLiteral("0"));
+    QCommandLineOption cropOption(QStringLiteral("crop"), i18n("The area of each imported image to use."), i18n("x,y,width,height"));
+    QCommandLineOption scaleOption(QStringLiteral("scale"), i18n("The size of imported patterns as a percentage of the image size."), i18n("percent"), QStringLiteral("100"));
+    QCommandLineOption clothCountOption(QStringLiteral("cloth-count"), i18n("The cloth count of imported patterns."), i18n("count"));
+    QCommandLineOption maximumColorsOption(QStringLiteral("max-colors"), i18n("The maximum number of colors of imported patterns."), i18n("colors"));
+    QCommandLineOption schemeOption(QStringLiteral("scheme"), i18n("The floss scheme of imported patterns."), i18n("scheme"));
+    QCommandLineOption ignoreColorOption(QStringLiteral("ignore-color"), i18n("A color of imported images that is not stitched."), i18n("color"));
+    QCommandLineOption fractionalsOption(QStringLiteral("fractionals"), i18n("Use fractional stitches in imported patterns."));
+    QCommandLineOption renderOption(QStringLiteral("render"),
+                                    i18n("Render the document given as an argument to an image or PDF file and exit."),
+                                    i18n("file"));
+    QCommandLineOption cellSizeOption(QStringLiteral("cell-size"), i18n("The size in pixels of each cell of a rendered chart."), i18n("pixels"), QStringLiteral("20"));
+    QCommandLineOption pagesOption(QStringLiteral("pages"), i18n("Render the printer pages to separate images rather than the chart."));
+    QCommandLineOption dpiOption(QStringLiteral("dpi"), i18n("The resolution of rendered pages."), i18n("dpi"), QStringLiteral("300"));
+    parser.addOption(convertOption);
+    parser.addOption(importOption);
+    parser.addOption(outputDirOption);
+    parser.addOption(jobsOption);
+    parser.addOption(cropOption);
+    parser.addOption(scaleOption);
+    parser.addOption(clothCountOption);
+    parser.addOption(maximumColorsOption);
+    parser.addOption(schemeOption);
+    parser.addOption(ignoreColorOption);
+    parser.addOption(fractionalsOption);
+    parser.addOption(renderOption);
+    parser.addOption(cellSizeOption);
+    parser.addOption(pagesOption);
+    parser.addOption(dpiOption);
+
     parser.process(app);
 
     aboutData.processCommandLine(&parser);
 
+    if (parser.isSet(convertOption)) {
+        return BatchConverter::run(parser.positionalArguments(), parser.value(outputDirOption), parser.value(jobsOption).toInt());
+    }
+
+    if (parser.isSet(importOption)) {
+        ImageConversionOptions options;
+
+        if (parser.isSet(cropOption)) {
+            QStringList values = parser.value(cropOption).split(QLatin1Char(','));
+
+            if (values.count() != 4) {
+                parser.showHelp(1);
+            }
+
+            options.crop = QRect(values.at(0).toInt(), values.at(1).toInt(), values.at(2).toInt(), values.at(3).toInt());
+        }
+
+        if (parser.isSet(ignoreColorOption)) {
+            options.ignoreColor = QColor(parser.value(ignoreColorOption));
+
+            if (!options.ignoreColor.isValid()) {
+                parser.showHelp(1);
+            }
+        }
+
+        options.scale = parser.value(scaleOption).toInt();
+        options.clothCount = parser.value(clothCountOption).toDouble();
+        options.maximumColors = parser.value(maximumColorsOption).toInt();
+        options.schemeName = parser.value(schemeOption);
+        options.useFractionals = parser.isSet(fractionalsOption);
+
+        return ImageConverter::run(parser.positionalArguments(), parser.value(outputDirOption), options, parser.value(jobsOption).toInt());
+    }
+
+    if (parser.isSet(renderOption)) {
+        if (parser.positionalArguments().count() != 1) {
+            parser.showHelp(1);
+        }
+
+        return PatternExporter::run(parser.positionalArguments().first(),
+                                    parser.value(renderOption),
+                                    parser.value(cellSizeOption).toInt(),
+                                    parser.value(dpiOption).toInt(),
+                                    parser.isSet(pagesOption),
+                                    parser.value(jobsOption).toInt());
+    }
+
     MainWindow *mainWindow;
 
     QStringList urls = parser.positionalArguments();
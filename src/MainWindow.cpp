@@ -12,10 +12,13 @@
 
 #include <QAction>
 #include <QActionGroup>
+#include <QBuffer>
 #include <QClipboard>
 #include <QDataStream>
 #include <QDockWidget>
+#include <QHash>
 #include <QFileDialog>
+#include <QImage>
 #include <QGridLayout>
 #include <QMenu>
 #include <QMimeData>
@@ -28,9 +31,12 @@
 #include <QProgressDialog>
 #include <QSaveFile>
 #include <QScrollArea>
+#include <QStorageInfo>
 #include <QTemporaryFile>
 #include <QUndoView>
 #include <QUrl>
+#include <QVector>
+#include <QtConcurrent>
 
 #include <KActionCollection>
 #include <KConfigDialog>
@@ -43,6 +49,7 @@
 #include <KXMLGUIFactory>
 #include <kwidgetsaddons_version.h>
 
+#include "AutosaveJournal.h"
 #include "BackgroundImage.h"
 #include "Commands.h"
 #include "ConfigurationDialogs.h"
@@ -53,6 +60,8 @@
 #include "Floss.h"
 #include "FlossScheme.h"
 #include "ImportImageDlg.h"
+#include "ImportImageReader.h"
+#include "ImportPipeline.h"
 #include "Palette.h"
 #include "PaletteManagerDlg.h"
 #include "PaperSizes.h"
@@ -65,14 +74,22 @@
 #include "SymbolManager.h"
 #include "configuration.h"
 
+#include <exception>
+
 MainWindow::MainWindow()
     : m_printer(nullptr)
+    , m_saveWatcher(new QFutureWatcher<QString>(this))
+    , m_saveSnapshot(nullptr)
+    , m_journal(nullptr)
 {
     setupActions();
 }
 
 MainWindow::MainWindow(const QUrl &url)
     : m_printer(nullptr)
+    , m_saveWatcher(new QFutureWatcher<QString>(this))
+    , m_saveSnapshot(nullptr)
+    , m_journal(nullptr)
 {
     setupMainWindow();
     setupLayout();
@@ -90,6 +107,9 @@ MainWindow::MainWindow(const QUrl &url)
 
 MainWindow::MainWindow(const QString &source)
     : m_printer(nullptr)
+    , m_saveWatcher(new QFutureWatcher<QString>(this))
+    , m_saveSnapshot(nullptr)
+    , m_journal(nullptr)
 {
     setupMainWindow();
     setupLayout();
@@ -138,6 +158,7 @@ void MainWindow::setupLayout()
 void MainWindow::setupDocument()
 {
     m_document = new Document();
+    m_journal = new AutosaveJournal(m_document, this);
 
     m_editor->setDocument(m_document);
     m_editor->setPreview(m_preview);
@@ -171,6 +192,8 @@ void MainWindow::setupConnections()
     connect(&(m_document->undoStack()), &QUndoStack::undoTextChanged, this, &MainWindow::undoTextChanged);
     connect(&(m_document->undoStack()), &QUndoStack::redoTextChanged, this, &MainWindow::redoTextChanged);
     connect(&(m_document->undoStack()), &QUndoStack::cleanChanged, this, &MainWindow::documentModified);
+    connect(&(m_document->undoStack()), &QUndoStack::indexChanged, m_journal, &AutosaveJournal::scheduleRecord);
+    connect(m_saveWatcher, &QFutureWatcher<QString>::finished, this, &MainWindow::saveFinished);
     connect(m_palette, &Palette::colorSelected, m_editor, static_cast<void (Editor::*)()>(&Editor::drawContents));
     connect(m_palette, static_cast<void (Palette::*)(int, int)>(&Palette::swapColors), this, &MainWindow::paletteSwapColors);
     connect(m_palette, static_cast<void (Palette::*)(int, int)>(&Palette::replaceColor), this, &MainWindow::paletteReplaceColor);
@@ -205,6 +228,14 @@ void MainWindow::setupActionDefaults()
 
 MainWindow::~MainWindow()
 {
+    m_saveWatcher->waitForFinished();
+    delete m_saveSnapshot;
+
+    // the window is only closed once any changes have been saved or discarded, so the journal is no longer needed
+    if (m_journal) {
+        m_journal->close();
+    }
+
     delete m_printer;
 }
 
@@ -225,6 +256,8 @@ Palette *MainWindow::palette()
 
 bool MainWindow::queryClose()
 {
+    waitForSave();
+
     if (m_document->undoStack().isClean()) {
         return true;
     }
@@ -235,6 +268,7 @@ bool MainWindow::queryClose()
         switch (messageBoxResult) {
         case KMessageBox::PrimaryAction:
             fileSave();
+            waitForSave();
 
             if (m_document->undoStack().isClean()) {
                 return true;
@@ -264,6 +298,19 @@ void MainWindow::setupActionsFromDocument()
     updateBackgroundImageActionLists();
 }
 
+/**
+    Test if a file is stored on a network file system.
+    @param fileName the path of the file
+    @return true if the file system is known to be a network file system
+    */
+static bool isNetworkFileSystem(const QString &fileName)
+{
+    static const QList<QByteArray> networkFileSystems = {"9p", "afs", "ceph", "cifs", "davfs", "fuse.davfs2", "fuse.glusterfs", "fuse.sshfs", "glusterfs",
+                                                         "lustre", "ncpfs", "nfs", "nfs4", "smb", "smb2", "smb3", "smbfs", "sshfs"};
+
+    return networkFileSystems.contains(QStorageInfo(fileName).fileSystemType());
+}
+
 void MainWindow::fileNew()
 {
     MainWindow *window = new MainWindow(QUrl());
@@ -285,61 +332,61 @@ void MainWindow::fileOpen(const QUrl &url)
 
     if (url.isValid()) {
         if (docEmpty) {
-            QTemporaryFile tmpFile;
-
-            if (tmpFile.open()) {
-                tmpFile.close();
-
-                KIO::FileCopyJob *job = KIO::file_copy(url, QUrl::fromLocalFile(tmpFile.fileName()), -1, KIO::Overwrite);
-
-                if (job->exec()) {
-                    /* In earlier versions of KDE/Qt creating a QDataStream on tmpFile allowed reading the data from the copied file.
-                     * Somewhere after KDE 5.55.0/Qt 5.9.7 this no longer possible as tmpFile size() is reported with a length of 0
-                     * whereas previously tmpFile size() was reported as the size of the copied file.
-                     * Therefore open a new QFile on the temporary file after downloading to allow reading.
-                     */
-                    QFile reader(tmpFile.fileName());
-                    if (reader.open(QIODevice::ReadOnly)) {
-                        QDataStream stream(&reader);
-
-                        try {
-                            m_document->readKXStitch(stream);
-                            m_document->setUrl(url);
-                            KRecentFilesAction *action = static_cast<KRecentFilesAction *>(actionCollection()->action(QStringLiteral("file_open_recent")));
-                            action->addUrl(url);
-                            action->saveEntries(KConfigGroup(KSharedConfig::openConfig(), QStringLiteral("RecentFiles")));
-                        } catch (const InvalidFile &e) {
-                            stream.device()->seek(0);
-
-                            try {
-                                m_document->readPCStitch(stream);
-                            } catch (const InvalidFile &e) {
-                                KMessageBox::error(nullptr, i18n("The file does not appear to be a recognized cross stitch file."));
-                            }
-                        } catch (const InvalidFileVersion &e) {
-                            KMessageBox::error(nullptr, i18n("This version of the file is not supported.\n%1", e.version));
-                        } catch (const FailedReadFile &e) {
-                            KMessageBox::error(nullptr, i18n("Failed to read the file.\n%1.", e.status));
-                            m_document->initialiseNew();
-                        }
+            if (url.isLocalFile()) {
+                // files on local disks are mapped into memory and read in place rather than being copied, files on network
+                // shares are read into memory as they can be truncated whilst mapped, which would crash the application
+                QFile file(url.toLocalFile());
+
+                if (file.open(QIODevice::ReadOnly)) {
+                    uchar *data = (isNetworkFileSystem(file.fileName())) ? nullptr : file.map(0, file.size());
+                    QByteArray fileData = (data) ? QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size()) : file.readAll();
+
+                    if (data || (file.error() == QFileDevice::NoError)) {
+                        QBuffer buffer(&fileData);
+                        buffer.open(QIODevice::ReadOnly);
+                        readDocument(&buffer, url);
+                        buffer.close();
+                    } else {
+                        KMessageBox::error(nullptr, file.errorString());
+                    }
 
-                        setupActionsFromDocument();
-                        m_editor->readDocumentSettings();
-                        m_preview->readDocumentSettings();
-                        m_palette->update();
-                        documentModified(true); // this is the clean value true
+                    if (data) {
+                        file.unmap(data);
+                    }
 
-                        reader.close();
+                    file.close();
+                } else {
+                    KMessageBox::error(nullptr, file.errorString());
+                }
+            } else {
+                QTemporaryFile tmpFile;
+
+                if (tmpFile.open()) {
+                    tmpFile.close();
+
+                    KIO::FileCopyJob *job = KIO::file_copy(url, QUrl::fromLocalFile(tmpFile.fileName()), -1, KIO::Overwrite);
+
+                    if (job->exec()) {
+                        /* In earlier versions of KDE/Qt creating a QDataStream on tmpFile allowed reading the data from the copied file.
+                         * Somewhere after KDE 5.55.0/Qt 5.9.7 this no longer possible as tmpFile size() is reported with a length of 0
+                         * whereas previously tmpFile size() was reported as the size of the copied file.
+                         * Therefore open a new QFile on the temporary file after downloading to allow reading.
+                         */
+                        QFile reader(tmpFile.fileName());
+                        if (reader.open(QIODevice::ReadOnly)) {
+                            readDocument(&reader, url);
+                            reader.close();
+                        } else {
+                            KMessageBox::error(nullptr, reader.errorString());
+                        }
                     } else {
-                        KMessageBox::error(nullptr, reader.errorString());
+                        KMessageBox::error(nullptr, job->errorString());
                     }
+
+                    tmpFile.close();
                 } else {
-                    KMessageBox::error(nullptr, job->errorString());
+                    KMessageBox::error(nullptr, tmpFile.errorString());
                 }
-
-                tmpFile.close();
-            } else {
-                KMessageBox::error(nullptr, tmpFile.errorString());
             }
         } else {
             window = new MainWindow(url);
@@ -348,6 +395,60 @@ void MainWindow::fileOpen(const QUrl &url)
     }
 }
 
+void MainWindow::readDocument(QIODevice *device, const QUrl &url)
+{
+    QDataStream stream(device);
+
+    try {
+        m_document->readKXStitch(stream);
+        m_document->setUrl(url);
+
+        if (m_journal->open(url)) {
+            if (KMessageBox::questionTwoActions(this,
+                                                i18n("There are unsaved changes to %1 from a previous session.\nDo you want to recover them?", url.fileName()),
+                                                i18n("Recover Changes"),
+                                                KGuiItem(i18nc("@action:button", "Recover"), QStringLiteral("document-revert")),
+                                                KStandardGuiItem::discard())
+                == KMessageBox::PrimaryAction) {
+                if (!m_journal->recover()) {
+                    KMessageBox::error(this, i18n("Some of the changes could not be recovered."));
+                }
+
+                // the recovered changes have not been saved
+                m_document->undoStack().resetClean();
+            } else {
+                m_journal->discard();
+            }
+        }
+
+        KRecentFilesAction *action = static_cast<KRecentFilesAction *>(actionCollection()->action(QStringLiteral("file_open_recent")));
+        action->addUrl(url);
+        action->saveEntries(KConfigGroup(KSharedConfig::openConfig(), QStringLiteral("RecentFiles")));
+    } catch (const InvalidFile &e) {
+        stream.device()->seek(0);
+
+        try {
+            m_document->readPCStitch(stream);
+        } catch (const InvalidFile &e) {
+            KMessageBox::error(nullptr, i18n("The file does not appear to be a recognized cross stitch file."));
+        } catch (const FailedReadFile &e) {
+            KMessageBox::error(nullptr, i18n("Failed to read the file.\n%1.", e.status));
+            m_document->initialiseNew();
+        }
+    } catch (const InvalidFileVersion &e) {
+        KMessageBox::error(nullptr, i18n("This version of the file is not supported.\n%1", e.version));
+    } catch (const FailedReadFile &e) {
+        KMessageBox::error(nullptr, i18n("Failed to read the file.\n%1.", e.status));
+        m_document->initialiseNew();
+    }
+
+    setupActionsFromDocument();
+    m_editor->readDocumentSettings();
+    m_preview->readDocumentSettings();
+    m_palette->update();
+    documentModified(m_document->undoStack().isClean());
+}
+
 void MainWindow::fileSave()
 {
     QUrl url = m_document->url();
@@ -355,27 +456,82 @@ void MainWindow::fileSave()
     if (url.toString() == i18n("Untitled")) {
         fileSaveAs();
     } else {
+        // only one save at a time, any previous save must complete before the next snapshot is taken
+        waitForSave();
+
+        // the pattern is encoded in to the snapshot here, the snapshot is then compressed and written on a
+        // worker thread whilst editing continues, the undo stack is clean at this point
+        m_saveSnapshot = m_document->snapshot();
+        m_document->undoStack().setClean();
+        m_journal->saveStarted(url);
+
+        Document *snapshot = m_saveSnapshot;
         // ### Why use QUrl everywhere if this only supports local files?
-        QSaveFile file(url.toLocalFile());
+        QString fileName = url.toLocalFile();
+        // the configuration is not thread safe so it is read here rather than by the worker
+        bool compress = Configuration::document_CompressFiles();
 
-        if (file.open(QIODevice::WriteOnly)) {
-            QDataStream stream(&file);
+        m_saveWatcher->setFuture(QtConcurrent::run([snapshot, fileName, compress]() {
+            QString error;
+            QSaveFile file(fileName);
 
-            try {
-                m_document->write(stream);
+            if (file.open(QIODevice::WriteOnly)) {
+                QDataStream stream(&file);
 
-                if (!file.commit()) {
-                    throw FailedWriteFile(stream.status());
-                }
+                try {
+                    snapshot->write(stream, compress);
 
-                m_document->undoStack().setClean();
-            } catch (const FailedWriteFile &e) {
-                KMessageBox::error(nullptr, QString(i18n("Failed to save the file.\n%1", file.errorString())));
-                file.cancelWriting();
+                    if (!file.commit()) {
+                        error = QString(i18n("Failed to save the file.\n%1", file.errorString()));
+                    }
+                } catch (const FailedWriteFile &e) {
+                    error = QString(i18n("Failed to save the file.\n%1", e.statusMessage()));
+                    file.cancelWriting();
+                } catch (const std::exception &e) {
+                    error = QString(i18n("Failed to save the file.\n%1", QString::fromLocal8Bit(e.what())));
+                    file.cancelWriting();
+                } catch (...) {
+                    error = QString(i18n("Failed to save the file."));
+                    file.cancelWriting();
+                }
+            } else {
+                error = QString(i18n("Failed to open the file.\n%1", file.errorString()));
             }
-        } else {
-            KMessageBox::error(nullptr, QString(i18n("Failed to open the file.\n%1", file.errorString())));
-        }
+
+            return error;
+        }));
+
+        documentModified(m_document->undoStack().isClean());
+    }
+}
+
+void MainWindow::saveFinished()
+{
+    if (m_saveSnapshot == nullptr) {
+        return; // already handled by waitForSave
+    }
+
+    QString error = m_saveWatcher->result();
+
+    delete m_saveSnapshot;
+    m_saveSnapshot = nullptr;
+
+    m_journal->saveFinished(error.isEmpty());
+
+    if (!error.isEmpty()) {
+        // the snapshot was not saved so the document no longer has a state matching the file
+        m_document->undoStack().resetClean();
+        KMessageBox::error(this, error);
+    }
+
+    documentModified(m_document->undoStack().isClean());
+}
+
+void MainWindow::waitForSave()
+{
+    if (m_saveSnapshot) {
+        m_saveWatcher->waitForFinished();
+        saveFinished();
     }
 }
 
@@ -517,137 +673,61 @@ void MainWindow::fileImportImage()
 
 void MainWindow::convertImage(const QString &source)
 {
-    Magick::Image image(source.toStdString());
-
-    QMap<int, QColor> documentFlosses;
-    QList<qint16> symbolIndexes = SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes();
+    // large images are reduced as they are read, so the full size image is never held in memory
+    Magick::Image image = ImportImageReader::read(source, Configuration::import_ReduceLargeImages() ? Configuration::import_MaximumImageSize() : 0);
 
     QPointer<ImportImageDlg> importImageDlg = new ImportImageDlg(this, image);
 
     if (importImageDlg->exec()) {
         Magick::Image convertedImage = importImageDlg->convertedImage();
 
-        int imageWidth = convertedImage.columns();
-        int imageHeight = convertedImage.rows();
-        int documentWidth = imageWidth;
-        int documentHeight = imageHeight;
-
-        bool useFractionals = importImageDlg->useFractionals();
-
-/*
- * ImageMagick prior to V7 used matte (opacity) to determine if an image has transparency.
- * 0.0 for transparent to 1.0 for opaque
- *
- * ImageMagick V7 now uses alpha (transparency).
- * 1.0 for transparent to 0.0 for opaque
- *
- * Access to pixels has changed too, V7 can use pixelColor to access the color of a particular
- * pixel, but although this was available in V6, it doesn't appear to produce the same result
- * and has resulted in black images when importing.
- */
-#if MagickLibVersion < 0x700
-        bool hasTransparency = convertedImage.matte();
-        double transparent = 1.0;
-        const Magick::PixelPacket *pixels = convertedImage.getConstPixels(0, 0, imageWidth, imageHeight);
-#else
-        bool hasTransparency = convertedImage.alpha();
-        double transparent = 0.0;
-#endif
-
-        bool ignoreColor = importImageDlg->ignoreColor();
-        Magick::Color ignoreColorValue = importImageDlg->ignoreColorValue();
-
-        int pixelCount = imageWidth * imageHeight;
-
-        if (useFractionals) {
-            documentWidth /= 2;
-            documentHeight /= 2;
-        }
-
-        QString schemeName = importImageDlg->flossScheme();
-        FlossScheme *flossScheme = SchemeManager::scheme(schemeName);
+        int pixelCount = convertedImage.columns() * convertedImage.rows();
 
-        QUndoCommand *importImageCommand = new ImportImageCommand(m_document);
-        new ResizeDocumentCommand(m_document, documentWidth, documentHeight, importImageCommand);
-        new ChangeSchemeCommand(m_document, schemeName, importImageCommand);
+        // the stitches and palette are filled directly and given to a single command, rather
+        // than creating a command for each stitch which is then run when pushed on the undo stack
+        StitchData stitches;
+        DocumentPalette palette = m_document->pattern()->palette();
+        palette.setSchemeName(importImageDlg->flossScheme());
 
         QProgressDialog progress(i18n("Converting to stitches"), i18n("Cancel"), 0, pixelCount, this);
         progress.setWindowModality(Qt::WindowModal);
 
-        for (int dy = 0; dy < imageHeight; dy++) {
-            progress.setValue(dy * imageWidth);
-            QApplication::processEvents();
-
-            if (progress.wasCanceled()) {
-                delete importImageDlg;
-                delete importImageCommand;
-                return;
-            }
-
-            for (int dx = 0; dx < imageWidth; dx++) {
-#if MagickLibVersion < 0x700
-                Magick::ColorRGB rgb = Magick::Color(*pixels++);
-#else
-                Magick::ColorRGB rgb = convertedImage.pixelColor(dx, dy);
-#endif
-
-                if (hasTransparency && (rgb.alpha() == transparent)) {
-                    // ignore this pixel as it is transparent
-                } else {
-                    if (!(ignoreColor && (rgb == ignoreColorValue))) {
-                        int flossIndex;
-                        QColor color((int)(255 * rgb.red()), (int)(255 * rgb.green()), (int)(255 * rgb.blue()));
-
-                        for (flossIndex = 0; flossIndex < documentFlosses.count(); ++flossIndex) {
-                            if (documentFlosses[flossIndex] == color) {
-                                break;
-                            }
-                        }
-
-                        if (flossIndex == documentFlosses.count()) { // reached the end of the list
-                            qint16 stitchSymbol = symbolIndexes.takeFirst();
-                            Qt::PenStyle backstitchSymbol(Qt::SolidLine);
-                            Floss *floss = flossScheme->find(color);
-
-                            DocumentFloss *documentFloss = new DocumentFloss(floss->name(),
-                                                                             stitchSymbol,
-                                                                             backstitchSymbol,
-                                                                             Configuration::palette_StitchStrands(),
-                                                                             Configuration::palette_BackstitchStrands());
-                            documentFloss->setFlossColor(floss->color());
-                            new AddDocumentFlossCommand(m_document, flossIndex, documentFloss, importImageCommand);
-                            documentFlosses.insert(flossIndex, color);
-                        }
-
-                        // at this point
-                        //   flossIndex will be the index for the found color
-                        if (useFractionals) {
-                            int zone = (dy % 2) * 2 + (dx % 2);
-                            new AddStitchCommand(m_document, QPoint(dx / 2, dy / 2), stitchMap[0][zone], flossIndex, importImageCommand);
-                        } else {
-                            new AddStitchCommand(m_document, QPoint(dx, dy), Stitch::Full, flossIndex, importImageCommand);
-                        }
-                    }
-                }
-            }
+        bool converted = ImportPipeline::createStitches(convertedImage,
+                                                        importImageDlg->useFractionals(),
+                                                        importImageDlg->ignoreColor(),
+                                                        importImageDlg->ignoreColorValue(),
+                                                        stitches,
+                                                        palette,
+                                                        [&progress, &convertedImage](int row) {
+                                                            progress.setValue(row * convertedImage.columns());
+                                                            QApplication::processEvents();
+                                                            return !progress.wasCanceled();
+                                                        });
+
+        if (!converted) {
+            delete importImageDlg;
+            return;
         }
 
+        QUndoCommand *importImageCommand = new ImportImageCommand(m_document, stitches, palette);
         new SetPropertyCommand(m_document, QStringLiteral("horizontalClothCount"), importImageDlg->horizontalClothCount(), importImageCommand);
         new SetPropertyCommand(m_document, QStringLiteral("verticalClothCount"), importImageDlg->verticalClothCount(), importImageCommand);
         m_document->undoStack().push(importImageCommand);
 
-        convertPreview(source, importImageDlg->croppedArea());
+        convertPreview(image, importImageDlg->croppedArea());
     }
 
     delete importImageDlg;
 }
 
-void MainWindow::convertPreview(const QString &source, const QRect &croppedArea)
+void MainWindow::convertPreview(const Magick::Image &image, const QRect &croppedArea)
 {
-    QPixmap pixmap;
-    pixmap.load(source);
-    pixmap = pixmap.copy(croppedArea);
-    m_imageLabel->setPixmap(pixmap);
+    // the preview is created from the image that was imported rather than reading the source again
+    int width = image.columns();
+    int height = image.rows();
+    QImage preview(width, height, QImage::Format_RGBA8888);
+    image.write(0, 0, width, height, "RGBA", Magick::CharPixel, preview.bits());
+    m_imageLabel->setPixmap(QPixmap::fromImage(preview.copy(croppedArea)));
 }
 
 void MainWindow::fileProperties()
@@ -749,6 +829,7 @@ void MainWindow::fileRemoveBackgroundImage()
 void MainWindow::fileClose()
 {
     if (queryClose()) {
+        m_journal->close();
         m_document->initialiseNew();
         setupActionsFromDocument();
         m_editor->readDocumentSettings();
@@ -966,6 +1047,10 @@ void MainWindow::settingsChanged()
         delete configurationCommand;
     }
 
+    if (!Configuration::document_AutosaveJournal()) {
+        m_journal->close();
+    }
+
     loadSettings();
 }
 
@@ -1073,7 +1158,13 @@ void MainWindow::loadSettings()
 
 void MainWindow::documentModified(bool clean)
 {
-    setCaption(m_document->url().fileName(), !clean);
+    QString caption = m_document->url().fileName();
+
+    if (m_saveSnapshot) {
+        caption = i18n("%1 (saving)", caption);
+    }
+
+    setCaption(caption, !clean);
 }
 
 void MainWindow::setupActions()
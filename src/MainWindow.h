@@ -11,13 +11,17 @@
 #ifndef MainWindow_H
 #define MainWindow_H
 
+#include <QFutureWatcher>
+
 #include <KXmlGuiWindow>
 
+class QIODevice;
 class QPrinter;
 class QString;
 class QUndoView;
 class QUrl;
 
+class AutosaveJournal;
 class Document;
 class Editor;
 class Palette;
@@ -26,6 +30,11 @@ class Scale;
 class ScaledPixmapLabel;
 class SchemeManager;
 
+namespace Magick
+{
+class Image;
+}
+
 class MainWindow : public KXmlGuiWindow
 {
     Q_OBJECT
@@ -104,6 +113,7 @@ protected slots:
 
 private slots:
     void paletteContextMenu(const QPoint &);
+    void saveFinished();
 
 private:
     void setupMainWindow();
@@ -114,8 +124,10 @@ private:
     void setupConnections();
     void setupActionDefaults();
     void setupActionsFromDocument();
+    void readDocument(QIODevice *, const QUrl &);
+    void waitForSave();
     void convertImage(const QString &);
-    void convertPreview(const QString &, const QRect &);
+    void convertPreview(const Magick::Image &, const QRect &);
     QPrinter *printer();
 
     Document *m_document;
@@ -130,6 +142,11 @@ private:
     Scale *m_verticalScale;
 
     QPrinter *m_printer;
+
+    QFutureWatcher<QString> *m_saveWatcher;
+    Document *m_saveSnapshot;
+
+    AutosaveJournal *m_journal;
 };
 
 #endif // MainWindow_H
@@ -10,6 +10,9 @@
 
 #include "Pattern.h"
 
+#include <QHash>
+#include <QSet>
+
 #include <KLocalizedString>
 
 #include "Exceptions.h"
@@ -57,12 +60,19 @@ void Pattern::constructPalette(Pattern *pattern)
     }
 }
 
-Pattern *Pattern::cut(const QRect &area, int colorMask, const QList<Stitch::Type> &stitchMask, bool excludeBackstitches, bool excludeKnots)
+Pattern *Pattern::cut(const QRect &area, int colorMask, const StitchMask &stitchMask, bool excludeBackstitches, bool excludeKnots)
 {
     Pattern *pattern = new Pattern;
     pattern->stitches().resize(area.width(), area.height());
 
-    for (int row = area.top(); row <= area.bottom(); row++) {
+    // without masks the stitch queues are moved whole
+    bool allStitches = (colorMask == -1) && stitchMask.containsAll();
+
+    if (allStitches) {
+        pattern->stitches().moveStitchQueues(stitches(), area);
+    }
+
+    for (int row = area.top(); !allStitches && row <= area.bottom(); row++) {
         for (int column = area.left(); column <= area.right(); ++column) {
             QPoint src(column, row);
             QPoint dst(src - area.topLeft());
@@ -134,12 +144,19 @@ Pattern *Pattern::cut(const QRect &area, int colorMask, const QList<Stitch::Type
     return pattern;
 }
 
-Pattern *Pattern::copy(const QRect &area, int colorMask, const QList<Stitch::Type> &stitchMask, bool excludeBackstitches, bool excludeKnots)
+Pattern *Pattern::copy(const QRect &area, int colorMask, const StitchMask &stitchMask, bool excludeBackstitches, bool excludeKnots)
 {
     Pattern *pattern = new Pattern;
     pattern->stitches().resize(area.width(), area.height());
 
-    for (int row = area.top(); row <= area.bottom(); row++) {
+    // without masks the stitch queues are copied whole
+    bool allStitches = (colorMask == -1) && stitchMask.containsAll();
+
+    if (allStitches) {
+        pattern->stitches().copyStitchQueues(stitches(), area);
+    }
+
+    for (int row = area.top(); !allStitches && row <= area.bottom(); row++) {
         for (int column = area.left(); column <= area.right(); ++column) {
             QPoint src(column, row);
             QPoint dst(src - area.topLeft());
@@ -201,6 +218,31 @@ void Pattern::paste(Pattern *pattern, const QPoint &cell, bool merge)
 {
     pattern->palette().setSchemeName(palette().schemeName());
 
+    // the flosses of the pasted pattern are added to the palette once, when first used
+    QHash<int, int> colorIndexes;
+    QSet<int> usedIndexes;
+    bool distinctIndexes = true;
+
+    auto colorIndex = [&](int srcIndex) {
+        QHash<int, int>::const_iterator i = colorIndexes.constFind(srcIndex);
+
+        if (i != colorIndexes.constEnd()) {
+            return i.value();
+        }
+
+        int dstIndex = palette().add(pattern->palette().flosses().value(srcIndex)->flossColor());
+
+        // if two pasted flosses map to the same floss, stitches need to be added to combine them
+        if (usedIndexes.contains(dstIndex)) {
+            distinctIndexes = false;
+        }
+
+        usedIndexes.insert(dstIndex);
+        colorIndexes.insert(srcIndex, dstIndex);
+
+        return dstIndex;
+    };
+
     for (int row = 0; row < pattern->stitches().height(); ++row) {
         for (int col = 0; col < pattern->stitches().width(); ++col) {
             QPoint src(col, row);
@@ -215,16 +257,27 @@ void Pattern::paste(Pattern *pattern, const QPoint &cell, bool merge)
             }
 
             if (srcQ) {
+                QListIterator<Stitch *> stitchIterator(*srcQ);
+
                 if (dstQ == nullptr) {
                     dstQ = new StitchQueue();
-                }
 
-                QListIterator<Stitch *> stitchIterator(*srcQ);
+                    // the pasted queue is already consistent, so its stitches can be copied directly unless their colors combine
+                    while (distinctIndexes && stitchIterator.hasNext()) {
+                        Stitch *stitch = stitchIterator.next();
+                        dstQ->enqueue(new Stitch(stitch->type, colorIndex(stitch->colorIndex)));
+                    }
+
+                    if (!distinctIndexes) {
+                        qDeleteAll(*dstQ);
+                        dstQ->clear();
+                        stitchIterator.toFront();
+                    }
+                }
 
                 while (stitchIterator.hasNext()) {
                     Stitch *stitch = stitchIterator.next();
-                    int colorIndex = palette().add(pattern->palette().flosses().value(stitch->colorIndex)->flossColor());
-                    dstQ->add(stitch->type, colorIndex);
+                    dstQ->add(stitch->type, colorIndex(stitch->colorIndex));
                 }
             }
 
@@ -239,10 +292,10 @@ void Pattern::paste(Pattern *pattern, const QPoint &cell, bool merge)
 
     while (backstitchIterator.hasNext()) {
         Backstitch *backstitch = backstitchIterator.next();
-        int colorIndex = palette().add(pattern->palette().flosses().value(backstitch->colorIndex)->flossColor());
+        int dstIndex = colorIndex(backstitch->colorIndex);
 
         if (snapArea.contains(backstitch->start + targetOffset) && snapArea.contains(backstitch->end + targetOffset)) {
-            stitches().addBackstitch(backstitch->start + targetOffset, backstitch->end + targetOffset, colorIndex);
+            stitches().addBackstitch(backstitch->start + targetOffset, backstitch->end + targetOffset, dstIndex);
         }
     }
 
@@ -250,10 +303,10 @@ void Pattern::paste(Pattern *pattern, const QPoint &cell, bool merge)
 
     while (knotIterator.hasNext()) {
         Knot *knot = knotIterator.next();
-        int colorIndex = palette().add(pattern->palette().flosses().value(knot->colorIndex)->flossColor());
+        int dstIndex = colorIndex(knot->colorIndex);
 
         if (snapArea.contains(knot->position + targetOffset)) {
-            stitches().addFrenchKnot(knot->position + targetOffset, colorIndex);
+            stitches().addFrenchKnot(knot->position + targetOffset, dstIndex);
         }
     }
 }
@@ -27,8 +27,8 @@ public:
     DocumentPalette &palette();
     StitchData &stitches();
 
-    Pattern *cut(const QRect &area, int colorMask, const QList<Stitch::Type> &stitchMask, bool excludeBackstitches, bool excludeKnots);
-    Pattern *copy(const QRect &area, int colorMask, const QList<Stitch::Type> &stitchMask, bool excludeBackstitches, bool excludeKnots);
+    Pattern *cut(const QRect &area, int colorMask, const StitchMask &stitchMask, bool excludeBackstitches, bool excludeKnots);
+    Pattern *copy(const QRect &area, int colorMask, const StitchMask &stitchMask, bool excludeBackstitches, bool excludeKnots);
     void paste(Pattern *pattern, const QPoint &cell, bool merge);
 
     friend QDataStream &operator<<(QDataStream &stream, const Pattern &pattern);
@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file implements the rendering of a pattern document to image or PDF
+ * files from the command line without creating a MainWindow.
+ */
+
+// Class include
+#include "PatternExporter.h"
+
+// Qt includes
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageWriter>
+#include <QPageLayout>
+#include <QPainter>
+#include <QPdfWriter>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+// KF includes
+#include <KLocalizedString>
+
+// Application includes
+#include "Document.h"
+#include "Page.h"
+#include "PaperSizes.h"
+#include "Renderer.h"
+#include "SchemeManager.h"
+#include "SymbolManager.h"
+#include "configuration.h"
+
+/**
+ * Read a document from a file, trying the KXStitch format first and then the PC Stitch format.
+ *
+ * @param document is the Document to read in to
+ * @param source is the path of the file
+ *
+ * @return a description of the failure, empty if successful
+ */
+static QString readDocument(Document &document, const QString &source)
+{
+    QFile file(source);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return file.errorString();
+    }
+
+    QDataStream stream(&file);
+
+    try {
+        try {
+            document.readKXStitch(stream);
+        } catch (const InvalidFile &e) {
+            stream.device()->seek(0);
+            document.readPCStitch(stream);
+        }
+    } catch (const InvalidFile &e) {
+        return i18n("The file does not appear to be a recognized cross stitch file.");
+    } catch (const InvalidFileVersion &e) {
+        return i18n("This version of the file is not supported.\n%1", e.version);
+    } catch (const FailedReadFile &e) {
+        return i18n("Failed to read the file.\n%1.", e.status);
+    }
+
+    return QString();
+}
+
+/**
+ * Render the chart to an image, one band of rows on each thread.
+ *
+ * @param document is the Document to render
+ * @param output is the path of the image file
+ * @param cellSize is the size in pixels of each cell
+ * @param pool is the QThreadPool used for the bands
+ *
+ * @return a description of the failure, empty if successful
+ */
+static QString exportChart(Document &document, const QString &output, int cellSize, QThreadPool &pool)
+{
+    Pattern *pattern = document.pattern();
+    int width = pattern->stitches().width();
+    int height = pattern->stitches().height();
+
+    QImage image(width * cellSize, height * cellSize, QImage::Format_ARGB32_Premultiplied);
+
+    if (image.isNull()) {
+        return i18n("Unable to create an image of %1 by %2 pixels.", width * cellSize, height * cellSize);
+    }
+
+    image.fill(document.property(QStringLiteral("fabricColor")).value<QColor>());
+
+    // the bands write directly in to the scan lines of the image, so the bits are fetched once
+    // here as QImage::bits() may detach and is not safe to call from several threads
+    uchar *bits = image.bits();
+    qsizetype bytesPerLine = image.bytesPerLine();
+
+    int rowsPerBand = qMax(1, (height + pool.maxThreadCount() * 4 - 1) / (pool.maxThreadCount() * 4));
+    QList<int> bands;
+
+    for (int row = 0; row < height; row += rowsPerBand) {
+        bands.append(row);
+    }
+
+    int cellHorizontalGrouping = document.property(QStringLiteral("cellHorizontalGrouping")).toInt();
+    int cellVerticalGrouping = document.property(QStringLiteral("cellVerticalGrouping")).toInt();
+    QColor thinLineColor = document.property(QStringLiteral("thinLineColor")).value<QColor>();
+    QColor thickLineColor = document.property(QStringLiteral("thickLineColor")).value<QColor>();
+
+    QtConcurrent::blockingMap(&pool, bands, [&](int firstRow) {
+        int rows = qMin(rowsPerBand, height - firstRow);
+        QImage band(bits + firstRow * cellSize * bytesPerLine, width * cellSize, rows * cellSize, bytesPerLine, QImage::Format_ARGB32_Premultiplied);
+
+        // the renderer holds state while rendering, so each band has its own
+        Renderer renderer;
+        renderer.setCellGrouping(cellHorizontalGrouping, cellVerticalGrouping);
+        renderer.setGridLineWidths(Configuration::editor_ThinLineWidth(), Configuration::editor_ThickLineWidth());
+        renderer.setGridLineColors(thinLineColor, thickLineColor);
+        renderer.setRenderStitchesAs(Configuration::renderer_RenderStitchesAs());
+        renderer.setRenderBackstitchesAs(Configuration::renderer_RenderBackstitchesAs());
+        renderer.setRenderKnotsAs(Configuration::renderer_RenderKnotsAs());
+
+        QPainter painter(&band);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setWindow(0, firstRow, width, rows);
+
+        renderer.render(&painter,
+                        pattern,
+                        QRect(0, firstRow, width, rows),
+                        Configuration::renderer_RenderGrid(),
+                        Configuration::renderer_RenderStitches(),
+                        Configuration::renderer_RenderBackstitches(),
+                        Configuration::renderer_RenderFrenchKnots(),
+                        -1);
+    });
+
+    QImageWriter writer(output);
+
+    if (!writer.write(image)) {
+        return writer.errorString();
+    }
+
+    return QString();
+}
+
+/**
+ * Render the printer pages to images, one page on each thread.
+ *
+ * @param document is the Document to render
+ * @param output is the path of the image file, the page number is added to the name of each page
+ * @param dpi is the resolution of the images
+ * @param pool is the QThreadPool used for the pages
+ *
+ * @return a description of the failure, empty if successful
+ */
+static QString exportPageImages(Document &document, const QString &output, int dpi, QThreadPool &pool)
+{
+    QList<Page *> pages = document.printerConfiguration().pages();
+    QFileInfo outputInfo(output);
+    int digits = QString::number(pages.count()).length();
+
+    QList<int> pageIndexes;
+
+    for (int i = 0; i < pages.count(); ++i) {
+        pageIndexes.append(i);
+    }
+
+    QList<QString> errors = QtConcurrent::blockingMapped(&pool, pageIndexes, [&](int index) {
+        const Page *page = pages.at(index);
+        int paperWidth = PageSizes::width(page->pageSize().id(), page->orientation());
+        int paperHeight = PageSizes::height(page->pageSize().id(), page->orientation());
+
+        // the paper sizes are in mm
+        QImage image(qRound(paperWidth * dpi / 25.4), qRound(paperHeight * dpi / 25.4), QImage::Format_ARGB32_Premultiplied);
+
+        if (image.isNull()) {
+            return i18n("Unable to create an image of page %1.", index + 1);
+        }
+
+        image.fill(Qt::white);
+
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setWindow(0, 0, paperWidth, paperHeight);
+        page->render(&document, &painter);
+        painter.end();
+
+        QString fileName = QStringLiteral("%1-%2.%3").arg(outputInfo.completeBaseName()).arg(index + 1, digits, 10, QLatin1Char('0')).arg(outputInfo.suffix());
+        QImageWriter writer(outputInfo.dir().filePath(fileName));
+
+        return writer.write(image) ? QString() : writer.errorString();
+    });
+
+    for (const QString &error : std::as_const(errors)) {
+        if (!error.isEmpty()) {
+            return error;
+        }
+    }
+
+    return QString();
+}
+
+/**
+ * Render the printer pages to a PDF file.
+ *
+ * @param document is the Document to render
+ * @param output is the path of the PDF file
+ * @param dpi is the resolution of the PDF file
+ *
+ * @return a description of the failure, empty if successful
+ */
+static QString exportPdf(Document &document, const QString &output, int dpi)
+{
+    QList<Page *> pages = document.printerConfiguration().pages();
+
+    QPdfWriter writer(output);
+    writer.setResolution(dpi);
+    writer.setCreator(QStringLiteral("KXStitch"));
+    writer.setTitle(document.property(QStringLiteral("title")).toString());
+
+    QPainter painter;
+
+    for (int i = 0; i < pages.count(); ++i) {
+        const Page *page = pages.at(i);
+
+        // the page layout is set before the page is started, the pages elements include the margins
+        writer.setPageLayout(QPageLayout(page->pageSize(), page->orientation(), QMarginsF()));
+
+        if (i == 0) {
+            if (!painter.begin(&writer)) {
+                return i18n("Unable to write to %1.", output);
+            }
+
+            painter.setRenderHint(QPainter::Antialiasing, true);
+        } else {
+            writer.newPage();
+        }
+
+        painter.setWindow(0, 0, PageSizes::width(page->pageSize().id(), page->orientation()), PageSizes::height(page->pageSize().id(), page->orientation()));
+        page->render(&document, &painter);
+    }
+
+    painter.end();
+
+    return QString();
+}
+
+int PatternExporter::run(const QString &source, const QString &output, int cellSize, int dpi, bool pages, int jobs)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if ((cellSize < 1) || (dpi < 1)) {
+        err << i18n("The cell size and resolution must be greater than zero.") << Qt::endl;
+        return 1;
+    }
+
+    // the shared managers are created lazily, so create them here before any threads use them
+    SchemeManager::schemes();
+    SymbolManager::libraries();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    Document document;
+    QString error = readDocument(document, source);
+
+    if (error.isEmpty()) {
+        QThreadPool pool;
+
+        if (jobs > 0) {
+            pool.setMaxThreadCount(jobs);
+        }
+
+        bool pdf = (QFileInfo(output).suffix().compare(QLatin1String("pdf"), Qt::CaseInsensitive) == 0);
+
+        if ((pdf || pages) && document.printerConfiguration().pages().isEmpty()) {
+            error = i18n("There is nothing to print");
+        } else if (!pdf && !pages && document.pattern()->stitches().width() * document.pattern()->stitches().height() == 0) {
+            error = i18n("The pattern is empty.");
+        } else if (pdf) {
+            error = exportPdf(document, output, dpi);
+        } else if (pages) {
+            error = exportPageImages(document, output, dpi, pool);
+        } else {
+            error = exportChart(document, output, cellSize, pool);
+        }
+
+        if (error.isEmpty()) {
+            out << i18n("%1 -> %2 (%3 ms using %4 threads)", source, output, timer.elapsed(), pdf ? 1 : pool.maxThreadCount()) << Qt::endl;
+            return 0;
+        }
+    }
+
+    err << i18n("%1: %2", source, error.simplified()) << Qt::endl;
+
+    return 1;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 by agent
+ * agent@local
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * This file defines the rendering of a pattern document to image or PDF
+ * files from the command line without creating a MainWindow.
+ */
+
+#ifndef PatternExporter_H
+#define PatternExporter_H
+
+// Qt includes
+#include <QString>
+
+/**
+ * This class renders a pattern document to a file without creating any widgets.
+ *
+ * The output format is chosen from the extension of the output file. A PDF
+ * file contains the pages of the documents PrinterConfiguration, rendered as
+ * they would be printed. Any other extension writes an image, either of the
+ * whole chart at a given number of pixels per cell, or of each of the printer
+ * pages at a given resolution when pages are requested.
+ *
+ * A chart image is divided in to horizontal bands that are rendered in to
+ * the final image at the same time, each by its own Renderer. Page images are
+ * rendered a page at a time on each thread. The pages of a PDF file are
+ * written in order to a single stream, so they are rendered sequentially.
+ */
+class PatternExporter
+{
+public:
+    /**
+     * Render the document.
+     *
+     * @param source is the path of the KXStitch or PC Stitch file
+     * @param output is the path of the file to write, with pages the page number is added to the name
+     * @param cellSize is the size in pixels of each cell of a chart image
+     * @param dpi is the resolution of page images and the PDF file
+     * @param pages is true to render the printer pages to images rather than the chart
+     * @param jobs is the maximum number of threads used, 0 to use the number of processors
+     *
+     * @return 0 if the document was rendered, 1 otherwise
+     */
+    static int run(const QString &source, const QString &output, int cellSize, int dpi, bool pages, int jobs);
+};
+
+#endif // PatternExporter_H
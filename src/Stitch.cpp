@@ -15,6 +15,8 @@
 
 #include "Stitch.h"
 
+#include <QVector>
+
 #include <KLocalizedString>
 
 #include "Exceptions.h"
@@ -38,6 +40,18 @@ Stitch::Stitch(Stitch::Type t, int i)
 {
 }
 
+/**
+    Test if a value read from a file is one of the stitch types that can be in a cell.
+    @param type the value to test
+    @return true if the value is a valid stitch type
+    */
+bool Stitch::isValidType(int type)
+{
+    static const StitchMask cellTypes = StitchMask::all();
+
+    return (type >= 0) && (type < 256) && cellTypes.contains(static_cast<Stitch::Type>(type));
+}
+
 QDataStream &operator<<(QDataStream &stream, const Stitch &stitch)
 {
     stream << qint32(stitch.version);
@@ -70,6 +84,38 @@ QDataStream &operator>>(QDataStream &stream, Stitch &stitch)
     return stream;
 }
 
+/**
+    Constructor.
+    Creates an empty mask, add the stitch types to be included with operator<<.
+    */
+StitchMask::StitchMask()
+{
+}
+
+/**
+    Test if all the stitch types that can be in a cell are included in the mask.
+    @return true if all the stitch types are included
+    */
+bool StitchMask::containsAll() const
+{
+    static const StitchMask allTypes = all();
+
+    return (m_types & allTypes.m_types) == allTypes.m_types;
+}
+
+/**
+    Create a mask including all the stitch types that can be in a cell.
+    @return a StitchMask
+    */
+StitchMask StitchMask::all()
+{
+    StitchMask mask;
+    mask << Stitch::TLQtr << Stitch::TRQtr << Stitch::BLQtr << Stitch::BTHalf << Stitch::TL3Qtr << Stitch::BRQtr << Stitch::TBHalf << Stitch::TR3Qtr
+         << Stitch::BL3Qtr << Stitch::BR3Qtr << Stitch::Full << Stitch::TLSmallHalf << Stitch::TRSmallHalf << Stitch::BLSmallHalf << Stitch::BRSmallHalf
+         << Stitch::TLSmallFull << Stitch::TRSmallFull << Stitch::BLSmallFull << Stitch::BRSmallFull;
+    return mask;
+}
+
 /**
     Constructor.
     */
@@ -205,6 +251,117 @@ int StitchQueue::add(Stitch::Type type, int colorIndex)
     return count();
 }
 
+/**
+    The stitches resulting from adding the quarter stitches of a cell, in the order
+    top left, top right, bottom left, bottom right, for one arrangement of colors.
+    */
+struct QuarterBlock {
+    int count; // the number of stitches
+    Stitch::Type types[4]; // the type of each stitch
+    int zones[4]; // the zone whose color each stitch has
+};
+
+/**
+    The number of arrangements of the colors of the four quarters of a cell. Each zone
+    is labelled 0 if it has no stitch, or one more than the first zone with the same
+    color, giving a code of four base 5 digits.
+    */
+static const int quarterBlockCodes = 5 * 5 * 5 * 5;
+
+/**
+    Create the table of stitches for each arrangement of quarter colors by adding the
+    quarters to a queue, so the result is the same as adding them one at a time.
+    @return a list of QuarterBlock indexed by the arrangement code
+    */
+static QVector<QuarterBlock> createQuarterBlocks()
+{
+    QVector<QuarterBlock> blocks(quarterBlockCodes);
+
+    for (int code = 0; code < quarterBlockCodes; ++code) {
+        QuarterBlock &block = blocks[code];
+        block.count = 0;
+
+        int labels[4];
+
+        for (int zone = 0, digits = code; zone < 4; ++zone, digits /= 5) {
+            labels[zone] = digits % 5;
+        }
+
+        StitchQueue queue;
+        bool canonical = true;
+
+        for (int zone = 0; zone < 4; ++zone) {
+            int label = labels[zone];
+
+            // the label of a zone refers to itself or to an earlier zone that is labelled with itself
+            if (label && ((label > zone + 1) || (labels[label - 1] != label))) {
+                canonical = false;
+                break;
+            }
+
+            if (label) {
+                queue.add(stitchMap[0][zone], label - 1);
+            }
+        }
+
+        if (canonical) {
+            for (const Stitch *stitch : std::as_const(queue)) {
+                block.types[block.count] = stitch->type;
+                block.zones[block.count] = stitch->colorIndex;
+                ++block.count;
+            }
+        }
+    }
+
+    return blocks;
+}
+
+/**
+    Create the queue of stitches for a cell from the colors of its four quarters, giving
+    the same stitches as adding each quarter with add, but classifying the arrangement of
+    colors and creating the final stitches directly. Matching quarters become half, three
+    quarter or full stitches.
+    @param colorIndexes the palette index of the top left, top right, bottom left and bottom right quarters, -1 for no stitch
+    @return a pointer to a new StitchQueue, or nullptr if there are no stitches
+    */
+StitchQueue *StitchQueue::fromQuarters(const int colorIndexes[4])
+{
+    static const QVector<QuarterBlock> blocks = createQuarterBlocks();
+
+    int code = 0;
+
+    for (int zone = 3; zone >= 0; --zone) {
+        int label = 0;
+
+        if (colorIndexes[zone] != -1) {
+            label = zone + 1;
+
+            for (int first = 0; first < zone; ++first) {
+                if (colorIndexes[first] == colorIndexes[zone]) {
+                    label = first + 1;
+                    break;
+                }
+            }
+        }
+
+        code = code * 5 + label;
+    }
+
+    const QuarterBlock &block = blocks.at(code);
+
+    if (block.count == 0) {
+        return nullptr;
+    }
+
+    StitchQueue *queue = new StitchQueue;
+
+    for (int i = 0; i < block.count; ++i) {
+        queue->enqueue(new Stitch(block.types[i], colorIndexes[block.zones[i]]));
+    }
+
+    return queue;
+}
+
 Stitch *StitchQueue::find(Stitch::Type type, int colorIndex)
 {
     int stitchCount = count();
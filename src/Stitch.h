@@ -15,6 +15,8 @@
 #include <QPoint>
 #include <QQueue>
 
+#include <bitset>
+
 class Stitch
 {
 public:
@@ -45,6 +47,8 @@ public:
     Stitch();
     Stitch(Stitch::Type, int);
 
+    static bool isValidType(int);
+
     static const int version = 100;
 
     Stitch::Type type;
@@ -54,6 +58,30 @@ public:
 QDataStream &operator<<(QDataStream &, const Stitch &);
 QDataStream &operator>>(QDataStream &, Stitch &);
 
+class StitchMask
+{
+public:
+    StitchMask();
+
+    StitchMask &operator<<(Stitch::Type type)
+    {
+        m_types.set(type);
+        return *this;
+    }
+
+    bool contains(Stitch::Type type) const
+    {
+        return m_types.test(type);
+    }
+
+    bool containsAll() const;
+
+    static StitchMask all();
+
+private:
+    std::bitset<256> m_types;
+};
+
 class StitchQueue : public QQueue<Stitch *>
 {
 public:
@@ -65,6 +93,8 @@ public:
     Stitch *find(Stitch::Type, int);
     int remove(Stitch::Type, int);
 
+    static StitchQueue *fromQuarters(const int colorIndexes[4]);
+
     static const int version = 100;
 };
 
@@ -10,10 +10,16 @@
 
 #include "StitchData.h"
 
+#include <QtConcurrent>
+#include <QtEndian>
+
 #include <KLocalizedString>
 
 #include "Exceptions.h"
 
+#include <limits>
+#include <utility>
+
 FlossUsage::FlossUsage()
     : backstitchCount(0)
     , backstitchLength(0.0)
@@ -55,16 +61,82 @@ int FlossUsage::stitchCount() const
 StitchData::StitchData()
     : m_width(0)
     , m_height(0)
+    , m_allCellsChanged(true)
+    , m_allBackstitchesChanged(true)
+    , m_allKnotsChanged(true)
 {
 }
 
+StitchData::StitchData(const StitchData &other)
+    : m_width(0)
+    , m_height(0)
+    , m_allCellsChanged(true)
+    , m_allBackstitchesChanged(true)
+    , m_allKnotsChanged(true)
+{
+    *this = other;
+}
+
 StitchData::~StitchData()
 {
     clear();
 }
 
+StitchData &StitchData::operator=(const StitchData &other)
+{
+    if (this != &other) {
+        clear();
+
+        m_width = other.m_width;
+        m_height = other.m_height;
+        m_stitches.fill(nullptr, other.m_stitches.count());
+
+        for (int i = 0; i < other.m_stitches.count(); ++i) {
+            if (StitchQueue *stitchQueue = other.m_stitches.at(i)) {
+                m_stitches[i] = new StitchQueue(stitchQueue);
+            }
+        }
+
+        QListIterator<Backstitch *> backstitchIterator(other.m_backstitches);
+
+        while (backstitchIterator.hasNext()) {
+            m_backstitches.append(new Backstitch(*backstitchIterator.next()));
+        }
+
+        QListIterator<Knot *> knotIterator(other.m_knots);
+
+        while (knotIterator.hasNext()) {
+            m_knots.append(new Knot(*knotIterator.next()));
+        }
+
+        // the contents were replaced rather than cleared
+        markChanged();
+    }
+
+    return *this;
+}
+
+/**
+    Exchange the contents of this StitchData with another without copying the stitches.
+    Both are marked as changed.
+    @param other the StitchData to exchange contents with
+    */
+void StitchData::swap(StitchData &other)
+{
+    std::swap(m_width, other.m_width);
+    std::swap(m_height, other.m_height);
+    m_stitches.swap(other.m_stitches);
+    m_backstitches.swap(other.m_backstitches);
+    m_knots.swap(other.m_knots);
+
+    markChanged();
+    other.markChanged();
+}
+
 void StitchData::clear()
 {
+    beginOperation(Operation{Operation::Clear});
+
     qDeleteAll(m_stitches);
     m_stitches.fill(nullptr);
 
@@ -73,6 +145,8 @@ void StitchData::clear()
 
     qDeleteAll(m_knots);
     m_knots.clear();
+
+    endOperation();
 }
 
 int StitchData::width() const
@@ -86,6 +160,19 @@ int StitchData::height() const
 }
 
 void StitchData::resize(int width, int height)
+{
+    beginOperation(Operation{Operation::Resize, width, height});
+    resizeQueues(width, height);
+    endOperation();
+}
+
+/**
+    Change the size of the stitch queues, keeping each queue at the same position. The pattern
+    must fit within the new size.
+    @param width the new width
+    @param height the new height
+    */
+void StitchData::resizeQueues(int width, int height)
 {
     QVector<StitchQueue *> newVector(width * height);
     QRect extentsRect = extents();
@@ -103,9 +190,11 @@ void StitchData::resize(int width, int height)
 
 void StitchData::insertColumns(int startColumn, int columns)
 {
+    beginOperation(Operation{Operation::InsertColumns, startColumn, columns});
+
     int originalWidth = m_width;
 
-    resize(originalWidth + columns, m_height);
+    resizeQueues(originalWidth + columns, m_height);
 
     for (int y = 0; y < m_height; ++y) {
         for (int destinationColumn = m_width - 1, sourceColumn = originalWidth - 1; sourceColumn >= startColumn; --destinationColumn, --sourceColumn) {
@@ -139,13 +228,17 @@ void StitchData::insertColumns(int startColumn, int columns)
             knot->position.setX(knot->position.x() + columns);
         }
     }
+
+    endOperation();
 }
 
 void StitchData::insertRows(int startRow, int rows)
 {
+    beginOperation(Operation{Operation::InsertRows, startRow, rows});
+
     int originalHeight = m_height;
 
-    resize(m_width, originalHeight + rows);
+    resizeQueues(m_width, originalHeight + rows);
 
     for (int destinationRow = m_height - 1, sourceRow = originalHeight - 1; sourceRow >= startRow; --destinationRow, --sourceRow) {
         for (int x = 0; x < m_width; ++x) {
@@ -179,10 +272,14 @@ void StitchData::insertRows(int startRow, int rows)
             knot->position.setY(knot->position.y() + rows);
         }
     }
+
+    endOperation();
 }
 
 void StitchData::removeColumns(int startColumn, int columns)
 {
+    beginOperation(Operation{Operation::RemoveColumns, startColumn, columns});
+
     for (int y = 0; y < m_height; ++y) {
         for (int destinationColumn = startColumn, sourceColumn = startColumn + columns; sourceColumn < m_width; ++destinationColumn, ++sourceColumn) {
             m_stitches[index(destinationColumn, y)] = takeStitchQueueAt(sourceColumn, y);
@@ -216,11 +313,14 @@ void StitchData::removeColumns(int startColumn, int columns)
         }
     }
 
-    resize(m_width - columns, m_height);
+    resizeQueues(m_width - columns, m_height);
+    endOperation();
 }
 
 void StitchData::removeRows(int startRow, int rows)
 {
+    beginOperation(Operation{Operation::RemoveRows, startRow, rows});
+
     for (int destinationRow = startRow, sourceRow = startRow + rows; sourceRow < m_height; ++destinationRow, ++sourceRow) {
         for (int x = 0; x < m_width; ++x) {
             m_stitches[index(x, destinationRow)] = takeStitchQueueAt(x, sourceRow);
@@ -254,7 +354,8 @@ void StitchData::removeRows(int startRow, int rows)
         }
     }
 
-    resize(m_width, m_height - rows);
+    resizeQueues(m_width, m_height - rows);
+    endOperation();
 }
 
 QRect StitchData::extents() const
@@ -294,6 +395,8 @@ QRect StitchData::extents() const
 
 void StitchData::movePattern(int dx, int dy)
 {
+    beginOperation(Operation{Operation::Move, dx, dy});
+
     QRect extentsRect = extents();
 
     QVector<StitchQueue *> newVector(m_width * m_height);
@@ -320,10 +423,14 @@ void StitchData::movePattern(int dx, int dy)
     while (knotIterator.hasNext()) {
         knotIterator.next()->move(dx, dy);
     }
+
+    endOperation();
 }
 
 void StitchData::mirror(Qt::Orientation orientation)
 {
+    beginOperation(Operation{Operation::Mirror, int(orientation)});
+
     int rows = m_height;
     int cols = m_width;
 
@@ -386,10 +493,14 @@ void StitchData::mirror(Qt::Orientation orientation)
             knot->position.setY(maxYSnap - knot->position.y());
         }
     }
+
+    endOperation();
 }
 
 void StitchData::rotate(Rotation rotation)
 {
+    beginOperation(Operation{Operation::Rotate, int(rotation)});
+
     int rows = m_height;
     int cols = m_width;
 
@@ -473,6 +584,8 @@ void StitchData::rotate(Rotation rotation)
             break;
         }
     }
+
+    endOperation();
 }
 
 void StitchData::invertQueue(Qt::Orientation orientation, StitchQueue *queue)
@@ -620,6 +733,13 @@ bool StitchData::isValid(int x, int y) const
     return ((x >= 0) && (x < m_width) && (y >= 0) && (y < m_height));
 }
 
+void StitchData::cellChanged(int i)
+{
+    if (!m_allCellsChanged) {
+        m_changedCells.insert(i);
+    }
+}
+
 void StitchData::addStitch(const QPoint &position, Stitch::Type type, int colorIndex)
 {
     int i = index(position);
@@ -631,6 +751,7 @@ void StitchData::addStitch(const QPoint &position, Stitch::Type type, int colorI
     }
 
     stitchQueue->add(type, colorIndex);
+    cellChanged(i);
 }
 
 Stitch *StitchData::findStitch(const QPoint &cell, Stitch::Type type, int colorIndex)
@@ -657,6 +778,8 @@ void StitchData::deleteStitch(const QPoint &position, Stitch::Type type, int col
             m_stitches[i] = nullptr;
             delete stitchQueue;
         }
+
+        cellChanged(i);
     }
 }
 
@@ -682,6 +805,7 @@ StitchQueue *StitchData::takeStitchQueueAt(int x, int y)
 
     if (stitchQueue) {
         m_stitches[index(x, y)] = nullptr;
+        cellChanged(index(x, y));
     }
 
     return stitchQueue;
@@ -698,6 +822,7 @@ StitchQueue *StitchData::replaceStitchQueueAt(int x, int y, StitchQueue *stitchQ
 
     if (isValid(x, y)) {
         m_stitches[index(x, y)] = stitchQueue;
+        cellChanged(index(x, y));
     }
 
     return originalQueue;
@@ -708,14 +833,73 @@ StitchQueue *StitchData::replaceStitchQueueAt(const QPoint &position, StitchQueu
     return replaceStitchQueueAt(position.x(), position.y(), stitchQueue);
 }
 
+/**
+    Copy the stitches of an area of another StitchData to the top left of this one, replacing
+    any existing stitches. The cells are copied a row at a time, only cells with stitches
+    are visited.
+    @param source the StitchData to copy from
+    @param area the area of source to copy, cells outside of source are treated as empty
+    */
+void StitchData::copyStitchQueues(const StitchData &source, const QRect &area)
+{
+    QRect sourceArea = area & QRect(0, 0, source.m_width, source.m_height);
+    QPoint offset = sourceArea.topLeft() - area.topLeft();
+
+    for (int y = sourceArea.top(); y <= sourceArea.bottom(); ++y) {
+        if (!isValid(offset.x(), y - area.top())) {
+            break;
+        }
+
+        StitchQueue *const *sourceRow = source.m_stitches.constData() + source.index(sourceArea.left(), y);
+        int columns = qMin(sourceArea.width(), m_width - offset.x());
+
+        for (int x = 0; x < columns; ++x) {
+            if (StitchQueue *stitchQueue = sourceRow[x]) {
+                delete replaceStitchQueueAt(offset.x() + x, y - area.top(), new StitchQueue(stitchQueue));
+            }
+        }
+    }
+}
+
+/**
+    Move the stitches of an area of another StitchData to the top left of this one, replacing
+    any existing stitches. The stitch queues are transferred rather than copied and the cells
+    of the source are left empty.
+    @param source the StitchData to move from
+    @param area the area of source to move, cells outside of source are treated as empty
+    */
+void StitchData::moveStitchQueues(StitchData &source, const QRect &area)
+{
+    QRect sourceArea = area & QRect(0, 0, source.m_width, source.m_height);
+    QPoint offset = sourceArea.topLeft() - area.topLeft();
+
+    for (int y = sourceArea.top(); y <= sourceArea.bottom(); ++y) {
+        if (!isValid(offset.x(), y - area.top())) {
+            break;
+        }
+
+        int sourceIndex = source.index(sourceArea.left(), y);
+        StitchQueue **sourceRow = source.m_stitches.data() + sourceIndex;
+        int columns = qMin(sourceArea.width(), m_width - offset.x());
+
+        for (int x = 0; x < columns; ++x) {
+            if (StitchQueue *stitchQueue = sourceRow[x]) {
+                sourceRow[x] = nullptr;
+                source.cellChanged(sourceIndex + x);
+                delete replaceStitchQueueAt(offset.x() + x, y - area.top(), stitchQueue);
+            }
+        }
+    }
+}
+
 void StitchData::addBackstitch(const QPoint &start, const QPoint &end, int colorIndex)
 {
-    m_backstitches.append(new Backstitch(start, end, colorIndex));
+    appendBackstitch(new Backstitch(start, end, colorIndex));
 }
 
 void StitchData::addBackstitch(Backstitch *backstitch)
 {
-    m_backstitches.append(backstitch);
+    appendBackstitch(backstitch);
 }
 
 Backstitch *StitchData::findBackstitch(const QPoint &start, const QPoint &end, int colorIndex)
@@ -735,7 +919,10 @@ Backstitch *StitchData::findBackstitch(const QPoint &start, const QPoint &end, i
 Backstitch *StitchData::takeBackstitch(const QPoint &start, const QPoint &end, int colorIndex)
 {
     Backstitch *removed = findBackstitch(start, end, colorIndex);
-    m_backstitches.removeOne(removed);
+
+    if (removed) {
+        removeBackstitch(removed);
+    }
 
     return removed;
 }
@@ -744,7 +931,7 @@ Backstitch *StitchData::takeBackstitch(Backstitch *backstitch)
 {
     Backstitch *removed = nullptr;
 
-    if (m_backstitches.removeOne(backstitch)) {
+    if (removeBackstitch(backstitch)) {
         removed = backstitch;
     }
 
@@ -753,12 +940,12 @@ Backstitch *StitchData::takeBackstitch(Backstitch *backstitch)
 
 void StitchData::addFrenchKnot(const QPoint &position, int colorIndex)
 {
-    m_knots.append(new Knot(position, colorIndex));
+    appendKnot(new Knot(position, colorIndex));
 }
 
 void StitchData::addFrenchKnot(Knot *knot)
 {
-    m_knots.append(knot);
+    appendKnot(knot);
 }
 
 Knot *StitchData::findKnot(const QPoint &position, int colorIndex)
@@ -780,7 +967,7 @@ Knot *StitchData::takeFrenchKnot(const QPoint &position, int colorIndex)
     Knot *removed = findKnot(position, colorIndex);
 
     if (removed) {
-        m_knots.removeOne(removed);
+        removeKnot(removed);
     }
 
     return removed;
@@ -790,13 +977,77 @@ Knot *StitchData::takeFrenchKnot(Knot *knot)
 {
     Knot *removed = nullptr;
 
-    if (m_knots.removeOne(knot)) {
+    if (removeKnot(knot)) {
         removed = knot;
     }
 
     return removed;
 }
 
+/**
+    Record a change to the backstitches or knots. Once there are more changes than items
+    it is cheaper to record all the items, so the changes are discarded.
+    @param changes the list of changes to append to
+    @param allChanged set to true when all the items are to be recorded
+    @param index the index of a removed item, or -1 for an appended item
+    @param item the appended item
+    @param count the number of items after the change
+    */
+template <class T>
+static void recordChange(QVector<QPair<int, T>> &changes, bool &allChanged, int index, const T &item, int count)
+{
+    if (allChanged) {
+        return;
+    }
+
+    changes.append(qMakePair(index, item));
+
+    if (changes.count() > count) {
+        allChanged = true;
+        changes.clear();
+    }
+}
+
+void StitchData::appendBackstitch(Backstitch *backstitch)
+{
+    m_backstitches.append(backstitch);
+    recordChange(m_backstitchChanges, m_allBackstitchesChanged, -1, *backstitch, m_backstitches.count());
+}
+
+bool StitchData::removeBackstitch(Backstitch *backstitch)
+{
+    int i = m_backstitches.indexOf(backstitch);
+
+    if (i == -1) {
+        return false;
+    }
+
+    m_backstitches.removeAt(i);
+    recordChange(m_backstitchChanges, m_allBackstitchesChanged, i, Backstitch(), m_backstitches.count());
+
+    return true;
+}
+
+void StitchData::appendKnot(Knot *knot)
+{
+    m_knots.append(knot);
+    recordChange(m_knotChanges, m_allKnotsChanged, -1, *knot, m_knots.count());
+}
+
+bool StitchData::removeKnot(Knot *knot)
+{
+    int i = m_knots.indexOf(knot);
+
+    if (i == -1) {
+        return false;
+    }
+
+    m_knots.removeAt(i);
+    recordChange(m_knotChanges, m_allKnotsChanged, i, Knot(), m_knots.count());
+
+    return true;
+}
+
 QList<Backstitch *> &StitchData::backstitches()
 {
     return m_backstitches;
@@ -814,6 +1065,10 @@ QListIterator<Backstitch *> StitchData::backstitchIterator()
 
 QMutableListIterator<Backstitch *> StitchData::mutableBackstitchIterator()
 {
+    // changes made through the iterator can not be recorded individually
+    m_allBackstitchesChanged = true;
+    m_backstitchChanges.clear();
+
     return QMutableListIterator<Backstitch *>(m_backstitches);
 }
 
@@ -824,6 +1079,10 @@ QListIterator<Knot *> StitchData::knotIterator()
 
 QMutableListIterator<Knot *> StitchData::mutableKnotIterator()
 {
+    // changes made through the iterator can not be recorded individually
+    m_allKnotsChanged = true;
+    m_knotChanges.clear();
+
     return QMutableListIterator<Knot *>(m_knots);
 }
 
@@ -891,33 +1150,579 @@ QMap<int, FlossUsage> StitchData::flossUsage()
     return usage;
 }
 
+/**
+    The number of rows of stitches remapped together by one thread.
+    */
+static const int remapBlockRows = 32;
+
+/**
+    Create lookup tables from a map of color indexes.
+    @param colorIndexes the map of original color indexes to their new color indexes
+    @param table set to the new color index for each original color index, -1 where the color is not remapped
+    @param targets set to true for each color index that is a new color index
+    */
+static void createRemapTables(const QMap<int, int> &colorIndexes, QVector<int> &table, QVector<bool> &targets)
+{
+    int size = 0;
+
+    for (QMap<int, int>::const_iterator i = colorIndexes.constBegin(); i != colorIndexes.constEnd(); ++i) {
+        size = qMax(size, qMax(i.key(), i.value()) + 1);
+    }
+
+    table.fill(-1, size);
+    targets.fill(false, size);
+
+    for (QMap<int, int>::const_iterator i = colorIndexes.constBegin(); i != colorIndexes.constEnd(); ++i) {
+        if (i.key() >= 0) {
+            table[i.key()] = i.value();
+        }
+
+        if (i.value() >= 0) {
+            targets[i.value()] = true;
+        }
+    }
+}
+
+/**
+    Change the color indexes of the stitches, backstitches and knots using a table of original
+    to new color indexes. The rows of stitches are divided into blocks remapped in parallel.
+    Every item that has one of the new color indexes afterwards is recorded in the returned
+    changes, in the order of the stitch data, as changed or already having that color. Passing
+    the inverse map and the changes to the other remapColors function reverses the remap, even
+    where the colors were merged.
+    @param colorIndexes the map of original color indexes to their new color indexes
+    @return the changes, one bit array for each block of rows followed by one for the backstitches and knots
+    */
+StitchData::ColorChanges StitchData::remapColors(const QMap<int, int> &colorIndexes)
+{
+    beginOperation(Operation{Operation::RemapColors, 0, 0, colorIndexes});
+
+    QVector<int> table;
+    QVector<bool> targets;
+    createRemapTables(colorIndexes, table, targets);
+
+    auto remap = [&table, &targets](int &colorIndex, QBitArray &itemChanges, int &count) {
+        int newIndex = (colorIndex >= 0 && colorIndex < table.count()) ? table.at(colorIndex) : -1;
+        bool changed = (newIndex != -1) && (newIndex != colorIndex);
+
+        if (changed) {
+            colorIndex = newIndex;
+        }
+
+        if (colorIndex >= 0 && colorIndex < targets.count() && targets.at(colorIndex)) {
+            if (count == itemChanges.size()) {
+                itemChanges.resize(qMax(64, count * 2));
+            }
+
+            itemChanges.setBit(count++, changed);
+        }
+    };
+
+    int blocks = (m_height + remapBlockRows - 1) / remapBlockRows;
+    ColorChanges changes(blocks + 1);
+    QBitArray *blockChanges = changes.data();
+    StitchQueue *const *stitches = m_stitches.constData();
+    QVector<int> blockIndexes(blocks);
+
+    for (int block = 0; block < blocks; ++block) {
+        blockIndexes[block] = block;
+    }
+
+    QtConcurrent::blockingMap(blockIndexes, [&](int block) {
+        int count = 0;
+        int first = index(0, block * remapBlockRows);
+        int last = index(0, qMin(m_height, (block + 1) * remapBlockRows));
+
+        for (int i = first; i < last; ++i) {
+            if (StitchQueue *stitchQueue = stitches[i]) {
+                for (Stitch *stitch : std::as_const(*stitchQueue)) {
+                    remap(stitch->colorIndex, blockChanges[block], count);
+                }
+            }
+        }
+
+        blockChanges[block].truncate(count);
+    });
+
+    int count = 0;
+
+    for (Backstitch *backstitch : std::as_const(m_backstitches)) {
+        remap(backstitch->colorIndex, changes[blocks], count);
+    }
+
+    for (Knot *knot : std::as_const(m_knots)) {
+        remap(knot->colorIndex, changes[blocks], count);
+    }
+
+    changes[blocks].truncate(count);
+
+    endOperation();
+
+    return changes;
+}
+
+/**
+    Change the color indexes of the recorded stitches, backstitches and knots using a table of
+    original to new color indexes. Each item with one of the original color indexes is changed
+    if its bit in changes is set, so the stitch data must be the same as when the changes were
+    returned from remapColors.
+    @param colorIndexes the map of original color indexes to their new color indexes
+    @param changes the changes returned by remapColors
+    */
+void StitchData::remapColors(const QMap<int, int> &colorIndexes, const ColorChanges &changes)
+{
+    beginOperation(Operation{Operation::RestoreColors, 0, 0, colorIndexes, changes});
+
+    QVector<int> table;
+    QVector<bool> targets;
+    createRemapTables(colorIndexes, table, targets);
+
+    auto remap = [&table](int &colorIndex, const QBitArray &itemChanges, int &count) {
+        int newIndex = (colorIndex >= 0 && colorIndex < table.count()) ? table.at(colorIndex) : -1;
+
+        if (newIndex != -1) {
+            if ((count < itemChanges.size()) && itemChanges.testBit(count)) {
+                colorIndex = newIndex;
+            }
+
+            ++count;
+        }
+    };
+
+    int blocks = (m_height + remapBlockRows - 1) / remapBlockRows;
+    Q_ASSERT(changes.count() == blocks + 1);
+
+    StitchQueue *const *stitches = m_stitches.constData();
+    QVector<int> blockIndexes(blocks);
+
+    for (int block = 0; block < blocks; ++block) {
+        blockIndexes[block] = block;
+    }
+
+    QtConcurrent::blockingMap(blockIndexes, [&](int block) {
+        int count = 0;
+        int first = index(0, block * remapBlockRows);
+        int last = index(0, qMin(m_height, (block + 1) * remapBlockRows));
+
+        for (int i = first; i < last; ++i) {
+            if (StitchQueue *stitchQueue = stitches[i]) {
+                for (Stitch *stitch : std::as_const(*stitchQueue)) {
+                    remap(stitch->colorIndex, changes.at(block), count);
+                }
+            }
+        }
+    });
+
+    int count = 0;
+
+    for (Backstitch *backstitch : std::as_const(m_backstitches)) {
+        remap(backstitch->colorIndex, changes.at(blocks), count);
+    }
+
+    for (Knot *knot : std::as_const(m_knots)) {
+        remap(knot->colorIndex, changes.at(blocks), count);
+    }
+
+    endOperation();
+}
+
+void StitchData::markChanged()
+{
+    m_allCellsChanged = true;
+    m_changedCells.clear();
+    m_allBackstitchesChanged = true;
+    m_backstitchChanges.clear();
+    m_allKnotsChanged = true;
+    m_knotChanges.clear();
+    m_operations.clear();
+}
+
+bool StitchData::allCellsChanged() const
+{
+    return m_allCellsChanged;
+}
+
+QSet<int> StitchData::changedCells() const
+{
+    return m_changedCells;
+}
+
+/**
+    Test if the backstitches need to be recorded in full rather than from backstitchChanges().
+    This is the case after markChanged() or when there were more changes than backstitches.
+    @return true if all the backstitches have changed, false otherwise
+    */
+bool StitchData::allBackstitchesChanged() const
+{
+    return m_allBackstitchesChanged;
+}
+
+/**
+    Get the changes made to the backstitches since resetChanges() in the order they were made.
+    Each change has the index of a removed backstitch, or -1 and the appended backstitch.
+    @return the BackstitchChanges
+    */
+StitchData::BackstitchChanges StitchData::backstitchChanges() const
+{
+    return m_backstitchChanges;
+}
+
+/**
+    Test if the knots need to be recorded in full rather than from knotChanges().
+    This is the case after markChanged() or when there were more changes than knots.
+    @return true if all the knots have changed, false otherwise
+    */
+bool StitchData::allKnotsChanged() const
+{
+    return m_allKnotsChanged;
+}
+
+/**
+    Get the changes made to the knots since resetChanges() in the order they were made.
+    Each change has the index of a removed knot, or -1 and the appended knot.
+    @return the KnotChanges
+    */
+StitchData::KnotChanges StitchData::knotChanges() const
+{
+    return m_knotChanges;
+}
+
+/**
+    Get the operations on the whole of the stitch data made since resetChanges() in the order
+    they were made. Repeating them with applyOperation() is much cheaper than recording every
+    cell they change. They were all made before the changes in changedCells(), backstitchChanges()
+    and knotChanges().
+    @return the Operations
+    */
+StitchData::Operations StitchData::operations() const
+{
+    return m_operations;
+}
+
+/**
+    Test if a size is valid for the stitch data.
+    @param width the width
+    @param height the height
+    @return true if the size is valid, false otherwise
+    */
+static bool isValidSize(qint64 width, qint64 height)
+{
+    return (width > 0) && (height > 0) && (width * height <= std::numeric_limits<int>::max());
+}
+
+/**
+    Test if the pattern fits within an area of the stitch data.
+    @param extents the extents of the pattern
+    @param area the area
+    @return true if the pattern fits, false otherwise
+    */
+static bool fits(const QRect &extents, const QRect &area)
+{
+    return !extents.isValid() || area.contains(extents);
+}
+
+/**
+    Repeat an operation returned by operations(), used when replaying a journal. As the
+    operation may have been read from a damaged file it is checked against the stitch data
+    before it is made.
+    @param operation the Operation to repeat
+    @return true if the operation was made, false if it is not valid for the stitch data
+    */
+bool StitchData::applyOperation(const Operation &operation)
+{
+    const int first = operation.first;
+    const int second = operation.second;
+
+    switch (operation.type) {
+    case Operation::Clear:
+        clear();
+        break;
+
+    case Operation::Resize:
+        if (!isValidSize(first, second) || !fits(extents(), QRect(0, 0, first, second))) {
+            return false;
+        }
+
+        resize(first, second);
+        break;
+
+    case Operation::InsertColumns:
+        if ((first < 0) || (first > m_width) || (second <= 0) || !isValidSize(qint64(m_width) + second, m_height)) {
+            return false;
+        }
+
+        insertColumns(first, second);
+        break;
+
+    case Operation::InsertRows:
+        if ((first < 0) || (first > m_height) || (second <= 0) || !isValidSize(m_width, qint64(m_height) + second)) {
+            return false;
+        }
+
+        insertRows(first, second);
+        break;
+
+    case Operation::RemoveColumns:
+        if ((first < 0) || (second <= 0) || (qint64(first) + second > m_width)) {
+            return false;
+        }
+
+        removeColumns(first, second);
+        break;
+
+    case Operation::RemoveRows:
+        if ((first < 0) || (second <= 0) || (qint64(first) + second > m_height)) {
+            return false;
+        }
+
+        removeRows(first, second);
+        break;
+
+    case Operation::Move:
+        if ((qAbs(first) > m_width) || (qAbs(second) > m_height) || !fits(extents().translated(first, second), QRect(0, 0, m_width, m_height))) {
+            return false;
+        }
+
+        movePattern(first, second);
+        break;
+
+    case Operation::Mirror:
+        if ((first != Qt::Horizontal) && (first != Qt::Vertical)) {
+            return false;
+        }
+
+        mirror(Qt::Orientation(first));
+        break;
+
+    case Operation::Rotate:
+        if ((first < Rotate90) || (first > Rotate270)) {
+            return false;
+        }
+
+        rotate(Rotation(first));
+        break;
+
+    case Operation::RemapColors:
+    case Operation::RestoreColors:
+        for (QMap<int, int>::const_iterator i = operation.colorIndexes.constBegin(); i != operation.colorIndexes.constEnd(); ++i) {
+            // a color index larger than any palette would create a very large table
+            if ((i.key() < 0) || (i.key() > std::numeric_limits<quint16>::max()) || (i.value() < 0) || (i.value() > std::numeric_limits<quint16>::max())) {
+                return false;
+            }
+        }
+
+        if (operation.type == Operation::RemapColors) {
+            remapColors(operation.colorIndexes);
+        } else if (operation.colorChanges.count() == (m_height + remapBlockRows - 1) / remapBlockRows + 1) {
+            remapColors(operation.colorIndexes, operation.colorChanges);
+        } else {
+            return false;
+        }
+
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+void StitchData::resetChanges()
+{
+    m_allCellsChanged = false;
+    m_changedCells.clear();
+    m_allBackstitchesChanged = false;
+    m_backstitchChanges.clear();
+    m_allKnotsChanged = false;
+    m_knotChanges.clear();
+    m_operations.clear();
+}
+
+/**
+    The largest number of operations recorded, as the changes of stitch data that is not journaled
+    are never reset.
+    */
+static const int maximumOperations = 64;
+
+/**
+    Record an operation on the whole of the stitch data so it can be repeated rather than
+    recording every cell it changes. Changes recorded individually before the operation would
+    be at their positions from before it, so in that case, or when there are already
+    maximumOperations, everything is marked as changed instead. The cells changed by the operation itself are discarded by endOperation().
+    @param operation the Operation about to be made
+    */
+void StitchData::beginOperation(const Operation &operation)
+{
+    if (!m_allCellsChanged && m_changedCells.isEmpty() && m_backstitchChanges.isEmpty() && m_knotChanges.isEmpty()
+        && (m_operations.count() < maximumOperations)) {
+        m_operations.append(operation);
+    } else {
+        markChanged();
+    }
+}
+
+/**
+    Complete an operation started by beginOperation().
+    */
+void StitchData::endOperation()
+{
+    if (!m_allCellsChanged) {
+        m_changedCells.clear();
+    }
+}
+
+/**
+    Append an unsigned value to a buffer as a variable length integer, seven bits
+    per byte with the high bit set on all but the last byte.
+    @param buffer the buffer to append to
+    @param value the value to append
+    */
+static void appendVarint(QByteArray &buffer, quint32 value)
+{
+    while (value >= 0x80) {
+        buffer.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+
+    buffer.append(char(value));
+}
+
+/**
+    Read a variable length integer written by appendVarint.
+    @param buffer the buffer to read from
+    @param position the position to read from, updated to the following value
+    @return the value read
+    */
+static quint32 readVarint(const QByteArray &buffer, int &position)
+{
+    quint32 value = 0;
+    int shift = 0;
+
+    while (position < buffer.size() && shift < 32) {
+        quint8 byte = quint8(buffer.at(position++));
+        value |= quint32(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+
+        shift += 7;
+    }
+
+    throw FailedReadFile(QString(i18n("Invalid stitch data encoding")));
+}
+
+QDataStream &operator<<(QDataStream &stream, const StitchData::Operation &operation)
+{
+    stream << qint32(operation.type);
+    stream << qint32(operation.first);
+    stream << qint32(operation.second);
+    stream << operation.colorIndexes;
+    stream << operation.colorChanges;
+
+    return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, StitchData::Operation &operation)
+{
+    qint32 type;
+    qint32 first;
+    qint32 second;
+
+    stream >> type;
+    stream >> first;
+    stream >> second;
+    stream >> operation.colorIndexes;
+    stream >> operation.colorChanges;
+
+    if ((type < StitchData::Operation::Clear) || (type > StitchData::Operation::RestoreColors)) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+    }
+
+    operation.type = StitchData::Operation::Type(type);
+    operation.first = first;
+    operation.second = second;
+
+    return stream;
+}
+
 QDataStream &operator<<(QDataStream &stream, const StitchData &stitchData)
 {
     stream << qint32(stitchData.version);
     stream << qint32(stitchData.m_width);
     stream << qint32(stitchData.m_height);
 
-    QVectorIterator<StitchQueue *> stitchesIterator(stitchData.m_stitches);
-    int queues = 0;
+    /* The stitch queues are written as columns rather than individually.
+     * positions    runs of occupied cells in row order, each as the gap from the end of the previous run and the run length
+     * counts       the number of stitches in each occupied cell
+     * types        the type of each stitch, one byte each
+     * colors       the color index of each stitch, colorSize bytes each, little endian
+     */
+    QByteArray positions;
+    QByteArray counts;
+    QByteArray types;
+    QVector<int> colorIndexes;
+    int cells = 0;
+    int maximumColorIndex = 0;
+    int runStart = -1;
+    int previousRunEnd = 0;
+    int cellCount = stitchData.m_stitches.count();
+
+    for (int i = 0; i <= cellCount; ++i) {
+        StitchQueue *stitchQueue = (i < cellCount) ? stitchData.m_stitches.at(i) : nullptr;
 
-    while (stitchesIterator.hasNext()) {
-        if (stitchesIterator.next()) {
-            ++queues;
+        if (stitchQueue) {
+            if (runStart == -1) {
+                runStart = i;
+            }
+
+            ++cells;
+            appendVarint(counts, stitchQueue->count());
+
+            for (const Stitch *stitch : std::as_const(*stitchQueue)) {
+                types.append(char(stitch->type));
+                colorIndexes.append(stitch->colorIndex);
+                maximumColorIndex = qMax(maximumColorIndex, stitch->colorIndex);
+            }
+        } else if (runStart != -1) {
+            appendVarint(positions, runStart - previousRunEnd);
+            appendVarint(positions, i - runStart);
+            previousRunEnd = i;
+            runStart = -1;
         }
     }
 
-    stream << qint32(queues);
+    qint8 colorSize = (maximumColorIndex < 0x100) ? 1 : (maximumColorIndex < 0x10000) ? 2 : 4;
+    QByteArray colors(colorIndexes.count() * colorSize, Qt::Uninitialized);
+    char *color = colors.data();
 
-    for (int row = 0; row < stitchData.m_height; ++row) {
-        for (int column = 0; column < stitchData.m_width; ++column) {
-            if (StitchQueue *stitchQueue = stitchData.m_stitches[stitchData.index(column, row)]) {
-                stream << qint32(column);
-                stream << qint32(row);
-                stream << *stitchQueue;
-            }
+    for (int colorIndex : std::as_const(colorIndexes)) {
+        switch (colorSize) {
+        case 1:
+            *color = char(colorIndex);
+            break;
+
+        case 2:
+            qToLittleEndian<quint16>(colorIndex, color);
+            break;
+
+        default:
+            qToLittleEndian<quint32>(colorIndex, color);
+            break;
         }
+
+        color += colorSize;
     }
 
+    stream << qint32(cells);
+    stream << qint32(types.size());
+    stream << positions;
+    stream << counts;
+    stream << types;
+    stream << colorSize;
+    stream << colors;
+
     QListIterator<Backstitch *> backstitchIterator(stitchData.m_backstitches);
     stream << qint32(stitchData.m_backstitches.count());
 
@@ -956,13 +1761,105 @@ QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
     qint32 columns;
     qint32 rows;
     qint32 count;
-    QHash<int, QHash<int, StitchQueue *>> stitches;
 
     stitchData.clear();
 
     stream >> version;
 
     switch (version) {
+    case 104: {
+        qint32 cells;
+        qint32 stitchCount;
+        qint8 colorSize;
+        QByteArray positions;
+        QByteArray counts;
+        QByteArray types;
+        QByteArray colors;
+
+        stream >> width;
+        stream >> height;
+        stream >> cells;
+        stream >> stitchCount;
+        stream >> positions;
+        stream >> counts;
+        stream >> types;
+        stream >> colorSize;
+        stream >> colors;
+
+        if ((stream.status() != QDataStream::Ok) || (width < 0) || (height < 0) || (qint64(width) * height > std::numeric_limits<int>::max()) || (cells < 0)
+            || (cells > qint64(width) * height) || (types.size() != stitchCount) || ((colorSize != 1) && (colorSize != 2) && (colorSize != 4))
+            || (colors.size() != qint64(stitchCount) * colorSize)) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data encoding")));
+        }
+
+        stitchData.resize(width, height);
+
+        const uchar *type = reinterpret_cast<const uchar *>(types.constData());
+        const uchar *color = reinterpret_cast<const uchar *>(colors.constData());
+        const uchar *lastType = type + types.size();
+        int positionIndex = 0;
+        int countIndex = 0;
+        int cellIndex = 0;
+
+        while (cells) {
+            quint32 gap = readVarint(positions, positionIndex);
+            quint32 run = readVarint(positions, positionIndex);
+
+            // the values are checked against the remaining cells before use so they cannot overflow
+            if ((gap > quint32(stitchData.m_stitches.count() - cellIndex)) || (run == 0) || (run > quint32(cells))
+                || (run > quint32(stitchData.m_stitches.count() - cellIndex) - gap)) {
+                throw FailedReadFile(QString(i18n("Invalid stitch data encoding")));
+            }
+
+            cellIndex += gap;
+            cells -= run;
+
+            while (run--) {
+                quint32 queueCount = readVarint(counts, countIndex);
+
+                if (queueCount > quint32(lastType - type)) {
+                    throw FailedReadFile(QString(i18n("Invalid stitch data encoding")));
+                }
+
+                StitchQueue *stitchQueue = new StitchQueue;
+                stitchQueue->reserve(queueCount);
+                stitchData.m_stitches[cellIndex++] = stitchQueue;
+
+                while (queueCount--) {
+                    if (!Stitch::isValidType(*type)) {
+                        throw FailedReadFile(QString(i18n("Invalid stitch type %1", int(*type))));
+                    }
+
+                    int colorIndex = (colorSize == 1) ? *color : (colorSize == 2) ? qFromLittleEndian<quint16>(color) : qFromLittleEndian<qint32>(color);
+                    stitchQueue->enqueue(new Stitch(static_cast<Stitch::Type>(*type++), colorIndex));
+                    color += colorSize;
+                }
+            }
+        }
+
+        if (type != lastType) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data encoding")));
+        }
+
+        stream >> count;
+
+        while (count--) {
+            Backstitch *backstitch = new Backstitch;
+            stream >> *(backstitch);
+            stitchData.addBackstitch(backstitch);
+        }
+
+        stream >> count;
+
+        while (count--) {
+            Knot *knot = new Knot;
+            stream >> *knot;
+            stitchData.addFrenchKnot(knot);
+        }
+
+        break;
+    }
+
     case 103:
         stream >> width;
         stream >> height;
@@ -1013,15 +1910,13 @@ QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
                 stream >> row;
 
                 StitchQueue *stitchQueue = new StitchQueue;
-                stitches[column][row] = stitchQueue;
                 stream >> *stitchQueue;
-            }
-        }
 
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                if (stitches[x][y]) {
-                    stitchData.replaceStitchQueueAt(x, y, stitches[x][y]);
+                // place the queue directly in the grid, discarding any out of range cells
+                if (stitchData.isValid(column, row)) {
+                    delete stitchData.replaceStitchQueueAt(column, row, stitchQueue);
+                } else {
+                    delete stitchQueue;
                 }
             }
         }
@@ -1062,15 +1957,13 @@ QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
                 stream >> row;
 
                 StitchQueue *stitchQueue = new StitchQueue;
-                stitches[column][row] = stitchQueue;
                 stream >> *stitchQueue;
-            }
-        }
 
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                if (stitches[x][y]) {
-                    stitchData.replaceStitchQueueAt(x, y, stitches[x][y]);
+                // place the queue directly in the grid, discarding any out of range cells
+                if (stitchData.isValid(column, row)) {
+                    delete stitchData.replaceStitchQueueAt(column, row, stitchQueue);
+                } else {
+                    delete stitchQueue;
                 }
             }
         }
@@ -1080,8 +1973,7 @@ QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
     case 100:
         stream >> width;
         stream >> height;
-        stitchData.m_width = width;
-        stitchData.m_height = height;
+        stitchData.resize(width, height);
 
         stream >> layers;
 
@@ -1101,16 +1993,14 @@ QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
                     stream >> row;
 
                     StitchQueue *stitchQueue = new StitchQueue;
-                    stitches[column][row] = stitchQueue;
                     stream >> *stitchQueue;
-                }
-            }
-        }
 
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                if (stitches[x][y]) {
-                    stitchData.replaceStitchQueueAt(x, y, stitches[x][y]);
+                    // place the queue directly in the grid, discarding any out of range cells
+                    if (stitchData.isValid(column, row)) {
+                        delete stitchData.replaceStitchQueueAt(column, row, stitchQueue);
+                    } else {
+                        delete stitchQueue;
+                    }
                 }
             }
         }
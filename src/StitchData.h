@@ -11,11 +11,14 @@
 #ifndef StitchData_H
 #define StitchData_H
 
+#include <QBitArray>
 #include <QList>
 #include <QListIterator>
 #include <QMap>
+#include <QPair>
 #include <QPoint>
 #include <QRect>
+#include <QSet>
 #include <QSharedDataPointer>
 #include <QVector>
 
@@ -42,10 +45,30 @@ class StitchData
 public:
     enum Rotation { Rotate90, Rotate180, Rotate270 };
 
+    using ColorChanges = QVector<QBitArray>;
+    using BackstitchChanges = QVector<QPair<int, Backstitch>>;
+    using KnotChanges = QVector<QPair<int, Knot>>;
+
+    struct Operation {
+        enum Type { Clear, Resize, InsertColumns, InsertRows, RemoveColumns, RemoveRows, Move, Mirror, Rotate, RemapColors, RestoreColors };
+
+        Type type = Clear;
+        int first = 0;                // the width, start column or row, dx, orientation or rotation
+        int second = 0;               // the height, number of columns or rows or dy
+        QMap<int, int> colorIndexes;  // the map of color indexes of a remap or restore
+        ColorChanges colorChanges;    // the changes of a restore
+    };
+
+    using Operations = QVector<Operation>;
+
     StitchData();
+    StitchData(const StitchData &);
     ~StitchData();
 
+    StitchData &operator=(const StitchData &);
+
     void clear();
+    void swap(StitchData &);
 
     int width() const;
     int height() const;
@@ -71,6 +94,8 @@ public:
     StitchQueue *takeStitchQueueAt(const QPoint &);
     StitchQueue *replaceStitchQueueAt(int, int, StitchQueue *);
     StitchQueue *replaceStitchQueueAt(const QPoint &, StitchQueue *);
+    void copyStitchQueues(const StitchData &, const QRect &);
+    void moveStitchQueues(StitchData &, const QRect &);
 
     void addBackstitch(const QPoint &, const QPoint &, int);
     void addBackstitch(Backstitch *);
@@ -94,6 +119,20 @@ public:
 
     QMap<int, FlossUsage> flossUsage();
 
+    ColorChanges remapColors(const QMap<int, int> &);
+    void remapColors(const QMap<int, int> &, const ColorChanges &);
+
+    void markChanged();
+    bool allCellsChanged() const;
+    QSet<int> changedCells() const;
+    bool allBackstitchesChanged() const;
+    BackstitchChanges backstitchChanges() const;
+    bool allKnotsChanged() const;
+    KnotChanges knotChanges() const;
+    Operations operations() const;
+    bool applyOperation(const Operation &);
+    void resetChanges();
+
     friend QDataStream &operator<<(QDataStream &, const StitchData &);
     friend QDataStream &operator>>(QDataStream &, StitchData &);
 
@@ -104,8 +143,16 @@ private:
     int index(int, int) const;
     int index(const QPoint &) const;
     bool isValid(int x, int y) const;
+    void cellChanged(int);
+    void beginOperation(const Operation &);
+    void endOperation();
+    void resizeQueues(int, int);
+    void appendBackstitch(Backstitch *);
+    bool removeBackstitch(Backstitch *);
+    void appendKnot(Knot *);
+    bool removeKnot(Knot *);
 
-    static const int version = 103;
+    static const int version = 104;
 
     int m_width;
     int m_height;
@@ -113,9 +160,19 @@ private:
     QVector<StitchQueue *> m_stitches;
     QList<Backstitch *> m_backstitches;
     QList<Knot *> m_knots;
+
+    QSet<int> m_changedCells;
+    bool m_allCellsChanged;
+    BackstitchChanges m_backstitchChanges;
+    bool m_allBackstitchesChanged;
+    KnotChanges m_knotChanges;
+    bool m_allKnotsChanged;
+    Operations m_operations;
 };
 
 QDataStream &operator<<(QDataStream &, const StitchData &);
 QDataStream &operator>>(QDataStream &, StitchData &);
+QDataStream &operator<<(QDataStream &, const StitchData::Operation &);
+QDataStream &operator>>(QDataStream &, StitchData::Operation &);
 
 #endif // StitchData_H